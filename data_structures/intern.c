@@ -0,0 +1,140 @@
+#include "intern.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug/malloc.h"
+
+// Entries live in pages that never move, so an ID can be looked up without taking the lock
+#define IDENT_PAGE_BITS 16
+#define IDENT_PAGE_SIZE ((size_t)1 << IDENT_PAGE_BITS)
+#define MAX_IDENT_PAGES ((size_t)1 << (32 - IDENT_PAGE_BITS))
+
+struct ident_entry {
+    sstr spelling;
+    uint32_t hash;
+    uint32_t flags;
+};
+
+// The first page is static, so NO_IDENT can be looked up even before anything is interned
+static struct ident_entry first_page[IDENT_PAGE_SIZE];
+static struct ident_entry *pages[MAX_IDENT_PAGES] = {first_page};
+static size_t n_idents; // including NO_IDENT
+
+/*
+ * Open addressing, with NO_IDENT in the empty slots. The number of slots is a power of 2, and at most half are used.
+ * Lookups don't take the lock: a slot is only written once the entry it points to is, and a table is never changed
+ * after it's replaced by a bigger one, only leaked, since another thread could still be reading it.
+ */
+struct slot_table {
+    size_t n_slots;
+    ident_id slots[];
+};
+static struct slot_table *table;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER; // for adding identifiers
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static struct ident_entry *get_entry(const ident_id id) {
+    return &pages[id >> IDENT_PAGE_BITS][id & (IDENT_PAGE_SIZE - 1)];
+}
+
+static uint32_t hash_spelling(const sstr spelling) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < spelling.len; i++) {
+        hash = (hash ^ spelling.data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// The slot that spelling is in, or the empty slot it would go in
+static size_t find_slot(const struct slot_table *const slot_table, const sstr spelling, const uint32_t hash) {
+    const size_t mask = slot_table->n_slots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const ident_id id = __atomic_load_n(&slot_table->slots[i], __ATOMIC_ACQUIRE);
+        if (id == NO_IDENT) return i;
+        const struct ident_entry *const entry = get_entry(id);
+        if (entry->hash == hash && sstrs_eq(entry->spelling, spelling)) return i;
+    }
+}
+
+static struct slot_table *new_slot_table(const size_t n_slots) {
+    struct slot_table *const slot_table = MALLOC(sizeof(struct slot_table) + n_slots * sizeof(ident_id));
+    slot_table->n_slots = n_slots;
+    memset(slot_table->slots, 0, n_slots * sizeof(ident_id));
+    return slot_table;
+}
+
+// Must be called with the lock held, and with spelling not in the table yet
+static ident_id add_ident(const sstr spelling, const uint32_t hash, const uint32_t flags) {
+    if (n_idents == MAX_IDENT_PAGES * IDENT_PAGE_SIZE) {
+        fprintf(stderr, "attempted to intern more than %zu identifiers\n", n_idents - 1);
+        exit(1);
+    }
+    const ident_id id = (ident_id)n_idents;
+    if (pages[id >> IDENT_PAGE_BITS] == NULL) pages[id >> IDENT_PAGE_BITS] = MALLOC(IDENT_PAGE_SIZE * sizeof(struct ident_entry));
+    unsigned char *const copy = MALLOC(spelling.len + 1);
+    memcpy(copy, spelling.data, spelling.len);
+    copy[spelling.len] = '\0';
+    *get_entry(id) = (struct ident_entry) { .spelling = { .data = copy, .len = spelling.len }, .hash = hash, .flags = flags };
+    n_idents++;
+
+    if (2 * n_idents <= table->n_slots) {
+        __atomic_store_n(&table->slots[find_slot(table, spelling, hash)], id, __ATOMIC_RELEASE);
+    } else {
+        struct slot_table *const bigger = new_slot_table(table->n_slots * 2);
+        for (ident_id i = 1; i <= id; i++) {
+            bigger->slots[find_slot(bigger, get_entry(i)->spelling, get_entry(i)->hash)] = i;
+        }
+        __atomic_store_n(&table, bigger, __ATOMIC_RELEASE);
+    }
+    return id;
+}
+
+static void init_table(void) {
+    table = new_slot_table(1024);
+    n_idents = 1; // NO_IDENT's entry is all zeros
+#define X(name, spelling, flags) { \
+        const sstr predefined = { .data = (unsigned char *)(spelling), .len = sizeof(spelling) - 1 }; \
+        add_ident(predefined, hash_spelling(predefined), (flags)); \
+    }
+    PREDEFINED_IDENTIFIERS(X)
+#undef X
+}
+
+ident_id intern(const sstr spelling) {
+    pthread_once(&table_once, init_table);
+    const uint32_t hash = hash_spelling(spelling);
+
+    const struct slot_table *const current = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+    ident_id id = __atomic_load_n(&current->slots[find_slot(current, spelling, hash)], __ATOMIC_ACQUIRE);
+    if (id != NO_IDENT) return id;
+
+    pthread_mutex_lock(&table_lock);
+    // Another thread could have added it in between
+    id = table->slots[find_slot(table, spelling, hash)];
+    if (id == NO_IDENT) id = add_ident(spelling, hash, 0);
+    pthread_mutex_unlock(&table_lock);
+    return id;
+}
+
+sstr ident_spelling(const ident_id id) {
+    return get_entry(id)->spelling;
+}
+
+uint32_t ident_hash(const ident_id id) {
+    return get_entry(id)->hash;
+}
+
+uint32_t ident_flags(const ident_id id) {
+    return get_entry(id)->flags;
+}
+
+size_t hash_ident_id(const ident_id id, const size_t n_buckets) {
+    return id % n_buckets;
+}
+
+bool ident_ids_eq(const ident_id id1, const ident_id id2) {
+    return id1 == id2;
+}
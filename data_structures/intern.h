@@ -0,0 +1,60 @@
+#ifndef ICK_INTERN_H
+#define ICK_INTERN_H
+
+#include <stdint.h>
+#include "sstr.h"
+#include "vector.h"
+
+/*
+ * Identifiers are interned in one table shared by every thread, which gives each distinct spelling a dense ID, so
+ * comparing identifiers is comparing integers. IDs are never freed, and NO_IDENT is never given out.
+ * The predefined identifiers are interned first, in order, so their IDs are the constants in enum predefined_ident.
+ */
+typedef uint32_t ident_id;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(ident_id)
+#define NO_IDENT 0
+
+enum ident_flag {
+    IDENT_FLAG_DIRECTIVE_NAME = 1 << 0,
+    IDENT_FLAG_KEYWORD = 1 << 1
+};
+
+#define PREDEFINED_IDENTIFIERS(X) \
+    X(DEFINE, "define", IDENT_FLAG_DIRECTIVE_NAME) X(UNDEF, "undef", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(IF, "if", IDENT_FLAG_DIRECTIVE_NAME | IDENT_FLAG_KEYWORD) X(IFDEF, "ifdef", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(IFNDEF, "ifndef", IDENT_FLAG_DIRECTIVE_NAME) X(ELIF, "elif", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(ELSE, "else", IDENT_FLAG_DIRECTIVE_NAME | IDENT_FLAG_KEYWORD) X(ENDIF, "endif", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(INCLUDE, "include", IDENT_FLAG_DIRECTIVE_NAME) X(LINE, "line", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(ERROR, "error", IDENT_FLAG_DIRECTIVE_NAME) X(PRAGMA, "pragma", IDENT_FLAG_DIRECTIVE_NAME) \
+    X(DEFINED, "defined", 0) X(ONCE, "once", 0) X(VA_ARGS, "__VA_ARGS__", 0) \
+    X(AUTO, "auto", IDENT_FLAG_KEYWORD) X(BREAK, "break", IDENT_FLAG_KEYWORD) X(CASE, "case", IDENT_FLAG_KEYWORD) \
+    X(CHAR, "char", IDENT_FLAG_KEYWORD) X(CONST, "const", IDENT_FLAG_KEYWORD) X(CONTINUE, "continue", IDENT_FLAG_KEYWORD) \
+    X(DEFAULT, "default", IDENT_FLAG_KEYWORD) X(DO, "do", IDENT_FLAG_KEYWORD) X(DOUBLE, "double", IDENT_FLAG_KEYWORD) \
+    X(ENUM, "enum", IDENT_FLAG_KEYWORD) X(EXTERN, "extern", IDENT_FLAG_KEYWORD) X(FLOAT, "float", IDENT_FLAG_KEYWORD) \
+    X(FOR, "for", IDENT_FLAG_KEYWORD) X(GOTO, "goto", IDENT_FLAG_KEYWORD) X(INLINE, "inline", IDENT_FLAG_KEYWORD) \
+    X(INT, "int", IDENT_FLAG_KEYWORD) X(LONG, "long", IDENT_FLAG_KEYWORD) X(REGISTER, "register", IDENT_FLAG_KEYWORD) \
+    X(RESTRICT, "restrict", IDENT_FLAG_KEYWORD) X(RETURN, "return", IDENT_FLAG_KEYWORD) X(SHORT, "short", IDENT_FLAG_KEYWORD) \
+    X(SIGNED, "signed", IDENT_FLAG_KEYWORD) X(SIZEOF, "sizeof", IDENT_FLAG_KEYWORD) X(STATIC, "static", IDENT_FLAG_KEYWORD) \
+    X(STRUCT, "struct", IDENT_FLAG_KEYWORD) X(SWITCH, "switch", IDENT_FLAG_KEYWORD) X(TYPEDEF, "typedef", IDENT_FLAG_KEYWORD) \
+    X(UNION, "union", IDENT_FLAG_KEYWORD) X(UNSIGNED, "unsigned", IDENT_FLAG_KEYWORD) X(VOID, "void", IDENT_FLAG_KEYWORD) \
+    X(VOLATILE, "volatile", IDENT_FLAG_KEYWORD) X(WHILE, "while", IDENT_FLAG_KEYWORD) X(BOOL, "_Bool", IDENT_FLAG_KEYWORD) \
+    X(COMPLEX, "_Complex", IDENT_FLAG_KEYWORD) X(IMAGINARY, "_Imaginary", IDENT_FLAG_KEYWORD)
+
+enum predefined_ident {
+    IDENT_BEFORE_PREDEFINED = NO_IDENT,
+#define X(name, spelling, flags) IDENT_##name,
+    PREDEFINED_IDENTIFIERS(X)
+#undef X
+};
+
+// Returns the ID of spelling, giving it a new one if it's the first time it's been seen. The spelling is copied.
+ident_id intern(sstr spelling);
+
+sstr ident_spelling(ident_id id);
+uint32_t ident_hash(ident_id id);
+uint32_t ident_flags(ident_id id);
+
+size_t hash_ident_id(ident_id id, size_t n_buckets);
+bool ident_ids_eq(ident_id id1, ident_id id2);
+
+#endif //ICK_INTERN_H
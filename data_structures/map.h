@@ -54,6 +54,7 @@
                 .value = value,                                                                                                                     \
                 .next = NULL                                                                                                                        \
             };                                                                                                                                      \
+            map_p->n_elements++;                                                                                                                    \
             return;                                                                                                                                 \
         }                                                                                                                                           \
         while (node->next != NULL) {                                                                                                                \
@@ -104,6 +105,20 @@
         exit(1);                                                                                                    \
     }
 
+#define DEFINE_MAP_GET_PTR_FUNCTION(_key_t, _value_t)                                                                   \
+    __attribute__((unused))                                                                                             \
+    static _value_t *_key_t##_##_value_t##_map_get_ptr(const _key_t##_##_value_t##_map *const map_p, const _key_t key) { \
+        const size_t entry_index = map_p->hash_func(key, map_p->n_buckets);                                             \
+        NODE_T(_key_t, _value_t) *node = map_p->buckets[entry_index];                                                   \
+        while (node != NULL) {                                                                                          \
+            if (map_p->keys_equal_func(node->key, key)) {                                                               \
+                return &node->value;                                                                                    \
+            }                                                                                                           \
+            node = node->next;                                                                                          \
+        }                                                                                                               \
+        return NULL;                                                                                                    \
+    }
+
 #define DEFINE_MAP_CONTAINS_FUNCTION(_key_t, _value_t)                                                               \
     __attribute__((unused))                                                                                          \
     static bool _key_t##_##_value_t##_map_contains(const _key_t##_##_value_t##_map *const map_p, const _key_t key) { \
@@ -169,6 +184,7 @@
     DEFINE_MAP_ADD_UNCHECKED_NO_EXPAND_FUNCTION(_key_t, _value_t)                     \
     DEFINE_MAP_EXPAND_FUNCTION(_key_t, _value_t)                                      \
     DEFINE_MAP_GET_FUNCTION(_key_t, _value_t)                                         \
+    DEFINE_MAP_GET_PTR_FUNCTION(_key_t, _value_t)                                     \
     DEFINE_MAP_CONTAINS_FUNCTION(_key_t, _value_t)                                    \
     DEFINE_MAP_ADD_FUNCTION(_key_t, _value_t)                                         \
     DEFINE_MAP_REMOVE_FUNCTION(_key_t, _value_t)                                      \
@@ -22,7 +22,7 @@ bool sstrs_eq(const sstr t1, const sstr t2) {
 sstr slice(const sstr str, const size_t begin, const size_t end) {
     if (begin > end || begin > str.len || end > str.len) {
         // TODO change to internal_error
-        preprocessor_fatal_error(0, 0, 0, "invalid value of begin and/or end in slice");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "invalid value of begin and/or end in slice");
     }
     return (sstr) { .data = &str.data[begin], .len = end-begin };
 }
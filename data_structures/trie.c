@@ -1,9 +1,64 @@
 #include "trie.h"
-#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug/malloc.h"
 
-struct trie *trie_get_child(const struct trie *const trie, const unsigned char c) {
-    for (size_t i = 0; i < trie->n_children; i++) {
-        if (trie->children[i].val == c) return &trie->children[i];
+static dense_trie_node add_dense_trie_node(struct dense_trie *const trie) {
+    if (trie->n_nodes > UINT16_MAX) {
+        fprintf(stderr, "attempted to add more than %d nodes to a dense trie\n", UINT16_MAX + 1);
+        exit(1);
     }
-    return NULL;
+    if (trie->n_nodes == trie->capacity) {
+        trie->capacity *= 2;
+        trie->children = REALLOC(trie->children, trie->capacity * sizeof(*trie->children));
+        trie->values = REALLOC(trie->values, trie->capacity * sizeof(int));
+    }
+    const dense_trie_node node = (dense_trie_node)trie->n_nodes++;
+    memset(trie->children[node], 0, sizeof(*trie->children));
+    trie->values[node] = DENSE_TRIE_NO_VALUE;
+    return node;
+}
+
+struct dense_trie dense_trie_new(void) {
+    struct dense_trie trie = {
+        .children = MALLOC(8 * sizeof(*trie.children)),
+        .values = MALLOC(8 * sizeof(int)),
+        .n_nodes = 0,
+        .capacity = 8
+    };
+    add_dense_trie_node(&trie); // the root
+    return trie;
+}
+
+void dense_trie_insert(struct dense_trie *const trie, const unsigned char *const str, const size_t len, const int value) {
+    dense_trie_node node = DENSE_TRIE_ROOT;
+    for (size_t i = 0; i < len; i++) {
+        if (trie->children[node][str[i]] == DENSE_TRIE_ROOT) {
+            const dense_trie_node child = add_dense_trie_node(trie);
+            trie->children[node][str[i]] = child;
+        }
+        node = trie->children[node][str[i]];
+    }
+    trie->values[node] = value;
+}
+
+void dense_trie_free_internals(struct dense_trie *const trie) {
+    FREE(trie->children);
+    FREE(trie->values);
+}
+
+size_t dense_trie_longest_match(const struct dense_trie *const trie, const unsigned char *const str, const size_t len, int *const value) {
+    size_t match_len = 0;
+    *value = trie->values[DENSE_TRIE_ROOT];
+    dense_trie_node node = DENSE_TRIE_ROOT;
+    for (size_t i = 0; i < len; i++) {
+        node = dense_trie_child(trie, node, str[i]);
+        if (node == DENSE_TRIE_ROOT) break;
+        if (trie->values[node] != DENSE_TRIE_NO_VALUE) {
+            match_len = i + 1;
+            *value = trie->values[node];
+        }
+    }
+    return match_len;
 }
@@ -1,16 +1,38 @@
 #ifndef ICK_TRIE_H
 #define ICK_TRIE_H
 
+#include <stddef.h>
 #include <stdint.h>
-#include <stdbool.h>
 
-struct trie {
-    struct trie *children;
-    uint_fast8_t n_children;
-    bool match;
-    unsigned char val;
+/*
+ * A trie whose nodes keep their children in a table indexed by byte, so finding a child is a single load instead of
+ * a search. Node 0 is the root, and since the root isn't anyone's child, a child of 0 means there isn't one.
+ * Every node that a string ends at has the value it was inserted with; the others have DENSE_TRIE_NO_VALUE.
+ */
+typedef uint16_t dense_trie_node;
+#define DENSE_TRIE_ROOT 0
+#define DENSE_TRIE_NO_VALUE (-1)
+
+struct dense_trie {
+    dense_trie_node (*children)[256];
+    int *values;
+    size_t n_nodes;
+    size_t capacity;
 };
 
-struct trie *trie_get_child(const struct trie *trie, unsigned char c);
+struct dense_trie dense_trie_new(void);
+// Adds the len bytes of str, which end at a node with the given value (which can't be DENSE_TRIE_NO_VALUE)
+void dense_trie_insert(struct dense_trie *trie, const unsigned char *str, size_t len, int value);
+void dense_trie_free_internals(struct dense_trie *trie);
+
+static inline dense_trie_node dense_trie_child(const struct dense_trie *const trie, const dense_trie_node node, const unsigned char c) {
+    return trie->children[node][c];
+}
+
+/*
+ * Finds the longest string in the trie that str starts with. Returns its length (0 if there's none), and sets *value
+ * to its value.
+ */
+size_t dense_trie_longest_match(const struct dense_trie *trie, const unsigned char *str, size_t len, int *value);
 
 #endif //ICK_TRIE_H
@@ -95,5 +95,7 @@ static void _type##_vec_free_internals(const _type##_vec *const vec_p) { \
     DEFINE_VEC_FREE_INTERNALS_FUNCTION(_type)         \
 
 DEFINE_VEC_TYPE_AND_FUNCTIONS(size_t)
+typedef char *char_p;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(char_p)
 
 #endif // ICK_DATA_STRUCTURES_VECTOR_VECTOR_H
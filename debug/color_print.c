@@ -3,6 +3,7 @@
 //
 
 #include "color_print.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -52,11 +53,11 @@ void set_color(const enum text_color color) {
             color_code = "\033[1;37m";
             break;
     }
-    printf("%s", color_code);
+    fprintf(trace_file(), "%s", color_code);
 }
 
 void clear_color(void) {
-    printf("\033[0m");
+    fprintf(trace_file(), "\033[0m");
 }
 
 __attribute__((format(printf, 2, 3)))
@@ -64,7 +65,7 @@ void print_with_color(const enum text_color color, const char *const text, ...)
     va_list args;
     va_start(args, text);
     set_color(color);
-    vprintf(text, args);
+    vfprintf(trace_file(), text, args);
     clear_color();
     va_end(args);
 }
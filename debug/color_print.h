@@ -8,6 +8,7 @@
 enum text_color { TEXT_COLOR_RED, TEXT_COLOR_GREEN, TEXT_COLOR_BROWN_ORANGE, TEXT_COLOR_BLUE, TEXT_COLOR_MAGENTA, TEXT_COLOR_CYAN, TEXT_COLOR_WHITE,
         TEXT_COLOR_LIGHT_RED, TEXT_COLOR_LIGHT_GREEN, TEXT_COLOR_YELLOW, TEXT_COLOR_LIGHT_BLUE, TEXT_COLOR_LIGHT_PURPLE, TEXT_COLOR_LIGHT_CYAN, TEXT_COLOR_BOLD_WHITE };
 
+// These write to the trace file (see trace.h)
 void set_color(enum text_color color);
 void clear_color(void);
 
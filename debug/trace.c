@@ -0,0 +1,58 @@
+#include "trace.h"
+#include <string.h>
+
+#define TRACE_BUFFER_SIZE (256 * 1024)
+
+enum trace_level trace_levels[N_TRACE_CATEGORIES];
+
+static const char *const category_names[] = {
+#define X(category, name) [TRACE_##category] = (name),
+    TRACE_CATEGORIES(X)
+#undef X
+};
+
+// Parses one "category" or "category:level", of length len
+static bool parse_trace_item(const char *const item, const size_t len, enum trace_level levels[N_TRACE_CATEGORIES]) {
+    const char *const colon = memchr(item, ':', len);
+    const size_t name_len = colon == NULL ? len : (size_t)(colon - item);
+    enum trace_level level = TRACE_BASIC;
+    if (colon != NULL) {
+        if (len - name_len != 2) return false;
+        if (colon[1] == '1') level = TRACE_BASIC;
+        else if (colon[1] == '2') level = TRACE_DETAILED;
+        else return false;
+    }
+    for (size_t i = 0; i < N_TRACE_CATEGORIES; i++) {
+        if (strlen(category_names[i]) == name_len && strncmp(category_names[i], item, name_len) == 0) {
+            if (level > levels[i]) levels[i] = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool set_trace_levels(const char *const spec) {
+    enum trace_level levels[N_TRACE_CATEGORIES];
+    memcpy(levels, trace_levels, sizeof(levels));
+    const char *item = spec;
+    while (true) {
+        const char *const comma = strchr(item, ',');
+        const size_t len = comma == NULL ? strlen(item) : (size_t)(comma - item);
+        if (!parse_trace_item(item, len, levels)) return false;
+        if (comma == NULL) break;
+        item = comma + 1;
+    }
+    memcpy(trace_levels, levels, sizeof(levels));
+    // Static, since stderr can be written to until the very end
+    static char buffer[TRACE_BUFFER_SIZE];
+    static bool buffered = false;
+    if (!buffered) {
+        setvbuf(stderr, buffer, _IOFBF, TRACE_BUFFER_SIZE);
+        buffered = true;
+    }
+    return true;
+}
+
+FILE *trace_file(void) {
+    return stderr;
+}
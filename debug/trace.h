@@ -0,0 +1,51 @@
+#ifndef ICK_TRACE_H
+#define ICK_TRACE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Debug output, in categories that are turned on separately with --trace=category[:level],... Level 1 (the default) is
+ * about one line per thing the category is about; level 2 adds detail that can be quadratic in the size of the input.
+ * Traces are only compiled in with ICK_TRACING defined. Without it, TRACING is always 0, and the code behind it is
+ * compiled out; with it, a category that's off costs one well-predicted branch.
+ */
+#define TRACE_CATEGORIES(X) \
+    X(LEXER, "lexer") /* 1: every token of every lexed file */ \
+    X(EARLEY, "earley") /* 1: every chart of every parse; 2: every item, as it's predicted, scanned, or completed */ \
+    X(MACRO, "macro") /* 1: every macro expansion; 2: every macro defined so far, after each #define */ \
+    X(COND, "cond") /* 1: the tree of every #if expression, and the value of every character constant in one */ \
+    X(INCLUDE, "include") /* 1: the file each #include resolves to; 2: the ones that are skipped */
+
+enum trace_category {
+#define X(category, name) TRACE_##category,
+    TRACE_CATEGORIES(X)
+#undef X
+    N_TRACE_CATEGORIES
+};
+
+enum trace_level {
+    TRACE_OFF, TRACE_BASIC, TRACE_DETAILED
+};
+
+#ifdef ICK_TRACING
+extern enum trace_level trace_levels[N_TRACE_CATEGORIES];
+#define TRACING(category, level) __builtin_expect(trace_levels[TRACE_##category] >= (level), 0)
+#else
+#define TRACING(category, level) 0
+#endif
+
+/*
+ * Turns on the categories in spec, a comma-separated list like "earley,macro:2". Returns false, and changes nothing,
+ * if spec names a category that doesn't exist or a level other than 1 or 2.
+ * Must be called before any other thread starts, and before anything is written to standard error.
+ */
+bool set_trace_levels(const char *spec);
+
+/*
+ * Where traces are written: standard error, which is made fully buffered once a category is turned on, so that traces
+ * don't cost a write each. (Errors go through the same buffer, so they still come out after the traces before them.)
+ */
+FILE *trace_file(void);
+
+#endif //ICK_TRACE_H
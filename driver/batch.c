@@ -0,0 +1,346 @@
+#include "batch.h"
+#include "diagnostics.h"
+#include "file_utils.h"
+#include "output_sink.h"
+#include "source_buffer.h"
+#include "debug/malloc.h"
+#include "preprocessor/file_cache.h"
+#include "preprocessor/header_search.h"
+#include "preprocessor/preprocessor.h"
+#include "preprocessor/token_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+batch_entry batch_entry_new(const char *const input_fname) {
+    char *const input_copy = MALLOC(strlen(input_fname) + 1);
+    strcpy(input_copy, input_fname);
+    char *output_fname;
+    if (is_stdio_fname(input_fname)) {
+        output_fname = MALLOC(sizeof(STDIO_FNAME));
+        strcpy(output_fname, STDIO_FNAME);
+    } else {
+        output_fname = new_fname_ext(input_fname, PREPROCESSED_EXT);
+    }
+    return (batch_entry) {
+        .input_fname = input_copy,
+        .output_fname = output_fname,
+        .defines = char_p_vec_new(0),
+        .quote_dirs = char_p_vec_new(0),
+        .include_dirs = char_p_vec_new(0),
+        .system_dirs = char_p_vec_new(0),
+        .dependencies = dependency_options_new(),
+        .object_fname = NULL
+    };
+}
+
+bool parse_entry_flag(batch_entry *const entry, const char_p_harr args, size_t *const i, const char *const dir) {
+    const char *const arg = args.data[*i];
+    const char *const flags[] = { "-D", "-iquote", "-isystem", "-I" };
+    char_p_vec *const destinations[] = { &entry->defines, &entry->quote_dirs, &entry->system_dirs, &entry->include_dirs };
+    for (size_t flag_index = 0; flag_index < sizeof(flags) / sizeof(flags[0]); flag_index++) {
+        const size_t flag_len = strlen(flags[flag_index]);
+        if (strncmp(arg, flags[flag_index], flag_len) != 0) continue;
+        const char *value = &arg[flag_len];
+        if (value[0] == '\0') {
+            if (*i + 1 == args.len) driver_error("Missing argument to %s.", arg);
+            (*i)++;
+            value = args.data[*i];
+        }
+        // Macro definitions aren't paths, so they're never resolved
+        char_p_vec_append(destinations[flag_index], flag_index == 0 ? resolve_path(NULL, value) : resolve_path(dir, value));
+        return true;
+    }
+    return false;
+}
+
+void append_entry_flags(batch_entry *const dest, const batch_entry *const src) {
+    char_p_vec_append_all(&dest->defines, src->defines);
+    char_p_vec_append_all(&dest->quote_dirs, src->quote_dirs);
+    char_p_vec_append_all(&dest->include_dirs, src->include_dirs);
+    char_p_vec_append_all(&dest->system_dirs, src->system_dirs);
+    append_dependency_options(&dest->dependencies, &src->dependencies);
+}
+
+static bool is_space(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+char_p_vec split_command_line(const char *const cmdline, const size_t len) {
+    char_p_vec args = char_p_vec_new(0);
+    size_t i = 0;
+    while (true) {
+        while (i < len && is_space(cmdline[i])) i++;
+        if (i == len) break;
+        uchar_vec arg = uchar_vec_new(0);
+        char quote = '\0';
+        for (; i < len && (quote != '\0' || !is_space(cmdline[i])); i++) {
+            const char c = cmdline[i];
+            if (quote == '\'') {
+                if (c == '\'') quote = '\0';
+                else uchar_vec_append(&arg, (unsigned char)c);
+            } else if (c == '\\' && i + 1 < len && (quote == '\0' || strchr("\"\\$`", cmdline[i+1]) != NULL)) {
+                i++;
+                uchar_vec_append(&arg, (unsigned char)cmdline[i]);
+            } else if (c == '"' && quote == '"') {
+                quote = '\0';
+            } else if ((c == '"' || c == '\'') && quote == '\0') {
+                quote = c;
+            } else {
+                uchar_vec_append(&arg, (unsigned char)c);
+            }
+        }
+        if (quote != '\0') driver_error("Unterminated %c quote in \"%.*s\".", quote, (int)len, cmdline);
+        uchar_vec_append(&arg, '\0');
+        char_p_vec_append(&args, (char *)arg.arr.data);
+    }
+    return args;
+}
+
+char_p_vec read_response_file(const char *const fname) {
+    struct source_buffer buf;
+    if (!open_source_buffer(fname, &buf)) {
+        driver_error("Response file \"%s\" does not exist.", fname);
+    }
+    const char_p_vec args = split_command_line((const char *)buf.contents.data, buf.contents.len);
+    close_source_buffer(&buf);
+    return args;
+}
+
+struct preprocessor_options entry_preprocessor_options(const batch_entry *const entry, const struct pch *const pch) {
+    return (struct preprocessor_options) {
+        .defines = entry->defines.arr,
+        .search_path = {
+            .quote_dirs = entry->quote_dirs.arr,
+            .dirs = entry->include_dirs.arr,
+            .system_dirs = entry->system_dirs.arr
+        },
+        .pch = pch
+    };
+}
+
+bool is_stdio_fname(const char *const fname) {
+    return strcmp(fname, STDIO_FNAME) == 0;
+}
+
+struct source_buffer open_entry_input(const batch_entry *const entry) {
+    if (is_stdio_fname(entry->input_fname)) return read_source_buffer_fd(STDIN_FILENO);
+    struct source_buffer input;
+    if (!open_source_buffer(entry->input_fname, &input)) {
+        driver_error("Input file \"%s\" does not exist.", entry->input_fname);
+    }
+    return input;
+}
+
+// Like gcc, the default target is the object file, which is named after the input without its directories
+static char *default_dependency_target(const batch_entry *const entry) {
+    if (entry->object_fname != NULL) return resolve_path(NULL, entry->object_fname);
+    const char *const last_slash = strrchr(entry->input_fname, '/');
+    return new_fname_ext(last_slash == NULL ? entry->input_fname : last_slash + 1, ".o");
+}
+
+void preprocess_entry(const batch_entry *const entry, const struct batch_options *const options) {
+    const bool writes_output = !entry->dependencies.instead_of_output;
+    const bool to_stdout = writes_output && is_stdio_fname(entry->output_fname);
+    if (writes_output && !to_stdout && strcmp(entry->input_fname, entry->output_fname) == 0) {
+        driver_error("The output filename, \"%s\", is the same as the input filename.", entry->output_fname);
+    }
+    const struct source_buffer input = open_entry_input(entry);
+    const char *const output_fname = writes_output ? entry->output_fname : "/dev/null";
+    // /dev/null isn't one of the job's outputs, so it mustn't be deleted if the job fails
+    const int output_fd = to_stdout ? STDOUT_FILENO : writes_output ? open_output_file(output_fname) : open(output_fname, O_WRONLY);
+    if (output_fd == -1) {
+        driver_error("Couldn't open output file \"%s\". Errno: %d (%s).", output_fname, errno, strerror(errno));
+    }
+    struct output_sink output = output_sink_new(output_fd);
+    struct token_printer printer = token_printer_new(&output, options->print_mode);
+    struct preprocessor_options preprocessor_options = entry_preprocessor_options(entry, options->pch);
+    char_p_vec dependencies = char_p_vec_new(0);
+    if (entry->dependencies.enabled) {
+        // Every dependency is found by the same run that writes the output, so no file is read twice
+        preprocessor_options.dependencies = &dependencies;
+        preprocessor_options.skip_system_dependencies = entry->dependencies.skip_system_headers;
+    }
+    preprocess_file(input, entry->input_fname, preprocessor_options, &printer);
+    output_sink_free(&output);
+    if (!to_stdout) close_output_file(output_fd);
+
+    if (entry->dependencies.enabled) {
+        char *const target = default_dependency_target(entry);
+        char *const depfile_fname = new_fname_ext(entry->output_fname, ".d");
+        write_depfile(&entry->dependencies, entry->input_fname, dependencies.arr, target, depfile_fname);
+        FREE(target);
+        FREE(depfile_fname);
+    }
+    // The paths themselves belong to the translation unit's include map
+    FREE(dependencies.arr.data);
+}
+
+void dump_entry_tokens(const batch_entry *const entry) {
+    const bool from_stdin = is_stdio_fname(entry->input_fname);
+    const int fd = from_stdin ? STDIN_FILENO : open(entry->input_fname, O_RDONLY);
+    if (fd == -1) driver_error("Input file \"%s\" does not exist.", entry->input_fname);
+    struct lexer *const lexer = lexer_new(fd, DISCARD_COMMENTS);
+    struct preprocessing_token token;
+    while (next_token(lexer, &token)) {
+        print_token_info(stdout, token, false);
+    }
+    lexer_free(lexer);
+    if (!from_stdin) close(fd);
+}
+
+void emit_pch_for_entry(const batch_entry *const entry, const char *const pch_fname) {
+    if (strcmp(entry->input_fname, pch_fname) == 0) {
+        driver_error("The PCH filename, \"%s\", is the same as the input filename.", pch_fname);
+    }
+    emit_pch(open_entry_input(entry), entry->input_fname, entry_preprocessor_options(entry, NULL), pch_fname);
+}
+
+void print_token_cache_stats(void) {
+    if (!token_cache_enabled()) return;
+    const struct token_cache_stats stats = token_cache_get_stats();
+    const size_t n_lookups = stats.hits + stats.misses;
+    printf("Token cache: %zu hits, %zu misses (%.1f%% hit rate), %.2f MiB mapped\n", stats.hits, stats.misses,
+           n_lookups == 0 ? 0.0 : 100.0 * (double)stats.hits / (double)n_lookups, (double)stats.bytes_mapped / (1024.0 * 1024.0));
+}
+
+struct sized_entry {
+    const batch_entry *entry;
+    size_t size;
+};
+
+static int compare_by_size_descending(const void *const a, const void *const b) {
+    const size_t size_a = ((const struct sized_entry *)a)->size;
+    const size_t size_b = ((const struct sized_entry *)b)->size;
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+/*
+ * Each worker owns a deque of entries, dealt out round-robin from the list sorted by size,
+ * so every deque starts with its largest entry. Owners take from the front; idle workers steal from the back of
+ * someone else's deque, so the two rarely want the same end.
+ */
+struct work_deque {
+    pthread_mutex_t lock;
+    struct sized_entry *items;
+    size_t front;
+    size_t back; // one past the last item
+};
+
+struct batch_worker {
+    pthread_t thread;
+    size_t index;
+    struct work_deque *deques;
+    size_t n_workers;
+    const struct batch_options *options;
+};
+
+static bool take_work(struct work_deque *const deque, const bool from_front, struct sized_entry *const out) {
+    pthread_mutex_lock(&deque->lock);
+    const bool found = deque->front < deque->back;
+    if (found) {
+        *out = from_front ? deque->items[deque->front++] : deque->items[--deque->back];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static double seconds_since(const struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void *batch_worker_main(void *const arg) {
+    const struct batch_worker *const worker = arg;
+    while (true) {
+        struct sized_entry work;
+        bool found = take_work(&worker->deques[worker->index], true, &work);
+        for (size_t i = 1; !found && i < worker->n_workers; i++) {
+            found = take_work(&worker->deques[(worker->index + i) % worker->n_workers], false, &work);
+        }
+        // Nothing new is ever added, so once every deque is empty, the batch is done
+        if (!found) return NULL;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        preprocess_entry(work.entry, worker->options);
+        printf("%s: %.2f ms\n", work.entry->input_fname, seconds_since(start) * 1e3);
+    }
+}
+
+void run_batch(const batch_entry_harr entries, const struct batch_options options) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t n_workers = options.n_threads;
+    if (n_workers == 0) {
+        const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = n_cpus > 0 ? (size_t)n_cpus : 1;
+    }
+    if (n_workers > entries.len) n_workers = entries.len;
+    if (n_workers == 0) return;
+
+    struct sized_entry *const sorted = MALLOC(entries.len * sizeof(struct sized_entry));
+    size_t total_size = 0;
+    for (size_t i = 0; i < entries.len; i++) {
+        struct stat st;
+        // If the file can't be stat'd, the error is reported when it's preprocessed
+        const size_t size = stat(entries.data[i].input_fname, &st) == 0 ? (size_t)st.st_size : 0;
+        sorted[i] = (struct sized_entry) { .entry = &entries.data[i], .size = size };
+        total_size += size;
+    }
+    qsort(sorted, entries.len, sizeof(struct sized_entry), compare_by_size_descending);
+
+    struct work_deque *const deques = MALLOC(n_workers * sizeof(struct work_deque));
+    for (size_t w = 0; w < n_workers; w++) {
+        pthread_mutex_init(&deques[w].lock, NULL);
+        deques[w].items = MALLOC((entries.len / n_workers + 1) * sizeof(struct sized_entry));
+        deques[w].front = 0;
+        deques[w].back = 0;
+    }
+    for (size_t i = 0; i < entries.len; i++) {
+        struct work_deque *const deque = &deques[i % n_workers];
+        deque->items[deque->back++] = sorted[i];
+    }
+
+    struct batch_worker *const workers = MALLOC(n_workers * sizeof(struct batch_worker));
+    for (size_t w = 0; w < n_workers; w++) {
+        workers[w] = (struct batch_worker) {
+            .index = w,
+            .deques = deques,
+            .n_workers = n_workers,
+            .options = &options
+        };
+        const int err = pthread_create(&workers[w].thread, NULL, batch_worker_main, &workers[w]);
+        if (err != 0) driver_error("Couldn't start worker thread. Errno: %d (%s).", err, strerror(err));
+    }
+    for (size_t w = 0; w < n_workers; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+
+    const double elapsed = seconds_since(start);
+    const double mib = (double)total_size / (1024.0 * 1024.0);
+    printf("\nPreprocessed %zu files (%.2f MiB) with %zu threads in %.3f s: %.1f files/s, %.2f MiB/s\n",
+           entries.len, mib, n_workers, elapsed, (double)entries.len / elapsed, mib / elapsed);
+    const struct file_cache_stats cache_stats = file_cache_get_stats();
+    printf("Included file cache: %zu hits, %zu misses\n", cache_stats.hits, cache_stats.misses);
+    const struct header_search_stats search_stats = header_search_get_stats();
+    printf("Header search: %zu lookups (%zu negative), %zu directory reads, %zu stat calls\n",
+           search_stats.lookups, search_stats.negative_lookups, search_stats.directory_reads, search_stats.stat_calls);
+    print_token_cache_stats();
+
+    for (size_t w = 0; w < n_workers; w++) {
+        pthread_mutex_destroy(&deques[w].lock);
+        FREE(deques[w].items);
+    }
+    FREE(workers);
+    FREE(deques);
+    FREE(sorted);
+}
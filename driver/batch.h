@@ -0,0 +1,106 @@
+#ifndef ICK_BATCH_H
+#define ICK_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "depfile.h"
+#include "source_buffer.h"
+#include "data_structures/vector.h"
+#include "preprocessor/pch.h"
+#include "preprocessor/pp_token.h"
+#include "preprocessor/preprocessor.h"
+
+// As an input filename, stands for standard input, and then the output goes to standard output
+#define STDIO_FNAME "-"
+
+/*
+ * One translation unit to preprocess, with its own output path and flags.
+ */
+typedef struct batch_entry {
+    char *input_fname;
+    char *output_fname;
+    char_p_vec defines; // NAME or NAME=VALUE, as given to -D
+    char_p_vec quote_dirs; // -iquote
+    char_p_vec include_dirs; // -I
+    char_p_vec system_dirs; // -isystem
+    struct dependency_options dependencies; // -M and friends
+    char *object_fname; // the compiler's output, which is the default target of the dependency rule; NULL if unknown
+} batch_entry;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(batch_entry)
+
+struct batch_options {
+    size_t n_threads; // 0 means one per online CPU
+    enum token_print_mode print_mode;
+    const struct pch *pch; // the prefix every entry starts with, from --include-pch; NULL if there isn't one
+};
+
+/*
+ * Makes an entry whose output goes next to the input file, with the extension changed to .i (or to standard output,
+ * if the input is STDIO_FNAME).
+ */
+batch_entry batch_entry_new(const char *input_fname);
+
+/*
+ * If args.data[*i] is a -D, -I, -iquote, or -isystem flag, adds it to entry, and moves *i to the flag's value if the
+ * value is a separate argument (as in "-I dir" rather than "-Idir"). Relative directories are resolved against dir,
+ * unless dir is NULL. Returns false if args.data[*i] isn't one of those flags.
+ */
+bool parse_entry_flag(batch_entry *entry, char_p_harr args, size_t *i, const char *dir);
+
+/*
+ * Adds src's -D, -I, -iquote, -isystem, and dependency flags to the end of dest's.
+ */
+void append_entry_flags(batch_entry *dest, const batch_entry *src);
+
+/*
+ * Splits a command line into arguments. Arguments are separated by unquoted whitespace;
+ * single quotes, double quotes, and backslashes work like they do in a POSIX shell.
+ */
+char_p_vec split_command_line(const char *cmdline, size_t len);
+
+/*
+ * Reads the arguments out of a response file (the file named by an @file argument).
+ */
+char_p_vec read_response_file(const char *fname);
+
+/*
+ * The options for preprocessing entry; pch is the prefix it starts with, or NULL.
+ */
+struct preprocessor_options entry_preprocessor_options(const batch_entry *entry, const struct pch *pch);
+
+bool is_stdio_fname(const char *fname);
+
+/*
+ * Loads entry's input file. Exits with an error if it can't be read.
+ */
+struct source_buffer open_entry_input(const batch_entry *entry);
+
+/*
+ * Preprocesses one entry, and writes its dependency rule if it asked for one.
+ * Exits with an error if the input can't be read or the output can't be written.
+ */
+void preprocess_entry(const batch_entry *entry, const struct batch_options *options);
+
+/*
+ * Prints every token in entry's input to standard output, one per line, without preprocessing. The input is read a
+ * window at a time, so this works on inputs of any size.
+ */
+void dump_entry_tokens(const batch_entry *entry);
+
+/*
+ * Preprocesses one entry as a prefix header, and writes the result to the PCH file pch_fname instead of the entry's output.
+ */
+void emit_pch_for_entry(const batch_entry *entry, const char *pch_fname);
+
+/*
+ * Preprocesses every entry, spread over worker threads, largest inputs first.
+ * Prints the wall time of each file as it finishes, and the total throughput at the end.
+ */
+void run_batch(batch_entry_harr entries, struct batch_options options);
+
+/*
+ * Prints the token cache's hit rate and how much of it was mapped, if the cache is on.
+ */
+void print_token_cache_stats(void);
+
+#endif //ICK_BATCH_H
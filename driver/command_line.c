@@ -0,0 +1,162 @@
+#include "command_line.h"
+#include "compile_commands.h"
+#include "diagnostics.h"
+#include "edit_trace.h"
+#include "phases_benchmark.h"
+#include "file_utils.h"
+#include "debug/malloc.h"
+#include "preprocessor/pch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// If arg is "option=value", returns value; if arg is just option, takes the next argument as the value. NULL otherwise.
+static const char *option_value(const char_p_harr args, size_t *const i, const char *const option) {
+    const char *const arg = args.data[*i];
+    const size_t option_len = strlen(option);
+    if (strncmp(arg, option, option_len) != 0) return NULL;
+    if (arg[option_len] == '=') return &arg[option_len + 1];
+    if (arg[option_len] != '\0') return NULL;
+    if (*i + 1 == args.len) driver_error("Missing argument to %s.", option);
+    (*i)++;
+    return args.data[*i];
+}
+
+struct command_line parse_command_line(const char_p_harr raw_args, const char *const cwd) {
+    char_p_vec args = char_p_vec_new(raw_args.len);
+    for (size_t i = 0; i < raw_args.len; i++) {
+        if (raw_args.data[i][0] == '@') {
+            char *const response_fname = resolve_path(cwd, &raw_args.data[i][1]);
+            char_p_vec_append_all(&args, read_response_file(response_fname));
+            FREE(response_fname);
+        } else {
+            char_p_vec_append(&args, raw_args.data[i]);
+        }
+    }
+
+    struct command_line command_line = {
+        .entries = batch_entry_vec_new(0),
+        .options = { .n_threads = 0, .print_mode = TOKEN_PRINT_PRETTY, .pch = NULL },
+        .use_batch_mode = false,
+        .emit_pch_fname = NULL,
+        .token_cache_dir = NULL,
+        .server_socket = NULL,
+        .edit_trace_fname = NULL,
+        .benchmark_phases_1_2 = false,
+        .dump_tokens = false,
+        .trace_spec = NULL
+    };
+    batch_entry global_flags = batch_entry_new("");
+    for (size_t i = 0; i < args.arr.len; i++) {
+        char *const arg = args.arr.data[i];
+        const char *value;
+        if (strcmp(arg, "--raw") == 0) {
+            command_line.options.print_mode = TOKEN_PRINT_RAW;
+        } else if (strcmp(arg, "--dump-tokens") == 0) {
+            command_line.dump_tokens = true;
+        } else if (strcmp(arg, "--bench-phases-1-2") == 0) {
+            command_line.benchmark_phases_1_2 = true;
+        } else if ((value = option_value(args.arr, &i, "--compile-commands")) != NULL) {
+            char *const db_fname = resolve_path(cwd, value);
+            batch_entry_vec_append_all(&command_line.entries, read_compile_commands(db_fname));
+            FREE(db_fname);
+            command_line.use_batch_mode = true;
+        } else if ((value = option_value(args.arr, &i, "--token-cache")) != NULL) {
+            command_line.token_cache_dir = resolve_path(cwd, value);
+        } else if ((value = option_value(args.arr, &i, "--emit-pch")) != NULL) {
+            command_line.emit_pch_fname = resolve_path(cwd, value);
+        } else if ((value = option_value(args.arr, &i, "--include-pch")) != NULL) {
+            char *const pch_fname = resolve_path(cwd, value);
+            command_line.options.pch = load_pch(pch_fname);
+            FREE(pch_fname);
+        } else if ((value = option_value(args.arr, &i, "--server")) != NULL) {
+            command_line.server_socket = resolve_path(cwd, value);
+        } else if ((value = option_value(args.arr, &i, "--trace")) != NULL) {
+            command_line.trace_spec = value;
+        } else if ((value = option_value(args.arr, &i, "--replay-edits")) != NULL) {
+            command_line.edit_trace_fname = resolve_path(cwd, value);
+        } else if (parse_dependency_flag(&global_flags.dependencies, args.arr, &i, cwd)) {
+            // -M, -MD, -MF, etc.; added to every entry below
+        } else if (parse_entry_flag(&global_flags, args.arr, &i, cwd)) {
+            // -D, -I, -iquote, or -isystem; added to every entry below
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            const char *threads_value = &arg[2];
+            if (threads_value[0] == '\0') {
+                if (i + 1 == args.arr.len) driver_error("Missing argument to %s.", arg);
+                threads_value = args.arr.data[++i];
+            }
+            char *end;
+            const unsigned long n_threads = strtoul(threads_value, &end, 10);
+            if (*end != '\0' || n_threads == 0) driver_error("Invalid number of threads \"%s\".", threads_value);
+            command_line.options.n_threads = n_threads;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            driver_error("Unrecognized option \"%s\".", arg);
+        } else if (is_stdio_fname(arg)) {
+            batch_entry_vec_append(&command_line.entries, batch_entry_new(arg));
+        } else {
+            char *const input_fname = resolve_path(cwd, arg);
+            batch_entry_vec_append(&command_line.entries, batch_entry_new(input_fname));
+            FREE(input_fname);
+        }
+    }
+    FREE(args.arr.data);
+
+    if (command_line.entries.arr.len == 0 && command_line.server_socket == NULL) {
+        driver_error("No target file(s) specified.");
+    }
+    command_line.use_batch_mode = command_line.use_batch_mode || command_line.entries.arr.len > 1;
+    if (command_line.entries.arr.len > 1 && global_flags.dependencies.depfile_fname != NULL) {
+        driver_error("-MF can't be used with more than one input file.");
+    }
+    if (command_line.emit_pch_fname != NULL) {
+        if (command_line.use_batch_mode) driver_error("--emit-pch takes exactly one prefix header.");
+        if (command_line.options.pch != NULL) driver_error("--emit-pch can't be used with --include-pch.");
+    }
+    if (command_line.use_batch_mode) {
+        for (size_t i = 0; i < command_line.entries.arr.len; i++) {
+            if (is_stdio_fname(command_line.entries.arr.data[i].input_fname)) {
+                driver_error("Standard input (\"%s\") can't be used with more than one input file.", STDIO_FNAME);
+            }
+        }
+    }
+    if (command_line.edit_trace_fname != NULL) {
+        if (command_line.use_batch_mode) driver_error("--replay-edits takes exactly one input file.");
+        if (command_line.emit_pch_fname != NULL) driver_error("--replay-edits can't be used with --emit-pch.");
+        if (is_stdio_fname(command_line.entries.arr.data[0].input_fname)) {
+            driver_error("--replay-edits can't read from standard input.");
+        }
+    }
+    if (command_line.benchmark_phases_1_2 && command_line.use_batch_mode) {
+        driver_error("--bench-phases-1-2 takes exactly one input file.");
+    }
+
+    // Flags on the command line apply to every entry, after the entry's own flags
+    for (size_t i = 0; i < command_line.entries.arr.len; i++) {
+        append_entry_flags(&command_line.entries.arr.data[i], &global_flags);
+    }
+    return command_line;
+}
+
+void run_command_line(const struct command_line *const command_line) {
+    const batch_entry *const first_entry = &command_line->entries.arr.data[0];
+    if (command_line->benchmark_phases_1_2) {
+        benchmark_phases_1_2(first_entry);
+    } else if (command_line->dump_tokens) {
+        for (size_t i = 0; i < command_line->entries.arr.len; i++) {
+            dump_entry_tokens(&command_line->entries.arr.data[i]);
+        }
+    } else if (command_line->emit_pch_fname != NULL) {
+        emit_pch_for_entry(first_entry, command_line->emit_pch_fname);
+        printf("\nSuccessfully wrote PCH to %s\n", command_line->emit_pch_fname);
+    } else if (command_line->edit_trace_fname != NULL) {
+        replay_edit_trace(first_entry, command_line->edit_trace_fname, &command_line->options);
+    } else if (command_line->use_batch_mode) {
+        run_batch(command_line->entries.arr, command_line->options);
+    } else {
+        preprocess_entry(first_entry, &command_line->options);
+        if (!first_entry->dependencies.instead_of_output && !is_stdio_fname(first_entry->output_fname)) {
+            printf("\nSuccessfully preprocessed to %s\n", first_entry->output_fname);
+        }
+        print_token_cache_stats();
+    }
+}
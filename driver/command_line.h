@@ -0,0 +1,36 @@
+#ifndef ICK_COMMAND_LINE_H
+#define ICK_COMMAND_LINE_H
+
+#include <stdbool.h>
+#include "batch.h"
+#include "data_structures/vector.h"
+
+/*
+ * Everything ick was asked to do, as parsed from its arguments.
+ */
+struct command_line {
+    batch_entry_vec entries; // every entry already has the command line's flags
+    struct batch_options options;
+    bool use_batch_mode;
+    char *emit_pch_fname; // --emit-pch; NULL if not given
+    char *token_cache_dir; // --token-cache; NULL if not given
+    char *server_socket; // --server; NULL if not given
+    char *edit_trace_fname; // --replay-edits; NULL if not given
+    bool benchmark_phases_1_2; // --bench-phases-1-2
+    bool dump_tokens; // --dump-tokens
+    const char *trace_spec; // --trace; NULL if not given
+};
+
+/*
+ * Parses ick's arguments (without argv[0]). Response files are expanded first, so their contents can use every option.
+ * Relative paths, including those of response files, are resolved against cwd, unless cwd is NULL.
+ * Exits with an error if the arguments don't make sense.
+ */
+struct command_line parse_command_line(char_p_harr args, const char *cwd);
+
+/*
+ * Runs the preprocessing a command line asks for. Starting a server and setting the token cache are up to the caller.
+ */
+void run_command_line(const struct command_line *command_line);
+
+#endif //ICK_COMMAND_LINE_H
@@ -0,0 +1,241 @@
+#include "compile_commands.h"
+#include "diagnostics.h"
+#include "file_utils.h"
+#include "source_buffer.h"
+#include "debug/malloc.h"
+#include <string.h>
+
+// Just enough of a JSON reader for compilation databases
+
+struct json_reader {
+    const unsigned char *start;
+    const unsigned char *p;
+    const unsigned char *end;
+    const char *fname;
+};
+
+__attribute__((noreturn))
+static void json_error(const struct json_reader *const reader, const char *const msg) {
+    driver_error("%s: %s (at byte %td).", reader->fname, msg, reader->p - reader->start);
+}
+
+static void skip_json_whitespace(struct json_reader *const reader) {
+    while (reader->p < reader->end && (*reader->p == ' ' || *reader->p == '\t' || *reader->p == '\n' || *reader->p == '\r')) {
+        reader->p++;
+    }
+}
+
+static bool consume_json_char(struct json_reader *const reader, const unsigned char c) {
+    skip_json_whitespace(reader);
+    if (reader->p < reader->end && *reader->p == c) {
+        reader->p++;
+        return true;
+    }
+    return false;
+}
+
+static void expect_json_char(struct json_reader *const reader, const unsigned char c) {
+    if (!consume_json_char(reader, c)) {
+        char msg[] = "expected 'x'";
+        msg[sizeof(msg) - 3] = (char)c;
+        json_error(reader, msg);
+    }
+}
+
+static unsigned int read_hex4(struct json_reader *const reader) {
+    if (reader->end - reader->p < 4) json_error(reader, "truncated \\u escape");
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++) {
+        const unsigned int c = *reader->p++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10u;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10u;
+        else json_error(reader, "invalid \\u escape");
+    }
+    return value;
+}
+
+static void append_utf8(uchar_vec *const out, const unsigned int code_point) {
+    if (code_point < 0x80) {
+        uchar_vec_append(out, (unsigned char)code_point);
+    } else if (code_point < 0x800) {
+        uchar_vec_append(out, (unsigned char)(0xC0 | (code_point >> 6)));
+        uchar_vec_append(out, (unsigned char)(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        uchar_vec_append(out, (unsigned char)(0xE0 | (code_point >> 12)));
+        uchar_vec_append(out, (unsigned char)(0x80 | ((code_point >> 6) & 0x3F)));
+        uchar_vec_append(out, (unsigned char)(0x80 | (code_point & 0x3F)));
+    } else {
+        uchar_vec_append(out, (unsigned char)(0xF0 | (code_point >> 18)));
+        uchar_vec_append(out, (unsigned char)(0x80 | ((code_point >> 12) & 0x3F)));
+        uchar_vec_append(out, (unsigned char)(0x80 | ((code_point >> 6) & 0x3F)));
+        uchar_vec_append(out, (unsigned char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+// Returns a malloc'd, null-terminated string
+static char *read_json_string(struct json_reader *const reader) {
+    expect_json_char(reader, '"');
+    uchar_vec out = uchar_vec_new(0);
+    while (true) {
+        if (reader->p == reader->end) json_error(reader, "unterminated string");
+        const unsigned char c = *reader->p++;
+        if (c == '"') break;
+        if (c != '\\') {
+            uchar_vec_append(&out, c);
+            continue;
+        }
+        if (reader->p == reader->end) json_error(reader, "unterminated string");
+        const unsigned char escaped = *reader->p++;
+        switch (escaped) {
+            case '"': case '\\': case '/': uchar_vec_append(&out, escaped); break;
+            case 'b': uchar_vec_append(&out, '\b'); break;
+            case 'f': uchar_vec_append(&out, '\f'); break;
+            case 'n': uchar_vec_append(&out, '\n'); break;
+            case 'r': uchar_vec_append(&out, '\r'); break;
+            case 't': uchar_vec_append(&out, '\t'); break;
+            case 'u': {
+                unsigned int code_point = read_hex4(reader);
+                if (code_point >= 0xD800 && code_point < 0xDC00 && reader->end - reader->p >= 6
+                    && reader->p[0] == '\\' && reader->p[1] == 'u') {
+                    reader->p += 2;
+                    const unsigned int low = read_hex4(reader);
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(&out, code_point);
+                break;
+            }
+            default: json_error(reader, "invalid escape sequence");
+        }
+    }
+    uchar_vec_append(&out, '\0');
+    return (char *)out.arr.data;
+}
+
+static void skip_json_value(struct json_reader *const reader) {
+    skip_json_whitespace(reader);
+    if (reader->p == reader->end) json_error(reader, "expected a value");
+    switch (*reader->p) {
+        case '"':
+            FREE(read_json_string(reader));
+            return;
+        case '{':
+            reader->p++;
+            if (consume_json_char(reader, '}')) return;
+            do {
+                FREE(read_json_string(reader));
+                expect_json_char(reader, ':');
+                skip_json_value(reader);
+            } while (consume_json_char(reader, ','));
+            expect_json_char(reader, '}');
+            return;
+        case '[':
+            reader->p++;
+            if (consume_json_char(reader, ']')) return;
+            do {
+                skip_json_value(reader);
+            } while (consume_json_char(reader, ','));
+            expect_json_char(reader, ']');
+            return;
+        default:
+            // Numbers, true, false, and null
+            while (reader->p < reader->end && strchr(",}] \t\r\n", *reader->p) == NULL) reader->p++;
+            return;
+    }
+}
+
+static char_p_vec read_json_string_array(struct json_reader *const reader) {
+    char_p_vec strings = char_p_vec_new(0);
+    expect_json_char(reader, '[');
+    if (consume_json_char(reader, ']')) return strings;
+    do {
+        char_p_vec_append(&strings, read_json_string(reader));
+    } while (consume_json_char(reader, ','));
+    expect_json_char(reader, ']');
+    return strings;
+}
+
+static batch_entry read_compile_command(struct json_reader *const reader) {
+    char *dir = NULL;
+    char *file = NULL;
+    char *output = NULL;
+    char_p_vec args = { .arr = { .data = NULL, .len = 0 }, .capacity = 0 };
+    bool has_args = false;
+
+    expect_json_char(reader, '{');
+    if (!consume_json_char(reader, '}')) {
+        do {
+            char *const key = read_json_string(reader);
+            expect_json_char(reader, ':');
+            if (strcmp(key, "directory") == 0) {
+                dir = read_json_string(reader);
+            } else if (strcmp(key, "file") == 0) {
+                file = read_json_string(reader);
+            } else if (strcmp(key, "output") == 0) {
+                output = read_json_string(reader);
+            } else if (strcmp(key, "arguments") == 0) {
+                args = read_json_string_array(reader);
+                has_args = true;
+            } else if (strcmp(key, "command") == 0 && !has_args) {
+                // "arguments" takes precedence if both are present
+                char *const command = read_json_string(reader);
+                args = split_command_line(command, strlen(command));
+                has_args = true;
+                FREE(command);
+            } else {
+                skip_json_value(reader);
+            }
+            FREE(key);
+        } while (consume_json_char(reader, ','));
+        expect_json_char(reader, '}');
+    }
+    if (file == NULL) json_error(reader, "compile command has no \"file\"");
+
+    char *const input_fname = resolve_path(dir, file);
+    batch_entry entry = batch_entry_new(input_fname);
+    FREE(input_fname);
+    if (output != NULL) {
+        entry.object_fname = resolve_path(dir, output);
+        FREE(entry.output_fname);
+        entry.output_fname = new_fname_ext(entry.object_fname, PREPROCESSED_EXT);
+    }
+    if (has_args) {
+        // Only the flags that affect preprocessing matter; everything else is skipped. That includes -MD and -MF,
+        // which would make ick overwrite the build's own dependency files.
+        for (size_t i = 0; i < args.arr.len; i++) {
+            parse_entry_flag(&entry, args.arr, &i, dir);
+        }
+        for (size_t i = 0; i < args.arr.len; i++) FREE(args.arr.data[i]);
+        FREE(args.arr.data);
+    }
+    FREE(dir);
+    FREE(file);
+    FREE(output);
+    return entry;
+}
+
+batch_entry_vec read_compile_commands(const char *const fname) {
+    struct source_buffer buf;
+    if (!open_source_buffer(fname, &buf)) {
+        driver_error("Compilation database \"%s\" does not exist.", fname);
+    }
+    struct json_reader reader = {
+        .start = buf.contents.data,
+        .p = buf.contents.data,
+        .end = buf.contents.data + buf.contents.len,
+        .fname = fname
+    };
+    batch_entry_vec entries = batch_entry_vec_new(0);
+    expect_json_char(&reader, '[');
+    if (!consume_json_char(&reader, ']')) {
+        do {
+            batch_entry_vec_append(&entries, read_compile_command(&reader));
+        } while (consume_json_char(&reader, ','));
+        expect_json_char(&reader, ']');
+    }
+    skip_json_whitespace(&reader);
+    if (reader.p != reader.end) json_error(&reader, "unexpected text after the end of the database");
+    close_source_buffer(&buf);
+    return entries;
+}
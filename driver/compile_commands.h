@@ -0,0 +1,15 @@
+#ifndef ICK_COMPILE_COMMANDS_H
+#define ICK_COMPILE_COMMANDS_H
+
+#include "batch.h"
+
+/*
+ * Reads a compile_commands.json compilation database into batch entries.
+ * Each entry takes its -D and -I flags from the entry's "command" or "arguments".
+ * Relative paths are resolved against the entry's "directory".
+ * The output goes next to the entry's "output" if it has one, or next to its "file" otherwise, with the extension changed to .i.
+ * The entry's "output" is also the target of its dependency rule, if one is asked for on the command line.
+ */
+batch_entry_vec read_compile_commands(const char *fname);
+
+#endif //ICK_COMPILE_COMMANDS_H
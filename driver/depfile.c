@@ -0,0 +1,141 @@
+#include "depfile.h"
+#include "diagnostics.h"
+#include "file_utils.h"
+#include "output_sink.h"
+#include "data_structures/sstr.h"
+#include "debug/malloc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+struct dependency_options dependency_options_new(void) {
+    return (struct dependency_options) {
+        .enabled = false,
+        .instead_of_output = false,
+        .skip_system_headers = false,
+        .phony_targets = false,
+        .depfile_fname = NULL,
+        .targets = char_p_vec_new(0)
+    };
+}
+
+// Escapes the characters that make would otherwise treat specially in a rule
+static void append_quoted_for_make(uchar_vec *const out, const char *const str) {
+    for (size_t i = 0; str[i] != '\0'; i++) {
+        if (str[i] == ' ' || str[i] == '\t') {
+            // Backslashes right before the space would otherwise escape the escape
+            for (size_t j = i; j > 0 && str[j-1] == '\\'; j--) uchar_vec_append(out, '\\');
+            uchar_vec_append(out, '\\');
+        } else if (str[i] == '$') {
+            uchar_vec_append(out, '$');
+        } else if (str[i] == '#') {
+            uchar_vec_append(out, '\\');
+        }
+        uchar_vec_append(out, (unsigned char)str[i]);
+    }
+}
+
+static char *quoted_for_make(const char *const str) {
+    uchar_vec quoted = uchar_vec_new(0);
+    append_quoted_for_make(&quoted, str);
+    uchar_vec_append(&quoted, '\0');
+    return (char *)quoted.arr.data;
+}
+
+bool parse_dependency_flag(struct dependency_options *const options, const char_p_harr args, size_t *const i, const char *const dir) {
+    const char *const arg = args.data[*i];
+    if (strcmp(arg, "-M") == 0 || strcmp(arg, "-MM") == 0) {
+        options->enabled = true;
+        options->instead_of_output = true;
+        options->skip_system_headers = options->skip_system_headers || arg[2] == 'M';
+        return true;
+    }
+    if (strcmp(arg, "-MD") == 0 || strcmp(arg, "-MMD") == 0) {
+        options->enabled = true;
+        options->skip_system_headers = options->skip_system_headers || arg[2] == 'M';
+        return true;
+    }
+    if (strcmp(arg, "-MP") == 0) {
+        options->phony_targets = true;
+        return true;
+    }
+    if (strncmp(arg, "-MF", 3) != 0 && strncmp(arg, "-MT", 3) != 0 && strncmp(arg, "-MQ", 3) != 0) {
+        return false;
+    }
+    const char *value = &arg[3];
+    if (value[0] == '\0') {
+        if (*i + 1 == args.len) driver_error("Missing argument to %s.", arg);
+        (*i)++;
+        value = args.data[*i];
+    }
+    switch (arg[2]) {
+        case 'F':
+            FREE(options->depfile_fname);
+            options->depfile_fname = resolve_path(dir, value);
+            break;
+        case 'T':
+            char_p_vec_append(&options->targets, resolve_path(NULL, value));
+            break;
+        default: // 'Q'
+            char_p_vec_append(&options->targets, quoted_for_make(value));
+            break;
+    }
+    return true;
+}
+
+void append_dependency_options(struct dependency_options *const dest, const struct dependency_options *const src) {
+    dest->enabled = dest->enabled || src->enabled;
+    dest->instead_of_output = dest->instead_of_output || src->instead_of_output;
+    dest->skip_system_headers = dest->skip_system_headers || src->skip_system_headers;
+    dest->phony_targets = dest->phony_targets || src->phony_targets;
+    if (dest->depfile_fname == NULL && src->depfile_fname != NULL) {
+        dest->depfile_fname = resolve_path(NULL, src->depfile_fname);
+    }
+    char_p_vec_append_all(&dest->targets, src->targets);
+}
+
+void write_depfile(const struct dependency_options *const options, const char *const input_fname, const char_p_harr dependencies,
+                   const char *const default_target, const char *const default_depfile_fname) {
+    uchar_vec rule = uchar_vec_new(0);
+    if (options->targets.arr.len == 0) {
+        append_quoted_for_make(&rule, default_target);
+    }
+    for (size_t i = 0; i < options->targets.arr.len; i++) {
+        if (i > 0) uchar_vec_append(&rule, ' ');
+        uchar_vec_append_all_arr(&rule, (const unsigned char *)options->targets.arr.data[i], strlen(options->targets.arr.data[i]));
+    }
+    uchar_vec_append_all_arr(&rule, (const unsigned char *)": ", 2);
+    char *const input_path = normalize_path(input_fname);
+    append_quoted_for_make(&rule, input_path);
+    FREE(input_path);
+    for (size_t i = 0; i < dependencies.len; i++) {
+        uchar_vec_append_all_arr(&rule, (const unsigned char *)" \\\n  ", 5);
+        append_quoted_for_make(&rule, dependencies.data[i]);
+    }
+    uchar_vec_append(&rule, '\n');
+    if (options->phony_targets) {
+        for (size_t i = 0; i < dependencies.len; i++) {
+            uchar_vec_append(&rule, '\n');
+            append_quoted_for_make(&rule, dependencies.data[i]);
+            uchar_vec_append(&rule, ':');
+            uchar_vec_append(&rule, '\n');
+        }
+    }
+
+    const char *const fname = options->depfile_fname != NULL ? options->depfile_fname
+                            : options->instead_of_output ? NULL : default_depfile_fname;
+    if (fname == NULL) {
+        // One call, so rules from different threads don't get interleaved
+        fwrite(rule.arr.data, 1, rule.arr.len, standard_output_stream());
+    } else {
+        const int fd = open_output_file(fname);
+        if (fd == -1) {
+            driver_error("Couldn't open dependency file \"%s\". Errno: %d (%s).", fname, errno, strerror(errno));
+        }
+        struct output_sink sink = output_sink_new(fd);
+        output_sink_write(&sink, rule.arr.data, rule.arr.len);
+        output_sink_free(&sink);
+        close_output_file(fd);
+    }
+    FREE(rule.arr.data);
+}
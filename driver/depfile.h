@@ -0,0 +1,41 @@
+#ifndef ICK_DEPFILE_H
+#define ICK_DEPFILE_H
+
+#include <stdbool.h>
+#include "data_structures/vector.h"
+
+/*
+ * The -M family of flags, which ask for a make rule listing the files a translation unit depends on.
+ */
+struct dependency_options {
+    bool enabled; // any of -M, -MM, -MD, or -MMD was given
+    bool instead_of_output; // -M or -MM: the rule is written instead of the preprocessed output
+    bool skip_system_headers; // -MM or -MMD
+    bool phony_targets; // -MP: a rule with no prerequisites for each header, so make doesn't fail when one is deleted
+    char *depfile_fname; // -MF; NULL for the default
+    char_p_vec targets; // -MT and -MQ, already quoted for make; empty for the default
+};
+
+struct dependency_options dependency_options_new(void);
+
+/*
+ * If args.data[*i] is one of -M, -MM, -MD, -MMD, -MP, -MF, -MT, or -MQ, adds it to options, and moves *i to the flag's
+ * value if the value is a separate argument. A relative -MF path is resolved against dir, unless dir is NULL.
+ * Returns false if args.data[*i] isn't one of those flags.
+ */
+bool parse_dependency_flag(struct dependency_options *options, char_p_harr args, size_t *i, const char *dir);
+
+/*
+ * Adds the flags in src to dest. src's -MF is only used if dest doesn't have one.
+ */
+void append_dependency_options(struct dependency_options *dest, const struct dependency_options *src);
+
+/*
+ * Writes the make rule for a translation unit. dependencies are the files it included, in the order they were first
+ * included. The default target is default_target; the default file is default_depfile_fname for -MD and -MMD, and
+ * standard output for -M and -MM.
+ */
+void write_depfile(const struct dependency_options *options, const char *input_fname, char_p_harr dependencies,
+                   const char *default_target, const char *default_depfile_fname);
+
+#endif //ICK_DEPFILE_H
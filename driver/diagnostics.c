@@ -1,7 +1,11 @@
 #include "diagnostics.h"
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 
 #define VFPRINTF_VAARGS_FOLLOW(_stream, _fmt) \
@@ -11,23 +15,86 @@
     va_end(args)
 
 
+static pthread_key_t sink_key;
+static pthread_once_t sink_key_once = PTHREAD_ONCE_INIT;
+
+static void create_sink_key(void) {
+    pthread_key_create(&sink_key, NULL);
+}
+
+static const struct diagnostic_sink *get_diagnostic_sink(void) {
+    pthread_once(&sink_key_once, create_sink_key);
+    return pthread_getspecific(sink_key);
+}
+
+void set_diagnostic_sink(const struct diagnostic_sink *const sink) {
+    pthread_once(&sink_key_once, create_sink_key);
+    pthread_setspecific(sink_key, sink);
+}
+
+FILE *diagnostic_stream(void) {
+    const struct diagnostic_sink *const sink = get_diagnostic_sink();
+    return sink == NULL ? stderr : sink->stream;
+}
+
+FILE *standard_output_stream(void) {
+    const struct diagnostic_sink *const sink = get_diagnostic_sink();
+    return sink == NULL ? stdout : sink->output_stream;
+}
+
+int open_output_file(const char *const fname) {
+    const int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    const struct diagnostic_sink *const sink = get_diagnostic_sink();
+    if (fd != -1 && sink != NULL && sink->open_outputs != NULL) {
+        char *const fname_copy = MALLOC(strlen(fname) + 1);
+        strcpy(fname_copy, fname);
+        open_output_vec_append(sink->open_outputs, (open_output) { .fd = fd, .fname = fname_copy });
+    }
+    return fd;
+}
+
+void close_output_file(const int fd) {
+    const struct diagnostic_sink *const sink = get_diagnostic_sink();
+    if (sink != NULL && sink->open_outputs != NULL) {
+        open_output_harr *const outputs = &sink->open_outputs->arr;
+        for (size_t i = 0; i < outputs->len; i++) {
+            if (outputs->data[i].fd == fd) {
+                FREE(outputs->data[i].fname);
+                outputs->data[i] = outputs->data[outputs->len - 1];
+                outputs->len--;
+                break;
+            }
+        }
+    }
+    close(fd);
+}
+
+__attribute__((noreturn))
+void end_after_fatal_error(void) {
+    const struct diagnostic_sink *const sink = get_diagnostic_sink();
+    if (sink != NULL && sink->on_fatal_error != NULL) longjmp(*sink->on_fatal_error, 1);
+    exit(1);
+}
+
 static void driver_message_prefix(FILE *stream) {
     fprintf(stream, "%s: ", ick_progname);
 }
 
 __attribute__((format(printf, 1, 2), noreturn))
 void driver_error(const char *msg_fmt, ...) {
-    driver_message_prefix(stderr);
-    fprintf(stderr, "error: ");
-    VFPRINTF_VAARGS_FOLLOW(stderr, msg_fmt);
-    fprintf(stderr, "\n");
-    exit(1);
+    FILE *const stream = diagnostic_stream();
+    driver_message_prefix(stream);
+    fprintf(stream, "error: ");
+    VFPRINTF_VAARGS_FOLLOW(stream, msg_fmt);
+    fprintf(stream, "\n");
+    end_after_fatal_error();
 }
 
 __attribute__((format(printf, 1, 2)))
 void driver_warning(const char *msg_fmt, ...) {
-    driver_message_prefix(stderr);
-    fprintf(stderr, "warning: ");
-    VFPRINTF_VAARGS_FOLLOW(stderr, msg_fmt);
-    fprintf(stderr, "\n");
+    FILE *const stream = diagnostic_stream();
+    driver_message_prefix(stream);
+    fprintf(stream, "warning: ");
+    VFPRINTF_VAARGS_FOLLOW(stream, msg_fmt);
+    fprintf(stream, "\n");
 }
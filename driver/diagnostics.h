@@ -1,9 +1,52 @@
 #ifndef ICK_DIAGNOSTICS_H
 #define ICK_DIAGNOSTICS_H
 
+#include <setjmp.h>
+#include <stdio.h>
+#include "data_structures/vector.h"
+
 extern char *ick_progname;
 
+/*
+ * Where the calling thread's diagnostics and standard output go, and what a fatal error does. Without one, they go to
+ * stderr and stdout, and fatal errors exit the process; the server gives each job its own, so a job's messages go back
+ * to its client, and a bad job can't take the server down.
+ * Debugging output isn't redirected.
+ */
+typedef struct open_output {
+    int fd;
+    char *fname;
+} open_output;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(open_output)
+
+struct diagnostic_sink {
+    FILE *stream;
+    FILE *output_stream;
+    jmp_buf *on_fatal_error; // if not NULL, fatal errors longjmp here (with the value 1) instead of exiting
+    // If not NULL, the files the thread has open from open_output_file, so whoever catches a fatal error can close them
+    // and delete what was half written
+    open_output_vec *open_outputs;
+};
+
+// Sets the calling thread's sink; NULL goes back to the default. The sink must outlive its use.
+void set_diagnostic_sink(const struct diagnostic_sink *sink);
+FILE *diagnostic_stream(void);
+// Where output that would go to stdout, like the rule from -M, goes
+FILE *standard_output_stream(void);
+/*
+ * Opens fname for writing, creating or truncating it, and records it in the calling thread's sink (if it keeps track of
+ * open outputs). Returns the file descriptor, or -1 with errno set, like open.
+ */
+int open_output_file(const char *fname);
+// Closes a file descriptor from open_output_file, and forgets it
+void close_output_file(int fd);
+// Called by every fatal error, after its message has been written
+__attribute__((noreturn))
+void end_after_fatal_error(void);
+
+__attribute__((format(printf, 1, 2)))
 void driver_warning(const char *msg_fmt, ...);
+__attribute__((format(printf, 1, 2), noreturn))
 void driver_error(const char *msg_fmt, ...);
 
 #endif //ICK_DIAGNOSTICS_H
@@ -0,0 +1,107 @@
+#include "edit_trace.h"
+#include "diagnostics.h"
+#include "debug/malloc.h"
+#include "preprocessor/incremental.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double seconds_since(const struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static sstr unescape(const unsigned char *const text, const size_t len) {
+    uchar_vec out = uchar_vec_new(len);
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\\' && i + 1 < len && strchr("nt\\", text[i + 1]) != NULL) {
+            i++;
+            uchar_vec_append(&out, text[i] == 'n' ? '\n' : text[i] == 't' ? '\t' : '\\');
+        } else {
+            uchar_vec_append(&out, text[i]);
+        }
+    }
+    return out.arr;
+}
+
+static size_t parse_offset(const unsigned char **const p, const unsigned char *const line_end, const char *const trace_fname, const size_t line_number) {
+    size_t value = 0;
+    const unsigned char *const start = *p;
+    while (*p < line_end && **p >= '0' && **p <= '9') {
+        value = value * 10 + (size_t)(**p - '0');
+        (*p)++;
+    }
+    if (*p == start) driver_error("Line %zu of edit trace \"%s\" doesn't start with two byte offsets.", line_number, trace_fname);
+    return value;
+}
+
+static struct text_edit parse_edit(const unsigned char *const line, const unsigned char *const line_end, const char *const trace_fname, const size_t line_number) {
+    const unsigned char *p = line;
+    const size_t start = parse_offset(&p, line_end, trace_fname, line_number);
+    if (p < line_end && *p == ' ') p++;
+    const size_t end = parse_offset(&p, line_end, trace_fname, line_number);
+    if (p < line_end && *p == ' ') p++;
+    return (struct text_edit) { .start = start, .end = end, .replacement = unescape(p, (size_t)(line_end - p)) };
+}
+
+static bool tokens_eq(const struct preprocessing_token token1, const struct preprocessing_token token2) {
+    return token1.type == token2.type && token1.after_whitespace == token2.after_whitespace && sstrs_eq(token1.name, token2.name);
+}
+
+void replay_edit_trace(const batch_entry *const entry, const char *const trace_fname, const struct batch_options *const options) {
+    const struct source_buffer input = open_entry_input(entry);
+    struct source_buffer trace;
+    if (!open_source_buffer(trace_fname, &trace)) {
+        driver_error("Edit trace \"%s\" does not exist.", trace_fname);
+    }
+    const struct preprocessor_options preprocessor_options = entry_preprocessor_options(entry, options->pch);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct incremental_session *const session = incremental_session_new(input.contents, entry->input_fname, preprocessor_options);
+    printf("Initial run: %.2f ms, %zu tokens\n", seconds_since(start) * 1e3, incremental_session_output(session).len);
+
+    double total_seconds = 0;
+    size_t n_edits = 0;
+    const unsigned char *line = trace.contents.data;
+    const unsigned char *const trace_end = trace.contents.data + trace.contents.len;
+    for (size_t line_number = 1; line < trace_end; line_number++) {
+        const unsigned char *line_end = memchr(line, '\n', (size_t)(trace_end - line));
+        if (line_end == NULL) line_end = trace_end;
+        if (line_end > line) {
+            const struct text_edit edit = parse_edit(line, line_end, trace_fname, line_number);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            const struct token_delta delta = incremental_session_edit(session, edit);
+            const double seconds = seconds_since(start);
+            const struct incremental_stats stats = incremental_session_last_stats(session);
+            if (delta.parse_failed) {
+                printf("Edit %zu: %.2f ms; relexed %zu bytes, which don't parse (stuck at byte %zu), so the output is unchanged\n",
+                       line_number, seconds * 1e3, stats.n_bytes_relexed, delta.error_offset);
+            } else {
+                printf("Edit %zu: %.2f ms; relexed %zu bytes, reparsed %zu group parts, reran %zu%s; -%zu +%zu tokens at %zu\n",
+                       line_number, seconds * 1e3, stats.n_bytes_relexed, stats.n_group_parts_reparsed, stats.n_group_parts_rerun,
+                       stats.converged ? " and stopped early" : "", delta.n_removed, delta.inserted.len, delta.start);
+            }
+            total_seconds += seconds;
+            n_edits++;
+            FREE(edit.replacement.data);
+        }
+        line = line_end + 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const struct incremental_session *const from_scratch = incremental_session_new(incremental_session_text(session), entry->input_fname, preprocessor_options);
+    const double from_scratch_seconds = seconds_since(start);
+    const pp_token_harr expected = incremental_session_output(from_scratch);
+    const pp_token_harr actual = incremental_session_output(session);
+    for (size_t i = 0; i < expected.len || i < actual.len; i++) {
+        if (i == expected.len || i == actual.len || !tokens_eq(expected.data[i], actual.data[i])) {
+            driver_error("After replaying \"%s\", the output differs from preprocessing from scratch at token %zu.", trace_fname, i);
+        }
+    }
+    printf("Replayed %zu edits in %.2f ms (%.2f ms per edit); preprocessing the result from scratch took %.2f ms, with the same output\n",
+           n_edits, total_seconds * 1e3, n_edits == 0 ? 0.0 : total_seconds * 1e3 / (double)n_edits, from_scratch_seconds * 1e3);
+    close_source_buffer(&trace);
+}
@@ -0,0 +1,17 @@
+#ifndef ICK_EDIT_TRACE_H
+#define ICK_EDIT_TRACE_H
+
+#include "batch.h"
+
+/*
+ * Benchmarks incremental preprocessing. Replays a trace of edits to entry's input, the way an editor would send them,
+ * and prints how long each took and how much had to be redone. Then the final text is preprocessed from scratch, to
+ * compare the times and to check that the output is the same.
+ *
+ * Each line of the trace is an edit: START END REPLACEMENT, which replaces bytes [START, END) of the text as it is after
+ * the edits before it. REPLACEMENT is the rest of the line after the space following END, and can be empty;
+ * \n, \t, and \\ in it stand for a newline, a tab, and a backslash.
+ */
+void replay_edit_trace(const batch_entry *entry, const char *trace_fname, const struct batch_options *options);
+
+#endif //ICK_EDIT_TRACE_H
@@ -1,8 +1,6 @@
 #include "file_utils.h"
 #include "diagnostics.h"
 #include "debug/malloc.h"
-#include <errno.h>
-#include <stdint.h>
 #include <string.h>
 
 char *new_fname_ext(const char *fname, const char *new_ext) {
@@ -19,18 +17,38 @@ char *new_fname_ext(const char *fname, const char *new_ext) {
     return output;
 }
 
-unsigned long get_filesize(FILE *file) {
-    const long file_pos = ftell(file);
-    if (file_pos == -1) {
-        driver_error("Error in getting the initial file position. Errno: %d (%s).", errno, strerror(errno));
+char *resolve_path(const char *dir, const char *path) {
+    if (dir == NULL || path[0] == '/') {
+        char *const copy = MALLOC(strlen(path) + 1);
+        strcpy(copy, path);
+        return copy;
     }
-    fseek(file, 0, SEEK_END);
-    const long filesize = ftell(file);
-    if (filesize == -1) {
-        driver_error("Input file is likely too large (ftell failed to seek to the end). Errno: %d (%s).", errno, strerror(errno));
-    } else if ((unsigned long)filesize >= SIZE_MAX) {
-        driver_error("Input file is too large (%l bytes); the limit is SIZE_MAX (%zu)", filesize, SIZE_MAX);
+    const size_t dir_len = strlen(dir);
+    const size_t path_len = strlen(path);
+    char *const resolved = MALLOC(dir_len + 1 + path_len + 1);
+    memcpy(resolved, dir, dir_len);
+    resolved[dir_len] = '/';
+    memcpy(&resolved[dir_len + 1], path, path_len + 1);
+    return resolved;
+}
+
+char *normalize_path(const char *const path) {
+    const size_t len = strlen(path);
+    char *const normalized = MALLOC(len + 2);
+    size_t out_len = 0;
+    if (path[0] == '/') normalized[out_len++] = '/';
+    for (size_t i = 0; i < len;) {
+        size_t component_end = i;
+        while (component_end < len && path[component_end] != '/') component_end++;
+        const size_t component_len = component_end - i;
+        if (component_len > 0 && !(component_len == 1 && path[i] == '.')) {
+            if (out_len > 0 && normalized[out_len - 1] != '/') normalized[out_len++] = '/';
+            memcpy(&normalized[out_len], &path[i], component_len);
+            out_len += component_len;
+        }
+        i = component_end + 1;
     }
-    fseek(file, file_pos, SEEK_SET);
-    return (unsigned long)filesize;
+    if (out_len == 0) normalized[out_len++] = '.';
+    normalized[out_len] = '\0';
+    return normalized;
 }
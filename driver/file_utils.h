@@ -32,9 +32,15 @@
  */
 char *new_fname_ext(const char *fname, const char *new_ext);
 
-/*
- * Returns the number of bytes in the file, not including EOF.
+/*!
+ * Returns a malloc'd path: a copy of path if it's absolute or dir is NULL, or dir/path otherwise.
+ */
+char *resolve_path(const char *dir, const char *path);
+
+/*!
+ * Returns a malloc'd copy of path with repeated slashes and "." components removed, e.g. "./a//b/./c.h" -> "a/b/c.h".
+ * ".." components are kept, since removing them would give the wrong file if the directory before them is a symlink.
  */
-unsigned long get_filesize(FILE *file);
+char *normalize_path(const char *path);
 
 #endif //ICK_FILE_UTILS_H
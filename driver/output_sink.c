@@ -0,0 +1,73 @@
+#include "output_sink.h"
+#include "diagnostics.h"
+#include "debug/malloc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct output_sink output_sink_new(const int fd) {
+    return (struct output_sink) { .fd = fd, .buffer = MALLOC(OUTPUT_SINK_BUFFER_SIZE), .len = 0 };
+}
+
+// Writes everything in iov, retrying after short writes
+static void write_all(const int fd, struct iovec *iov, int iovcnt) {
+    // Anything printed to stdout through stdio so far has to come out first
+    if (fd == STDOUT_FILENO) fflush(stdout);
+    while (iovcnt > 0) {
+        ssize_t n_written = writev(fd, iov, iovcnt);
+        if (n_written < 0) {
+            if (errno == EINTR) continue;
+            driver_error("Error writing output. Errno: %d (%s).", errno, strerror(errno));
+        }
+        while (iovcnt > 0 && (size_t)n_written >= iov->iov_len) {
+            n_written -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + n_written;
+            iov->iov_len -= (size_t)n_written;
+        }
+    }
+}
+
+void output_sink_write(struct output_sink *const sink, const unsigned char *const data, const size_t len) {
+    if (len <= OUTPUT_SINK_BUFFER_SIZE - sink->len) {
+        memcpy(&sink->buffer[sink->len], data, len);
+        sink->len += len;
+        return;
+    }
+    if (len < OUTPUT_SINK_BUFFER_SIZE) {
+        // Top the buffer up so it goes out full, and keep the rest for later
+        const size_t n_fit = OUTPUT_SINK_BUFFER_SIZE - sink->len;
+        memcpy(&sink->buffer[sink->len], data, n_fit);
+        sink->len = OUTPUT_SINK_BUFFER_SIZE;
+        output_sink_flush(sink);
+        memcpy(sink->buffer, &data[n_fit], len - n_fit);
+        sink->len = len - n_fit;
+        return;
+    }
+    // Too big to be worth copying; send the buffer and the data together
+    struct iovec iov[2] = {
+        { .iov_base = sink->buffer, .iov_len = sink->len },
+        { .iov_base = (void *)(uintptr_t)data, .iov_len = len }
+    };
+    write_all(sink->fd, iov, 2);
+    sink->len = 0;
+}
+
+void output_sink_flush(struct output_sink *const sink) {
+    if (sink->len == 0) return;
+    struct iovec iov = { .iov_base = sink->buffer, .iov_len = sink->len };
+    write_all(sink->fd, &iov, 1);
+    sink->len = 0;
+}
+
+void output_sink_free(struct output_sink *const sink) {
+    output_sink_flush(sink);
+    FREE(sink->buffer);
+}
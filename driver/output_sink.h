@@ -0,0 +1,34 @@
+#ifndef ICK_OUTPUT_SINK_H
+#define ICK_OUTPUT_SINK_H
+
+#include <stddef.h>
+
+#define OUTPUT_SINK_BUFFER_SIZE (256 * 1024)
+
+/*
+ * Buffered output to a file descriptor. Writes are collected in a user-space buffer and handed to the kernel in
+ * large chunks, so producers can push output a few bytes at a time as soon as it's ready.
+ */
+struct output_sink {
+    int fd;
+    unsigned char *buffer;
+    size_t len;
+};
+
+struct output_sink output_sink_new(int fd);
+
+void output_sink_write(struct output_sink *sink, const unsigned char *data, size_t len);
+
+static inline void output_sink_put_char(struct output_sink *const sink, const unsigned char c) {
+    if (sink->len == OUTPUT_SINK_BUFFER_SIZE) output_sink_write(sink, &c, 1);
+    else sink->buffer[sink->len++] = c;
+}
+
+void output_sink_flush(struct output_sink *sink);
+
+/*
+ * Flushes the sink and frees its buffer. The file descriptor isn't closed.
+ */
+void output_sink_free(struct output_sink *sink);
+
+#endif //ICK_OUTPUT_SINK_H
@@ -0,0 +1,87 @@
+#include "phases_benchmark.h"
+#include "diagnostics.h"
+#include "debug/malloc.h"
+#include "preprocessor/phases_1_2.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_BYTES ((size_t)256 << 20)
+#define BENCHMARK_RUNS 5
+
+static double seconds_since(const struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void free_phases_1_2_info(const struct phases_1_2_info info, const sstr in) {
+    if (info.result.data != in.data) FREE(info.result.data);
+    FREE(info.map.breakpoints.data);
+}
+
+static bool phases_1_2_infos_eq(const struct phases_1_2_info info1, const struct phases_1_2_info info2) {
+    if (!sstrs_eq(info1.result, info2.result) || info1.map.breakpoints.len != info2.map.breakpoints.len) return false;
+    for (size_t i = 0; i < info1.map.breakpoints.len; i++) {
+        const source_map_breakpoint breakpoint1 = info1.map.breakpoints.data[i];
+        const source_map_breakpoint breakpoint2 = info2.map.breakpoints.data[i];
+        if (breakpoint1.logical_start != breakpoint2.logical_start || breakpoint1.raw_delta != breakpoint2.raw_delta) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The fastest of a few runs, in seconds. The result of the last run is left in *result.
+static double time_phases_1_2(const sstr in, const enum phases_1_2_search search, struct phases_1_2_info *const result) {
+    double best = -1;
+    for (int run = 0; run < BENCHMARK_RUNS; run++) {
+        if (run > 0) free_phases_1_2_info(*result, in);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        *result = apply_phases_1_2_with_search(in, search);
+        const double seconds = seconds_since(start);
+        if (best < 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+void benchmark_phases_1_2(const batch_entry *const entry) {
+    const struct source_buffer input = open_entry_input(entry);
+    if (input.contents.len == 0) driver_error("Input file \"%s\" is empty.", entry->input_fname);
+    const size_t n_copies = (BENCHMARK_BYTES + input.contents.len - 1) / input.contents.len;
+    unsigned char *const copies = MALLOC(n_copies * input.contents.len);
+    for (size_t i = 0; i < n_copies; i++) {
+        memcpy(&copies[i * input.contents.len], input.contents.data, input.contents.len);
+    }
+    const sstr in = { .data = copies, .len = n_copies * input.contents.len };
+    close_source_buffer(&input);
+    printf("Phases 1 and 2 on %zu copies of %s (%zu bytes), best of %d runs:\n", n_copies, entry->input_fname, in.len, BENCHMARK_RUNS);
+
+    static const struct {
+        enum phases_1_2_search search;
+        const char *name;
+    } searches[] = {
+        { PHASES_1_2_SCALAR, "scalar" },
+        { PHASES_1_2_SSE2, "SSE2" },
+        { PHASES_1_2_AVX2, "AVX2" }
+    };
+    struct phases_1_2_info scalar_result;
+    const double scalar_seconds = time_phases_1_2(in, PHASES_1_2_SCALAR, &scalar_result);
+    printf("  %-6s %6.2f GB/s\n", searches[0].name, (double)in.len / scalar_seconds / 1e9);
+    for (size_t i = 1; i < sizeof(searches) / sizeof(searches[0]); i++) {
+        if (!phases_1_2_search_supported(searches[i].search)) {
+            printf("  %-6s not supported by this CPU\n", searches[i].name);
+            continue;
+        }
+        struct phases_1_2_info result;
+        const double seconds = time_phases_1_2(in, searches[i].search, &result);
+        if (!phases_1_2_infos_eq(result, scalar_result)) {
+            driver_error("Phases 1 and 2 with the %s search give a different result than with the scalar one.", searches[i].name);
+        }
+        printf("  %-6s %6.2f GB/s (%.1fx scalar)\n", searches[i].name, (double)in.len / seconds / 1e9, scalar_seconds / seconds);
+        free_phases_1_2_info(result, in);
+    }
+    free_phases_1_2_info(scalar_result, in);
+    FREE(copies);
+}
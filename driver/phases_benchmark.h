@@ -0,0 +1,13 @@
+#ifndef ICK_PHASES_BENCHMARK_H
+#define ICK_PHASES_BENCHMARK_H
+
+#include "batch.h"
+
+/*
+ * Benchmarks translation phases 1 and 2. Entry's input is repeated until it's a few hundred MB, and apply_phases_1_2 is
+ * timed on that with each way of searching for trigraphs and line splices that the CPU supports. Prints the throughput
+ * of each in GB/s, next to the scalar search's, and checks that they all give the same result.
+ */
+void benchmark_phases_1_2(const batch_entry *entry);
+
+#endif //ICK_PHASES_BENCHMARK_H
@@ -0,0 +1,288 @@
+#ifdef __linux__
+#define _GNU_SOURCE // for struct ucred
+#endif
+#include "server.h"
+#include "command_line.h"
+#include "diagnostics.h"
+#include "data_structures/sstr.h"
+#include "debug/malloc.h"
+#include "preprocessor/header_search.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Requests bigger than this are assumed to be garbage rather than command lines
+#define MAX_REQUEST_STRINGS 65536
+#define MAX_REQUEST_STRING_LEN (1u << 20)
+
+static bool read_fully(const int fd, void *const data, size_t len) {
+    unsigned char *p = data;
+    while (len > 0) {
+        const ssize_t n_read = read(fd, p, len);
+        if (n_read < 0 && errno == EINTR) continue;
+        if (n_read <= 0) return false;
+        p += n_read;
+        len -= (size_t)n_read;
+    }
+    return true;
+}
+
+static bool write_fully(const int fd, const void *const data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        const ssize_t n_written = write(fd, p, len);
+        if (n_written < 0 && errno == EINTR) continue;
+        if (n_written <= 0) return false;
+        p += n_written;
+        len -= (size_t)n_written;
+    }
+    return true;
+}
+
+static void append_u32(uchar_vec *const message, const uint32_t value) {
+    uchar_vec_append_all_arr(message, (const unsigned char *)&value, sizeof(value));
+}
+
+static void append_string(uchar_vec *const message, const char *const str, const size_t len) {
+    append_u32(message, (uint32_t)len);
+    uchar_vec_append_all_arr(message, (const unsigned char *)str, len);
+}
+
+// Reads a uint32_t length followed by that many bytes. Returns a malloc'd, null-terminated string, or NULL on failure.
+static char *read_string(const int fd, const uint32_t max_len, uint32_t *const len_out) {
+    uint32_t len;
+    if (!read_fully(fd, &len, sizeof(len)) || len > max_len) return NULL;
+    char *const str = MALLOC((size_t)len + 1);
+    if (!read_fully(fd, str, len)) {
+        FREE(str);
+        return NULL;
+    }
+    str[len] = '\0';
+    if (len_out != NULL) *len_out = len;
+    return str;
+}
+
+// On success, the first string is the client's working directory, and the rest are its arguments
+static bool read_request(const int fd, char_p_vec *const strings) {
+    uint32_t n_strings;
+    if (!read_fully(fd, &n_strings, sizeof(n_strings)) || n_strings == 0 || n_strings > MAX_REQUEST_STRINGS) return false;
+    for (uint32_t i = 0; i < n_strings; i++) {
+        char *const str = read_string(fd, MAX_REQUEST_STRING_LEN, NULL);
+        if (str == NULL) return false;
+        char_p_vec_append(strings, str);
+    }
+    return strings->arr.data[0][0] == '/';
+}
+
+// The server writes files with its own permissions, so it only takes jobs from the user running it
+static bool peer_is_same_user(const int fd) {
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t credentials_len = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_len) == 0 && credentials.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+// Closes the files a failed job was writing, and deletes them, since they're incomplete
+static void discard_open_outputs(open_output_vec *const outputs) {
+    for (size_t i = 0; i < outputs->arr.len; i++) {
+        close(outputs->arr.data[i].fd);
+        unlink(outputs->arr.data[i].fname);
+        FREE(outputs->arr.data[i].fname);
+    }
+    outputs->arr.len = 0;
+}
+
+// Like run_command_line, but one entry at a time on the calling thread, since the server's threads are the parallelism
+static void run_job(const struct command_line *const command_line) {
+    if (command_line->server_socket != NULL) {
+        driver_error("--server can't be sent to a server.");
+    }
+    if (command_line->edit_trace_fname != NULL) {
+        driver_error("--replay-edits can't be sent to a server.");
+    }
+    if (command_line->dump_tokens) {
+        driver_error("--dump-tokens can't be sent to a server.");
+    }
+    if (command_line->benchmark_phases_1_2) {
+        driver_error("--bench-phases-1-2 can't be sent to a server.");
+    }
+    // The server's standard input and output aren't the client's
+    for (size_t i = 0; i < command_line->entries.arr.len; i++) {
+        if (is_stdio_fname(command_line->entries.arr.data[i].input_fname)) {
+            driver_error("Standard input (\"%s\") can't be sent to a server; run ick without --client.", STDIO_FNAME);
+        }
+    }
+    // --token-cache and -j are the server's business, so they're ignored here
+    if (command_line->emit_pch_fname != NULL) {
+        emit_pch_for_entry(&command_line->entries.arr.data[0], command_line->emit_pch_fname);
+        return;
+    }
+    for (size_t i = 0; i < command_line->entries.arr.len; i++) {
+        preprocess_entry(&command_line->entries.arr.data[i], &command_line->options);
+    }
+}
+
+static void serve_connection(const int fd) {
+    char *output = NULL;
+    size_t output_len = 0;
+    char *diagnostics = NULL;
+    size_t diagnostics_len = 0;
+    FILE *const output_stream = open_memstream(&output, &output_len);
+    FILE *const diagnostics_stream = open_memstream(&diagnostics, &diagnostics_len);
+    if (output_stream == NULL || diagnostics_stream == NULL) {
+        // Without anywhere to put the job's messages, the client just sees the connection close
+        if (output_stream != NULL) fclose(output_stream);
+        if (diagnostics_stream != NULL) fclose(diagnostics_stream);
+        free(output);
+        free(diagnostics);
+        return;
+    }
+    jmp_buf on_fatal_error;
+    // On the heap, since the job changes it between setjmp and longjmp
+    open_output_vec *const open_outputs = MALLOC(sizeof(open_output_vec));
+    *open_outputs = open_output_vec_new(0);
+    const struct diagnostic_sink sink = {
+        .stream = diagnostics_stream,
+        .output_stream = output_stream,
+        .on_fatal_error = &on_fatal_error,
+        .open_outputs = open_outputs
+    };
+    volatile uint32_t status = 1;
+    set_diagnostic_sink(&sink);
+    // Anything a failed job allocated is leaked, like it would be if the job were its own process, but the files it
+    // has open are closed and deleted below (a job that succeeds has closed all of them)
+    if (setjmp(on_fatal_error) == 0) {
+        char_p_vec strings = char_p_vec_new(0);
+        if (!read_request(fd, &strings)) driver_error("Malformed request from client.");
+        // Checked after reading the request, so the client is listening for the reply
+        if (!peer_is_same_user(fd)) driver_error("This server only runs jobs from the user that started it.");
+        header_search_revalidate();
+        const char_p_harr args = { .data = &strings.arr.data[1], .len = strings.arr.len - 1 };
+        const struct command_line command_line = parse_command_line(args, strings.arr.data[0]);
+        run_job(&command_line);
+        status = 0;
+    }
+    set_diagnostic_sink(NULL);
+    discard_open_outputs(open_outputs);
+    FREE(open_outputs->arr.data);
+    FREE(open_outputs);
+    fclose(output_stream);
+    fclose(diagnostics_stream);
+
+    uchar_vec response = uchar_vec_new(0);
+    append_u32(&response, status);
+    append_string(&response, output, output_len);
+    append_string(&response, diagnostics, diagnostics_len);
+    // If the client went away, there's no one to tell
+    write_fully(fd, response.arr.data, response.arr.len);
+    FREE(response.arr.data);
+    free(output);
+    free(diagnostics);
+}
+
+static void *server_worker_main(void *const arg) {
+    const int listen_fd = *(const int *)arg;
+    while (true) {
+        // Every worker accepts on the same socket, so the kernel hands each connection to an idle worker
+        const int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            driver_error("Couldn't accept a connection. Errno: %d (%s).", errno, strerror(errno));
+        }
+        serve_connection(fd);
+        close(fd);
+    }
+}
+
+static struct sockaddr_un socket_address(const char *const socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        driver_error("The socket path \"%s\" is too long.", socket_path);
+    }
+    strcpy(address.sun_path, socket_path);
+    return address;
+}
+
+void run_server(const char *const socket_path, size_t n_threads) {
+    // A client that disconnects early shouldn't kill the server
+    signal(SIGPIPE, SIG_IGN);
+    const struct sockaddr_un address = socket_address(socket_path);
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) driver_error("Couldn't create a socket. Errno: %d (%s).", errno, strerror(errno));
+    unlink(socket_path);
+    if (bind(listen_fd, (const struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        driver_error("Couldn't listen on \"%s\". Errno: %d (%s).", socket_path, errno, strerror(errno));
+    }
+
+    if (n_threads == 0) {
+        const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n_cpus > 0 ? (size_t)n_cpus : 1;
+    }
+    printf("Listening on %s with %zu threads\n", socket_path, n_threads);
+    fflush(stdout);
+    pthread_t *const workers = MALLOC(n_threads * sizeof(pthread_t));
+    for (size_t i = 0; i < n_threads; i++) {
+        const int err = pthread_create(&workers[i], NULL, server_worker_main, (void *)(uintptr_t)&listen_fd);
+        if (err != 0) driver_error("Couldn't start worker thread. Errno: %d (%s).", err, strerror(err));
+    }
+    // The workers only stop if accept fails, which exits the process
+    for (size_t i = 0; i < n_threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    exit(1);
+}
+
+int run_client(const char *const socket_path, const char_p_harr args) {
+    const struct sockaddr_un address = socket_address(socket_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (const struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        driver_error("Couldn't get the working directory. Errno: %d (%s).", errno, strerror(errno));
+    }
+
+    uchar_vec request = uchar_vec_new(0);
+    append_u32(&request, (uint32_t)args.len + 1);
+    append_string(&request, cwd, strlen(cwd));
+    for (size_t i = 0; i < args.len; i++) {
+        append_string(&request, args.data[i], strlen(args.data[i]));
+    }
+    uint32_t status;
+    uint32_t output_len;
+    uint32_t diagnostics_len;
+    char *output = NULL;
+    char *diagnostics = NULL;
+    if (!write_fully(fd, request.arr.data, request.arr.len)
+    || !read_fully(fd, &status, sizeof(status))
+    || (output = read_string(fd, UINT32_MAX, &output_len)) == NULL
+    || (diagnostics = read_string(fd, UINT32_MAX, &diagnostics_len)) == NULL) {
+        driver_error("Lost the connection to the ick server at \"%s\".", socket_path);
+    }
+    close(fd);
+    FREE(request.arr.data);
+    fwrite(output, 1, output_len, stdout);
+    fwrite(diagnostics, 1, diagnostics_len, stderr);
+    FREE(output);
+    FREE(diagnostics);
+    return (int)status;
+}
@@ -0,0 +1,34 @@
+#ifndef ICK_SERVER_H
+#define ICK_SERVER_H
+
+#include <stddef.h>
+#include "data_structures/vector.h"
+
+/*
+ * A resident ick, which preprocesses jobs sent by ick --client over a Unix domain socket.
+ * Since the process stays up, the grammar, the parses of included files, and the header search's directory listings
+ * stay warm from one job to the next. Included files are checked against their mtime and size on every use, and
+ * directories are checked against their mtime once per job, so edits are picked up.
+ *
+ * A job is one connection. The client sends the number of strings that follow, then each string as its length
+ * followed by its bytes: first the client's working directory, then its arguments. All numbers are uint32_t in the
+ * byte order of the machine (the socket is local). ick doesn't read any environment variables, so none are sent.
+ * The server writes the outputs the arguments ask for, then replies with the job's exit status, what the job printed
+ * to standard output (like the rule from -M -MF -), and its diagnostics: the status, then the other two as lengths
+ * followed by bytes. Jobs can't read standard input, since the server's isn't the client's.
+ */
+
+/*
+ * Listens on socket_path (replacing anything that's already there) and runs jobs on n_threads worker threads
+ * (0 means one per online CPU). Never returns.
+ */
+__attribute__((noreturn))
+void run_server(const char *socket_path, size_t n_threads);
+
+/*
+ * Sends args, and the working directory, to the server at socket_path, and writes the server's diagnostics to stderr.
+ * Returns the job's exit status, or -1 if no server could be reached (so the caller can do the work itself).
+ */
+int run_client(const char *socket_path, char_p_harr args);
+
+#endif //ICK_SERVER_H
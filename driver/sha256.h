@@ -0,0 +1,23 @@
+#ifndef ICK_SHA256_H
+#define ICK_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/*
+ * Incremental SHA-256 (FIPS 180-4).
+ */
+struct sha256 {
+    uint32_t state[8];
+    uint64_t n_bytes;
+    unsigned char block[64];
+    size_t block_len;
+};
+
+struct sha256 sha256_new(void);
+void sha256_update(struct sha256 *hash, const void *data, size_t len);
+void sha256_finish(struct sha256 *hash, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+#endif //ICK_SHA256_H
@@ -0,0 +1,89 @@
+#include "source_buffer.h"
+#include "diagnostics.h"
+#include "debug/malloc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct source_buffer read_all(const int fd) {
+    size_t capacity = 4096;
+    size_t len = 0;
+    unsigned char *data = MALLOC(capacity + 1);
+    while (true) {
+        if (len == capacity) {
+            capacity *= 2;
+            data = REALLOC(data, capacity + 1);
+        }
+        const ssize_t n_read = read(fd, &data[len], capacity - len);
+        if (n_read == 0) break;
+        if (n_read < 0) {
+            if (errno == EINTR) continue;
+            driver_error("Error reading input. Errno: %d (%s).", errno, strerror(errno));
+        }
+        len += (size_t)n_read;
+    }
+    // There's always room for one more byte; see the +1s above
+    data[len] = '\n';
+    len++;
+    return (struct source_buffer) { .contents = { .data = data, .len = len }, .mapping_len = 0 };
+}
+
+// Returns false, with nothing mapped, if the file can't be mapped
+static bool map_regular_file(const int fd, const size_t filesize, struct source_buffer *const buf) {
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    // Reserve one extra byte past the end of the file for the final newline, so it can be added without copying.
+    // If filesize is a multiple of the page size, that byte is in the anonymous page reserved here;
+    // otherwise it's in the zero-filled tail of the file's last page.
+    const size_t mapping_len = filesize + 1;
+    unsigned char *const base = mmap(NULL, mapping_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        driver_error("Couldn't reserve memory for the input file. Errno: %d (%s).", errno, strerror(errno));
+    }
+    if (mmap(base, filesize, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        driver_error("Couldn't map the input file. Errno: %d (%s).", errno, strerror(errno));
+    }
+
+    unsigned char *const last_page = base + ((filesize / page_size) * page_size);
+    if (mprotect(last_page, page_size, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, mapping_len);
+        return false;
+    }
+    base[filesize] = '\n';
+    // If this fails, the page just stays writable
+    mprotect(last_page, page_size, PROT_READ);
+    *buf = (struct source_buffer) { .contents = { .data = base, .len = filesize + 1 }, .mapping_len = mapping_len };
+    return true;
+}
+
+struct source_buffer read_source_buffer_fd(const int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        if ((uintmax_t)st.st_size >= SIZE_MAX) {
+            driver_error("Input file is too large (%jd bytes); the limit is SIZE_MAX (%zu)", (intmax_t)st.st_size, SIZE_MAX);
+        }
+        struct source_buffer buf;
+        if (map_regular_file(fd, (size_t)st.st_size, &buf)) return buf;
+    }
+    // Pipes, terminals, empty files (which can't be mapped), files whose last page can't be written to, etc.
+    return read_all(fd);
+}
+
+bool open_source_buffer(const char *const fname, struct source_buffer *const buf) {
+    const int fd = open(fname, O_RDONLY);
+    if (fd == -1) return false;
+    *buf = read_source_buffer_fd(fd);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    return true;
+}
+
+void close_source_buffer(const struct source_buffer *const buf) {
+    if (buf->mapping_len == 0) {
+        FREE(buf->contents.data);
+    } else {
+        munmap(buf->contents.data, buf->mapping_len);
+    }
+}
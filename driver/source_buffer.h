@@ -0,0 +1,33 @@
+#ifndef ICK_SOURCE_BUFFER_H
+#define ICK_SOURCE_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "data_structures/sstr.h"
+
+/*
+ * The raw contents of a source file, as handed to translation phase 1.
+ * Regular files are mmap'd read-only, so nothing is copied; pipes and other special files are read into a heap buffer.
+ * contents is the file followed by one extra newline, written into the slack space after the end of the file (only the
+ * last page gets copied on write). Even a file that ends in a newline needs it, in case that newline is spliced away
+ * by a backslash (or ??/) before it.
+ * contents stays valid until the buffer is closed, so tokens can point straight into it.
+ */
+struct source_buffer {
+    sstr contents;
+    size_t mapping_len; // 0 if contents is heap-allocated
+};
+
+/*
+ * Opens and loads fname. Returns false, leaving *buf untouched, if the file can't be opened.
+ */
+bool open_source_buffer(const char *fname, struct source_buffer *buf);
+
+/*
+ * Loads everything from an already-open file descriptor. The descriptor isn't closed.
+ */
+struct source_buffer read_source_buffer_fd(int fd);
+
+void close_source_buffer(const struct source_buffer *buf);
+
+#endif //ICK_SOURCE_BUFFER_H
@@ -1,13 +1,12 @@
 #include <stdio.h>
 #include <string.h>
 #include "data_structures/vector.h"
-#include "driver/file_utils.h"
+#include "driver/command_line.h"
 #include "driver/diagnostics.h"
-#include "preprocessor/trigraphs.h"
-#include "preprocessor/escaped_newlines.h"
+#include "driver/server.h"
+#include "debug/trace.h"
 #include "preprocessor/pp_token.h"
-#include "preprocessor/parser.h"
-#include "preprocessor/preprocessor.h"
+#include "preprocessor/token_cache.h"
 
 char *ick_progname;
 
@@ -25,29 +24,36 @@ int main(int argc, char *argv[]) {
         ick_progname = &argv[0][i+1];
     }
 
-    if (argc <= 1) {
-        driver_error("No target file(s) specified.");
+    char_p_harr args = { .data = &argv[1], .len = argc > 0 ? (size_t)argc - 1 : 0 };
+    if (args.len > 0 && strcmp(args.data[0], "--client") == 0) {
+        if (args.len == 1) driver_error("Missing argument to --client.");
+        const char_p_harr job_args = { .data = &args.data[2], .len = args.len - 2 };
+        const int status = run_client(args.data[1], job_args);
+        if (status >= 0) return status;
+        // There's no server running, so do the job here instead
+        args = job_args;
     }
 
-    const char *input_fname = argv[1];
-
-    char *output_fname = new_fname_ext(input_fname, PREPROCESSED_EXT);
-
-    if (strcmp(input_fname, output_fname) == 0) {
-        // TODO when -o support is added, make message depend on whether -o is passed
-        driver_error("The output filename, \"%s\", is the same as the input filename.", output_fname);
+    const struct command_line command_line = parse_command_line(args, NULL);
+    if (command_line.trace_spec != NULL) {
+#ifdef ICK_TRACING
+        if (!set_trace_levels(command_line.trace_spec)) {
+            driver_error("Invalid --trace value \"%s\"; the categories are lexer, earley, macro, cond, and include, "
+                         "each optionally followed by :1 or :2.", command_line.trace_spec);
+        }
+#else
+        driver_error("--trace needs ick to be built with ICK_TRACING defined.");
+#endif
     }
-
-    FILE *input_file = fopen(input_fname, "r");
-    if (input_file == NULL) {
-        driver_error("Input file \"%s\" does not exist.", input_fname);
+    if (command_line.token_cache_dir != NULL) {
+        token_cache_set_dir(command_line.token_cache_dir);
     }
-
-    FILE *output_file = fopen(output_fname, "w");
-
-    const pp_token_harr preprocessed_tokens = preprocess_file(input_file);
-    print_tokens(output_file, preprocessed_tokens, false, false);
-
-    printf("\nSuccessfully preprocessed to %s\n", output_fname);
-    FREE(output_fname);
+    if (!command_line.use_batch_mode && command_line.server_socket == NULL) {
+        // Only one file is preprocessed at a time, so its lexer can use the threads
+        set_lexer_threads(command_line.options.n_threads);
+    }
+    if (command_line.server_socket != NULL) {
+        run_server(command_line.server_socket, command_line.options.n_threads);
+    }
+    run_command_line(&command_line);
 }
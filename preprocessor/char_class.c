@@ -0,0 +1,141 @@
+#include "char_class.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define NO 0
+#define HS (CHAR_CLASS_SPACE | CHAR_CLASS_HORIZONTAL_SPACE | CHAR_CLASS_SOURCE)
+#define VS CHAR_CLASS_SPACE
+#define PU CHAR_CLASS_SOURCE
+#define OD (CHAR_CLASS_DIGIT | CHAR_CLASS_HEX_DIGIT | CHAR_CLASS_OCTAL_DIGIT | CHAR_CLASS_SOURCE | CHAR_CLASS_IDENTIFIER)
+#define DD (CHAR_CLASS_DIGIT | CHAR_CLASS_HEX_DIGIT | CHAR_CLASS_SOURCE | CHAR_CLASS_IDENTIFIER)
+#define HL (CHAR_CLASS_LETTER | CHAR_CLASS_HEX_DIGIT | CHAR_CLASS_SOURCE | CHAR_CLASS_IDENTIFIER)
+#define LE (CHAR_CLASS_LETTER | CHAR_CLASS_SOURCE | CHAR_CLASS_IDENTIFIER)
+#define US (CHAR_CLASS_SOURCE | CHAR_CLASS_IDENTIFIER)
+
+const unsigned char char_classes[256] = {
+    /* 0_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, HS, VS, HS, HS, VS, NO, NO,
+    /* 1_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* 2_ */ HS, PU, PU, PU, NO, PU, PU, PU, PU, PU, PU, PU, PU, PU, PU, PU,
+    /* 3_ */ OD, OD, OD, OD, OD, OD, OD, OD, DD, DD, PU, PU, PU, PU, PU, PU,
+    /* 4_ */ NO, HL, HL, HL, HL, HL, HL, LE, LE, LE, LE, LE, LE, LE, LE, LE,
+    /* 5_ */ LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, PU, PU, PU, PU, US,
+    /* 6_ */ NO, HL, HL, HL, HL, HL, HL, LE, LE, LE, LE, LE, LE, LE, LE, LE,
+    /* 7_ */ LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, LE, PU, PU, PU, PU, NO,
+    /* 8_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* 9_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* A_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* B_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* C_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* D_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* E_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+    /* F_ */ NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO, NO,
+};
+
+#undef NO
+#undef HS
+#undef VS
+#undef PU
+#undef OD
+#undef DD
+#undef HL
+#undef LE
+#undef US
+
+bool char_in_run(const enum char_run run, const unsigned char stop, const unsigned char c) {
+    switch (run) {
+        case CHAR_RUN_NONE:
+            return false;
+        case CHAR_RUN_IDENTIFIER:
+            return char_has_class(c, CHAR_CLASS_IDENTIFIER);
+        case CHAR_RUN_HORIZONTAL_SPACE:
+            return char_has_class(c, CHAR_CLASS_HORIZONTAL_SPACE);
+        case CHAR_RUN_UNTIL_BYTE:
+            return c != stop;
+        case CHAR_RUN_LITERAL_BODY:
+            return char_has_class(c, CHAR_CLASS_SOURCE) && c != '\\' && c != stop;
+    }
+    return false;
+}
+
+#if defined(__AVX2__)
+typedef __m256i byte_block;
+#define BLOCK_SIZE 32
+#define block_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define block_splat(c) _mm256_set1_epi8((char)(c))
+#define block_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define block_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#define block_or(a, b) _mm256_or_si256(a, b)
+#define block_andnot(a, b) _mm256_andnot_si256(a, b)
+#define block_add(a, b) _mm256_add_epi8(a, b)
+#define block_mask(a) (uint32_t)_mm256_movemask_epi8(a)
+#define FULL_BLOCK_MASK 0xffffffffu
+#elif defined(__SSE2__)
+typedef __m128i byte_block;
+#define BLOCK_SIZE 16
+#define block_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define block_splat(c) _mm_set1_epi8((char)(c))
+#define block_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define block_gt(a, b) _mm_cmpgt_epi8(a, b)
+#define block_or(a, b) _mm_or_si128(a, b)
+#define block_andnot(a, b) _mm_andnot_si128(a, b)
+#define block_add(a, b) _mm_add_epi8(a, b)
+#define block_mask(a) (uint32_t)_mm_movemask_epi8(a)
+#define FULL_BLOCK_MASK 0xffffu
+#endif
+
+#ifdef BLOCK_SIZE
+// Which bytes are in [low, high]. The comparison is signed, so the range is moved to start at -128 first.
+static byte_block block_in_range(const byte_block bytes, const unsigned char low, const unsigned char high) {
+    const byte_block shifted = block_add(bytes, block_splat(0x80 - low));
+    return block_gt(block_splat(0x80 + (high - low) + 1), shifted);
+}
+
+// \t \v \f; they're on either side of \n
+static byte_block horizontal_control_chars(const byte_block bytes) {
+    return block_andnot(block_eq(bytes, block_splat('\n')), block_in_range(bytes, '\t', '\f'));
+}
+
+// Which bytes of the block are in the run
+static byte_block block_in_run(const enum char_run run, const unsigned char stop, const byte_block bytes) {
+    switch (run) {
+        case CHAR_RUN_IDENTIFIER: {
+            const byte_block lower = block_or(bytes, block_splat(0x20));
+            return block_or(block_or(block_in_range(lower, 'a', 'z'), block_in_range(bytes, '0', '9')), block_eq(bytes, block_splat('_')));
+        }
+        case CHAR_RUN_HORIZONTAL_SPACE:
+            return block_or(block_eq(bytes, block_splat(' ')), horizontal_control_chars(bytes));
+        case CHAR_RUN_LITERAL_BODY: {
+            // Source characters are the printable ones apart from $ @ and `, and \t \v \f
+            const byte_block source = block_or(block_in_range(bytes, ' ', '~'), horizontal_control_chars(bytes));
+            const byte_block excluded = block_or(block_or(block_eq(bytes, block_splat('$')), block_eq(bytes, block_splat('@'))),
+                                                 block_or(block_or(block_eq(bytes, block_splat('`')), block_eq(bytes, block_splat('\\'))),
+                                                          block_eq(bytes, block_splat(stop))));
+            return block_andnot(excluded, source);
+        }
+        case CHAR_RUN_NONE:
+        case CHAR_RUN_UNTIL_BYTE:
+            break;
+    }
+    return block_splat(0);
+}
+#endif
+
+size_t skip_char_run(const enum char_run run, const unsigned char stop, const unsigned char *const data, size_t start, const size_t len) {
+    if (run == CHAR_RUN_UNTIL_BYTE) {
+        const unsigned char *const found = memchr(&data[start], stop, len - start);
+        return found == NULL ? len : (size_t)(found - data);
+    }
+#ifdef BLOCK_SIZE
+    if (run != CHAR_RUN_NONE) {
+        for (; start + BLOCK_SIZE <= len; start += BLOCK_SIZE) {
+            const uint32_t outside = ~block_mask(block_in_run(run, stop, block_load(&data[start]))) & FULL_BLOCK_MASK;
+            if (outside != 0) return start + (size_t)__builtin_ctz(outside);
+        }
+    }
+#endif
+    while (start < len && char_in_run(run, stop, data[start])) start++;
+    return start;
+}
@@ -0,0 +1,40 @@
+#ifndef ICK_CHAR_CLASS_H
+#define ICK_CHAR_CLASS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// What the lexer needs to know about a byte; these don't depend on the locale, unlike the ones in <ctype.h>
+enum char_class {
+    CHAR_CLASS_DIGIT = 1 << 0,
+    CHAR_CLASS_LETTER = 1 << 1, // A-Z and a-z
+    CHAR_CLASS_HEX_DIGIT = 1 << 2,
+    CHAR_CLASS_OCTAL_DIGIT = 1 << 3,
+    CHAR_CLASS_SPACE = 1 << 4, // what isspace accepts in the C locale
+    CHAR_CLASS_HORIZONTAL_SPACE = 1 << 5, // space, tab, vertical tab, and form feed
+    CHAR_CLASS_SOURCE = 1 << 6, // the basic source character set, apart from newline
+    CHAR_CLASS_IDENTIFIER = 1 << 7 // digits, letters, and _
+};
+
+extern const unsigned char char_classes[256];
+
+static inline bool char_has_class(const unsigned char c, const enum char_class char_class) {
+    return (char_classes[c] & char_class) != 0;
+}
+
+// Runs of bytes that the lexer can consume at once, because they can't change the state it's in
+enum char_run {
+    CHAR_RUN_NONE,
+    CHAR_RUN_IDENTIFIER, // digits, letters, and _
+    CHAR_RUN_HORIZONTAL_SPACE,
+    CHAR_RUN_UNTIL_BYTE, // anything but the stop byte (e.g. the body of a comment)
+    CHAR_RUN_LITERAL_BODY // source characters apart from \, $, @, `, and the stop byte (e.g. the body of a string literal)
+};
+
+// Whether c is part of a run of the given kind
+bool char_in_run(enum char_run run, unsigned char stop, unsigned char c);
+
+// The index of the first byte at or after start that isn't part of a run of the given kind, or len if there's none
+size_t skip_char_run(enum char_run run, unsigned char stop, const unsigned char *data, size_t start, size_t len);
+
+#endif //ICK_CHAR_CLASS_H
@@ -5,6 +5,7 @@
 #include "conditional_inclusion.h"
 #include "preprocessor/diagnostics.h"
 #include "debug/color_print.h"
+#include "debug/trace.h"
 #include "mappings/typedefs.h"
 
 static struct maybe_signed_intmax msi_s(const target_intmax_t num) {
@@ -55,7 +56,7 @@ static unsigned char get_hex_digit_value(const unsigned char digit) {
     else if (digit == 'e' || digit == 'E') return 14;
     else if (digit == 'f' || digit == 'F') return 15;
     else {
-        preprocessor_fatal_error(0, 0, 0, "invalid hex digit");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "invalid hex digit");
     }
 }
 
@@ -64,7 +65,7 @@ static unsigned char extract_bits(const unsigned int num, const unsigned char i,
     return (unsigned char)((num & (mask << i)) >> i);
 }
 
-static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide) {
+static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide, const struct source_location location) {
     const unsigned int max_esc_seq_val = is_wide ? ((uint64_t)1 << (sizeof(wchar_t) * 8)) - 1 : UCHAR_MAX;
     if ('0' <= esc_seq.data[1] && esc_seq.data[1] <= '7') {
         unsigned int out = 0;
@@ -72,7 +73,7 @@ static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide)
             out += (unsigned int) ((esc_seq.data[i] - '0') << ((esc_seq.len - 1 - i) * 3));
         }
         if (out > max_esc_seq_val) {
-            preprocessor_fatal_error(0, 0, 0, "octal escape sequence represents a number too large");
+            preprocessor_fatal_error(location, "octal escape sequence represents a number too large");
         }
         return out;
     } else if (esc_seq.data[1] == 'x') {
@@ -81,7 +82,7 @@ static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide)
             out += (unsigned int) (get_hex_digit_value(esc_seq.data[i]) << ((esc_seq.len - 1 - i) * 4));
         }
         if (out > max_esc_seq_val) {
-            preprocessor_fatal_error(0, 0, 0, "hex escape sequence represents a number too large (%x > %x)", out, max_esc_seq_val);
+            preprocessor_fatal_error(location, "hex escape sequence represents a number too large (%x > %x)", out, max_esc_seq_val);
         }
         return out;
     } else if (esc_seq.data[1] == 'u' || esc_seq.data[1] == 'U') {
@@ -90,7 +91,7 @@ static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide)
             code_point += (unsigned int) (get_hex_digit_value(esc_seq.data[i]) << ((esc_seq.len - 1 - i) * 4));
         }
         if ((code_point < 0xA0u && code_point != 0x24u && code_point != 0x40u && code_point != 0x60u) || code_point > 0x10FFFFu) {
-            preprocessor_fatal_error(0, 0, 0, "invalid universal character name");
+            preprocessor_fatal_error(location, "invalid universal character name");
         }
         if (code_point <= 0x7F || is_wide) {
             return code_point;
@@ -121,7 +122,7 @@ static unsigned int eval_escape_sequence(const sstr esc_seq, const bool is_wide)
             case 'r': return get_ascii_value('\r');
             case 't': return get_ascii_value('\t');
             case 'v': return get_ascii_value('\v');
-            default: preprocessor_fatal_error(0, 0, 0, "invalid escape sequence");
+            default: preprocessor_fatal_error(location, "invalid escape sequence");
         }
     }
 }
@@ -136,7 +137,7 @@ static unsigned char get_esc_seq_n_bytes(const sstr esc_seq) {
     }
 }
 
-static ssize_t scan_esc_seq(const sstr str, size_t i) {
+static ssize_t scan_esc_seq(const sstr str, size_t i, const struct source_location location) {
     if (i + 1 >= str.len || str.data[i] != '\\') return -1;
     i++;
     switch (str.data[i]) {
@@ -165,14 +166,14 @@ static ssize_t scan_esc_seq(const sstr str, size_t i) {
             return i - first_digit_i == 8 ? (ssize_t)i : -1;
         }
         default:
-            preprocessor_fatal_error(0, 0, 0, "tried to scan invalid escape sequence");
+            preprocessor_fatal_error(location, "tried to scan invalid escape sequence");
     }
 }
 
-static ssize_t scan_c_char(const sstr str, size_t i) {
+static ssize_t scan_c_char(const sstr str, size_t i, const struct source_location location) {
     if (i >= str.len || str.data[i] == '\'') return -1;
     if (str.data[i] == '\\') {
-        return scan_esc_seq(str, i);
+        return scan_esc_seq(str, i, location);
     } else if (in_src_char_set(str.data[i])) {
         return (ssize_t)i+1;
     } else {
@@ -185,13 +186,13 @@ struct parsed_char_constant {
     bool is_wide;
 };
 
-static struct parsed_char_constant parse_char_constant(const sstr char_constant) {
+static struct parsed_char_constant parse_char_constant(const sstr char_constant, const struct source_location location) {
     const bool is_wide = char_constant.data[0] == 'L';
     ssize_t i = char_constant.data[0] == 'L' ? 2 : 1;
     sstr_vec c_chars = sstr_vec_new(0);
     while (true) {
         const size_t char_start = (size_t)i;
-        i = scan_c_char(char_constant, (size_t)i);
+        i = scan_c_char(char_constant, (size_t)i, location);
         if (i == -1) break;
         sstr_vec_append(&c_chars, slice(char_constant, char_start, (size_t)i));
     }
@@ -200,11 +201,12 @@ static struct parsed_char_constant parse_char_constant(const sstr char_constant)
     };
 }
 
-static int eval_char_constant(const struct earley_rule rule) {
+static int eval_char_constant(const struct earley_rule rule, const struct diagnostic_file *const file) {
     const sstr rule_val = rule.rhs.symbols.data[0].val.terminal.token.name;
+    const struct source_location location = location_in(file, rule_val);
     uchar_vec rule_val_vec = uchar_vec_new(0);
     uchar_vec_append_all_harr(&rule_val_vec, rule_val);
-    const struct parsed_char_constant parse = parse_char_constant(rule_val_vec.arr);
+    const struct parsed_char_constant parse = parse_char_constant(rule_val_vec.arr, location);
 
     int out = 0;
     size_t current_byte = 0;
@@ -212,16 +214,16 @@ static int eval_char_constant(const struct earley_rule rule) {
         if (parse.c_chars.data[i].data[0] != '\\') {
             const unsigned char char_val = get_ascii_value(parse.c_chars.data[i].data[0]);
             if (current_byte + 1 > sizeof(int)) {
-                preprocessor_fatal_error(0, 0, 0, "character constant doesn't fit in an int");
+                preprocessor_fatal_error(location, "character constant doesn't fit in an int");
             } else {
                 out += char_val << (current_byte * 8);
             }
             current_byte += (parse.is_wide ? 4 : 1);
         } else {
-            const int char_val = (int)eval_escape_sequence(parse.c_chars.data[i], parse.is_wide);
+            const int char_val = (int)eval_escape_sequence(parse.c_chars.data[i], parse.is_wide, location);
             const unsigned char char_n_bytes = parse.is_wide ? 4 : get_esc_seq_n_bytes(parse.c_chars.data[i]);
             if (current_byte + char_n_bytes > sizeof(int)) {
-                preprocessor_fatal_error(0, 0, 0, "character constant doesn't fit in an int");
+                preprocessor_fatal_error(location, "character constant doesn't fit in an int");
             } else {
                 out += char_val << (current_byte * 8);
             }
@@ -229,7 +231,7 @@ static int eval_char_constant(const struct earley_rule rule) {
         }
     }
     if (!parse.is_wide && out > UCHAR_MAX) {
-        preprocessor_warning(0, 0, 0, "character constant doesn't fit in an unsigned char (a byte)");
+        preprocessor_warning(location, "character constant doesn't fit in an unsigned char (a byte)");
     }
     return out;
 }
@@ -297,58 +299,64 @@ static struct maybe_signed_intmax eval_int_constant(const struct earley_rule rul
     }
 }
 
-static struct maybe_signed_intmax eval_constant(const struct earley_rule rule) {
+// Where an expression starts, for diagnostics
+static struct source_location expr_location(const struct earley_rule *const rule, const struct diagnostic_file *const file) {
+    struct preprocessing_token first;
+    return rule_first_token(rule, &first) ? location_in(file, first.name) : file_location(file);
+}
+
+static struct maybe_signed_intmax eval_constant(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum constant_tag)rule.rhs.tag) {
         case CONSTANT_INTEGER:
             return eval_int_constant(*rule.completed_from.data[0]);
         case CONSTANT_FLOAT:
-            preprocessor_fatal_error(0, 0, 0, "preprocessor constant expressions must be integer expressions");
+            preprocessor_fatal_error(expr_location(&rule, file), "preprocessor constant expressions must be integer expressions");
         case CONSTANT_ENUM:
-            preprocessor_fatal_error(0, 0, 0, "enum constant should have been replaced with 0");
+            preprocessor_fatal_error(NO_SOURCE_LOCATION, "enum constant should have been replaced with 0");
         case CONSTANT_CHARACTER: {
-            const int val = eval_char_constant(*rule.completed_from.data[0]);
-            print_with_color(TEXT_COLOR_LIGHT_RED, "char constant evaluates to %d\n", val);
+            const int val = eval_char_constant(*rule.completed_from.data[0], file);
+            if (TRACING(COND, TRACE_BASIC)) print_with_color(TEXT_COLOR_LIGHT_RED, "char constant evaluates to %d\n", val);
             return msi_s(val);
         }
     }
 }
 
-static struct maybe_signed_intmax eval_cond_expr(struct earley_rule rule);
-static struct maybe_signed_intmax eval_assignment_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_cond_expr(struct earley_rule rule, const struct diagnostic_file *file);
+static struct maybe_signed_intmax eval_assignment_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum assignment_expr_tag)rule.rhs.tag) {
         case ASSIGNMENT_EXPR_CONDITIONAL:
-            return eval_cond_expr(*rule.completed_from.data[0]);
+            return eval_cond_expr(*rule.completed_from.data[0], file);
         case ASSIGNMENT_EXPR_NORMAL:
-            preprocessor_fatal_error(0, 0, 0, "assignment not allowed in preprocessor constant expression");
+            preprocessor_fatal_error(expr_location(&rule, file), "assignment not allowed in preprocessor constant expression");
     }
 }
 
-static struct maybe_signed_intmax eval_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch((enum list_rule_tag)rule.rhs.tag) {
         case LIST_RULE_ONE:
-            return eval_assignment_expr(*rule.completed_from.data[0]);
+            return eval_assignment_expr(*rule.completed_from.data[0], file);
         case LIST_RULE_MULTI:
-            preprocessor_fatal_error(0, 0, 0, "commas not allowed in preprocessor constant expression");
+            preprocessor_fatal_error(expr_location(&rule, file), "commas not allowed in preprocessor constant expression");
     }
 }
 
-static struct maybe_signed_intmax eval_primary_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_primary_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum primary_expr_tag)rule.rhs.tag) {
         case PRIMARY_EXPR_IDENTIFIER:
             return msi_s(0);
         case PRIMARY_EXPR_CONSTANT:
-            return eval_constant(*rule.completed_from.data[0]);
+            return eval_constant(*rule.completed_from.data[0], file);
         case PRIMARY_EXPR_STRING:
-            preprocessor_fatal_error(0, 0, 0, "string literals aren't allowed in a preprocessor constant expression");
+            preprocessor_fatal_error(expr_location(&rule, file), "string literals aren't allowed in a preprocessor constant expression");
         case PRIMARY_EXPR_PARENS:
-            return eval_expr(*rule.completed_from.data[0]);
+            return eval_expr(*rule.completed_from.data[0], file);
     }
 }
 
-static struct maybe_signed_intmax eval_postfix_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_postfix_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum postfix_expr_tag)rule.rhs.tag) {
         case POSTFIX_EXPR_PRIMARY:
-            return eval_primary_expr(*rule.completed_from.data[0]);
+            return eval_primary_expr(*rule.completed_from.data[0], file);
         case POSTFIX_EXPR_ARRAY_ACCESS:
         case POSTFIX_EXPR_FUNC:
         case POSTFIX_EXPR_DOT:
@@ -356,19 +364,19 @@ static struct maybe_signed_intmax eval_postfix_expr(const struct earley_rule rul
         case POSTFIX_EXPR_INC:
         case POSTFIX_EXPR_DEC:
         case POSTFIX_EXPR_COMPOUND_LITERAL:
-            preprocessor_fatal_error(0, 0, 0, "operation not supported in preprocessor constant expression");
+            preprocessor_fatal_error(expr_location(&rule, file), "operation not supported in preprocessor constant expression");
     }
 }
 
-static struct maybe_signed_intmax eval_cast_expr(struct earley_rule rule);
-static struct maybe_signed_intmax eval_unary_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_cast_expr(struct earley_rule rule, const struct diagnostic_file *file);
+static struct maybe_signed_intmax eval_unary_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch((enum unary_expr_tag)rule.rhs.tag) {
         case UNARY_EXPR_POSTFIX:
-            return eval_postfix_expr(*rule.completed_from.data[0]);
+            return eval_postfix_expr(*rule.completed_from.data[0], file);
         case UNARY_EXPR_INC: case UNARY_EXPR_DEC:
-            preprocessor_fatal_error(0, 0, 0, "++ and -- aren't allowed in constant expressions");
+            preprocessor_fatal_error(expr_location(&rule, file), "++ and -- aren't allowed in constant expressions");
         case UNARY_EXPR_UNARY_OP: {
-            const struct maybe_signed_intmax expr_val = eval_cast_expr(*rule.completed_from.data[1]);
+            const struct maybe_signed_intmax expr_val = eval_cast_expr(*rule.completed_from.data[1], file);
             switch ((enum unary_operator_tag)rule.completed_from.data[0]->rhs.tag) {
                 case UNARY_OPERATOR_PLUS:
                     if (expr_val.is_signed) return msi_s(+expr_val.val.signd);
@@ -383,23 +391,23 @@ static struct maybe_signed_intmax eval_unary_expr(const struct earley_rule rule)
                     if (expr_val.is_signed) return msi_s(!expr_val.val.signd);
                     else return msi_s(!expr_val.val.unsignd); // not a typo
                 case UNARY_OPERATOR_DEREFERENCE:
-                    preprocessor_fatal_error(0, 0, 0, "dereference operator isn't allowed in constant expressions");
+                    preprocessor_fatal_error(expr_location(&rule, file), "dereference operator isn't allowed in constant expressions");
                 case UNARY_OPERATOR_ADDRESS_OF:
-                    preprocessor_fatal_error(0, 0, 0, "address-of operator isn't allowed in constant expressions");
+                    preprocessor_fatal_error(expr_location(&rule, file), "address-of operator isn't allowed in constant expressions");
             }
         }
         case UNARY_EXPR_SIZEOF_UNARY: case UNARY_EXPR_SIZEOF_TYPE:
-            preprocessor_fatal_error(0, 0, 0,
+            preprocessor_fatal_error(NO_SOURCE_LOCATION,
                                      "sizeof found in preprocessor constant expression; should have been replaced with 0 earlier");
     }
 }
 
-static struct maybe_signed_intmax eval_cast_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_cast_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum cast_expr_tag)rule.rhs.tag) {
         case CAST_EXPR_UNARY:
-            return eval_unary_expr(*rule.completed_from.data[0]);
+            return eval_unary_expr(*rule.completed_from.data[0], file);
         case CAST_EXPR_NORMAL:
-            preprocessor_fatal_error(0, 0, 0, "cast expressions aren't allowed in constant expressions");
+            preprocessor_fatal_error(expr_location(&rule, file), "cast expressions aren't allowed in constant expressions");
     }
 }
 
@@ -407,119 +415,119 @@ static struct maybe_signed_intmax eval_cast_expr(const struct earley_rule rule)
 #pragma clang diagnostic ignored "-Wsign-compare"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wsign-conversion"
-static struct maybe_signed_intmax eval_mult_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_mult_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == MULTIPLICATIVE_EXPR_CAST) {
-        return eval_cast_expr(*rule.completed_from.data[0]);
+        return eval_cast_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == MULTIPLICATIVE_EXPR_MULT) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0]), eval_cast_expr(*rule.completed_from.data[1]), *);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0], file), eval_cast_expr(*rule.completed_from.data[1], file), *);
     } else if (rule.rhs.tag == MULTIPLICATIVE_EXPR_DIV) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0]), eval_cast_expr(*rule.completed_from.data[1]), /);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0], file), eval_cast_expr(*rule.completed_from.data[1], file), /);
     } else if (rule.rhs.tag == MULTIPLICATIVE_EXPR_MOD) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0]), eval_cast_expr(*rule.completed_from.data[1]), %);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_mult_expr(*rule.completed_from.data[0], file), eval_cast_expr(*rule.completed_from.data[1], file), %);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Multiplicative expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Multiplicative expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_add_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_add_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == ADDITIVE_EXPR_MULT) {
-        return eval_mult_expr(*rule.completed_from.data[0]);
+        return eval_mult_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == ADDITIVE_EXPR_PLUS) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_add_expr(*rule.completed_from.data[0]), eval_mult_expr(*rule.completed_from.data[1]), +);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_add_expr(*rule.completed_from.data[0], file), eval_mult_expr(*rule.completed_from.data[1], file), +);
     } else if (rule.rhs.tag == ADDITIVE_EXPR_MINUS) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_add_expr(*rule.completed_from.data[0]), eval_mult_expr(*rule.completed_from.data[1]), -);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_add_expr(*rule.completed_from.data[0], file), eval_mult_expr(*rule.completed_from.data[1], file), -);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Additive expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Additive expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_shift_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_shift_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == SHIFT_EXPR_ADDITIVE) {
-        return eval_add_expr(*rule.completed_from.data[0]);
+        return eval_add_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == SHIFT_EXPR_LEFT) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_shift_expr(*rule.completed_from.data[0]), eval_add_expr(*rule.completed_from.data[1]), <<);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_shift_expr(*rule.completed_from.data[0], file), eval_add_expr(*rule.completed_from.data[1], file), <<);
     } else if (rule.rhs.tag == SHIFT_EXPR_RIGHT) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_shift_expr(*rule.completed_from.data[0]), eval_add_expr(*rule.completed_from.data[1]), >>);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_shift_expr(*rule.completed_from.data[0], file), eval_add_expr(*rule.completed_from.data[1], file), >>);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Shift expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Shift expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_rel_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_rel_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == RELATIONAL_EXPR_SHIFT) {
-        return eval_shift_expr(*rule.completed_from.data[0]);
+        return eval_shift_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == RELATIONAL_EXPR_LESS) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0]), eval_shift_expr(*rule.completed_from.data[1]), <);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0], file), eval_shift_expr(*rule.completed_from.data[1], file), <);
     } else if (rule.rhs.tag == RELATIONAL_EXPR_GREATER) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0]), eval_shift_expr(*rule.completed_from.data[1]), >);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0], file), eval_shift_expr(*rule.completed_from.data[1], file), >);
     } else if (rule.rhs.tag == RELATIONAL_EXPR_LEQ) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0]), eval_shift_expr(*rule.completed_from.data[1]), <=);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0], file), eval_shift_expr(*rule.completed_from.data[1], file), <=);
     } else if (rule.rhs.tag == RELATIONAL_EXPR_GEQ) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0]), eval_shift_expr(*rule.completed_from.data[1]), >=);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_rel_expr(*rule.completed_from.data[0], file), eval_shift_expr(*rule.completed_from.data[1], file), >=);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Relational expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Relational expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_eq_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_eq_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == EQUALITY_EXPR_RELATIONAL) {
-        return eval_rel_expr(*rule.completed_from.data[0]);
+        return eval_rel_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == EQUALITY_EXPR_EQUAL) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_eq_expr(*rule.completed_from.data[0]), eval_rel_expr(*rule.completed_from.data[1]), ==);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_eq_expr(*rule.completed_from.data[0], file), eval_rel_expr(*rule.completed_from.data[1], file), ==);
     } else if (rule.rhs.tag == EQUALITY_EXPR_NOT_EQUAL) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_eq_expr(*rule.completed_from.data[0]), eval_rel_expr(*rule.completed_from.data[1]), !=);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_eq_expr(*rule.completed_from.data[0], file), eval_rel_expr(*rule.completed_from.data[1], file), !=);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Equality expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Equality expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_and_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_and_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == AND_EXPR_EQUALITY) {
-        return eval_eq_expr(*rule.completed_from.data[0]);
+        return eval_eq_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == AND_EXPR_NORMAL) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_and_expr(*rule.completed_from.data[0]), eval_eq_expr(*rule.completed_from.data[1]), &);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_and_expr(*rule.completed_from.data[0], file), eval_eq_expr(*rule.completed_from.data[1], file), &);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "And expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "And expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_eor_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_eor_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == EXCLUSIVE_OR_EXPR_AND) {
-        return eval_and_expr(*rule.completed_from.data[0]);
+        return eval_and_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == EXCLUSIVE_OR_EXPR_NORMAL) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_eor_expr(*rule.completed_from.data[0]), eval_and_expr(*rule.completed_from.data[1]), ^);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_eor_expr(*rule.completed_from.data[0], file), eval_and_expr(*rule.completed_from.data[1], file), ^);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Exclusive or expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Exclusive or expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_ior_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_ior_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == INCLUSIVE_OR_EXPR_EXCLUSIVE_OR) {
-        return eval_eor_expr(*rule.completed_from.data[0]);
+        return eval_eor_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == INCLUSIVE_OR_EXPR_NORMAL) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_ior_expr(*rule.completed_from.data[0]), eval_eor_expr(*rule.completed_from.data[1]), |);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_ior_expr(*rule.completed_from.data[0], file), eval_eor_expr(*rule.completed_from.data[1], file), |);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Inclusive or expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Inclusive or expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_land_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_land_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == LOGICAL_AND_EXPR_INCLUSIVE_OR) {
-        return eval_ior_expr(*rule.completed_from.data[0]);
+        return eval_ior_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == LOGICAL_AND_EXPR_NORMAL) {
-        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_land_expr(*rule.completed_from.data[0]), eval_ior_expr(*rule.completed_from.data[1]), &&);
+        MSI_BINARY_OP_RETURN_SIGNED_RESULT(eval_land_expr(*rule.completed_from.data[0], file), eval_ior_expr(*rule.completed_from.data[1], file), &&);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Logical and expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Logical and expression tag is not recognized");
     }
 }
 
-static struct maybe_signed_intmax eval_lor_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_lor_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     if (rule.rhs.tag == LOGICAL_OR_EXPR_LOGICAL_AND) {
-        return eval_land_expr(*rule.completed_from.data[0]);
+        return eval_land_expr(*rule.completed_from.data[0], file);
     } else if (rule.rhs.tag == LOGICAL_OR_EXPR_NORMAL) {
-        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_lor_expr(*rule.completed_from.data[0]), eval_land_expr(*rule.completed_from.data[1]), ||);
+        MSI_BINARY_OP_RETURN_WITH_USUAL_CONVERSIONS(eval_lor_expr(*rule.completed_from.data[0], file), eval_land_expr(*rule.completed_from.data[1], file), ||);
     } else {
-        preprocessor_fatal_error(0, 0, 0, "Logical or expression tag is not recognized");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Logical or expression tag is not recognized");
     }
 }
 #pragma clang diagnostic pop
@@ -528,47 +536,47 @@ static bool msi_is_nonzero(const struct maybe_signed_intmax msi) {
     return (msi.is_signed && msi.val.signd != 0) || (!msi.is_signed && msi.val.unsignd != 0);
 }
 
-static struct maybe_signed_intmax eval_cond_expr(const struct earley_rule rule) {
+static struct maybe_signed_intmax eval_cond_expr(const struct earley_rule rule, const struct diagnostic_file *const file) {
     switch ((enum cond_expr_tag)rule.rhs.tag) {
         case COND_EXPR_LOGICAL_OR:
-            return eval_lor_expr(*rule.completed_from.data[0]);
+            return eval_lor_expr(*rule.completed_from.data[0], file);
         case COND_EXPR_NORMAL: {
-            const struct maybe_signed_intmax condition_result = eval_lor_expr(*rule.completed_from.data[0]);
+            const struct maybe_signed_intmax condition_result = eval_lor_expr(*rule.completed_from.data[0], file);
             if (msi_is_nonzero(condition_result)) {
-                return eval_expr(*rule.completed_from.data[1]);
+                return eval_expr(*rule.completed_from.data[1], file);
             } else {
-                return eval_cond_expr(*rule.completed_from.data[2]);
+                return eval_cond_expr(*rule.completed_from.data[2], file);
             }
         }
     }
 }
 
-static struct maybe_signed_intmax eval_int_const_expr(const struct earley_rule constant_expression_rule) {
-    return eval_cond_expr(*constant_expression_rule.completed_from.data[0]);
+static struct maybe_signed_intmax eval_int_const_expr(const struct earley_rule constant_expression_rule, const struct diagnostic_file *const file) {
+    return eval_cond_expr(*constant_expression_rule.completed_from.data[0], file);
 }
 
-static pp_token_harr replace_defineds(const pp_token_harr tokens, const sstr_macro_args_and_body_map macro_map) {
+static pp_token_harr replace_defineds(const pp_token_harr tokens, const ident_id_macro_args_and_body_map macro_map) {
     pp_token_vec out = pp_token_vec_new(tokens.len);
     ssize_t to_inc;
     for (ssize_t i = 0; i < tokens.len; i += to_inc) {
-        const sstr *macro_name = NULL;
+        ident_id macro_name = NO_IDENT;
         to_inc = 1;
         if (i <= tokens.len - 4
-            && token_is_str(tokens.data[i], "defined")
-            && token_is_str(tokens.data[i+1], "(")
+            && tokens.data[i].ident == IDENT_DEFINED
+            && tokens.data[i+1].kind == TOKEN_LEFT_PAREN
             && tokens.data[i+2].type == IDENTIFIER
-            && token_is_str(tokens.data[i+3], ")")) {
-                macro_name = &tokens.data[i+2].name;
+            && tokens.data[i+3].kind == TOKEN_RIGHT_PAREN) {
+                macro_name = tokens.data[i+2].ident;
                 to_inc = 4;
         } else if (i <= tokens.len - 2
-            && token_is_str(tokens.data[i], "defined")
+            && tokens.data[i].ident == IDENT_DEFINED
             && tokens.data[i+1].type == IDENTIFIER) {
-                macro_name = &tokens.data[i+1].name;
+                macro_name = tokens.data[i+1].ident;
                 to_inc = 2;
         }
 
-        if (macro_name) {
-            const bool macro_defined = sstr_macro_args_and_body_map_contains(&macro_map, *macro_name);
+        if (macro_name != NO_IDENT) {
+            const bool macro_defined = ident_id_macro_args_and_body_map_contains(&macro_map, macro_name);
             pp_token_vec_append(&out, (struct preprocessing_token) {
                 .after_whitespace = tokens.data[i].after_whitespace,
                 .type = PP_NUMBER,
@@ -581,25 +589,27 @@ static pp_token_harr replace_defineds(const pp_token_harr tokens, const sstr_mac
     return out.arr;
 }
 
-static bool check_condition_in_pp_tokens_rule(const struct earley_rule pp_tokens_rule, const sstr_macro_args_and_body_map macro_map) {
+static bool check_condition_in_pp_tokens_rule(const struct earley_rule pp_tokens_rule, const ident_id_macro_args_and_body_map macro_map, const struct diagnostic_file *const file) {
     const pp_token_harr expr_tokens = pp_tokens_rule_as_harr(pp_tokens_rule);
     const pp_token_harr expr_tokens_defineds_replaced = replace_defineds(expr_tokens, macro_map);
-    const struct earley_rule *expr_rule_macros_replaced = parse(replace_macros(expr_tokens_defineds_replaced, macro_map, EXCLUDE_HEADER_NAME), &tr_constant_expression);
+    const struct earley_rule *expr_rule_macros_replaced = parse(replace_macros(expr_tokens_defineds_replaced, macro_map, EXCLUDE_HEADER_NAME, file), &tr_constant_expression);
     if (expr_rule_macros_replaced == NULL) {
-        preprocessor_fatal_error(0, 0, 0, "Could not parse constant expression");
+        preprocessor_fatal_error(location_in(file, expr_tokens.data[0].name), "Could not parse constant expression");
+    }
+    if (TRACING(COND, TRACE_BASIC)) {
+        print_with_color(TEXT_COLOR_LIGHT_RED, "Constant expression tree:\n");
+        print_tree(expr_rule_macros_replaced, 0);
     }
-    print_with_color(TEXT_COLOR_LIGHT_RED, "Constant expression tree:\n");
-    print_tree(expr_rule_macros_replaced, 0);
-    const struct maybe_signed_intmax expr_val = eval_int_const_expr(*expr_rule_macros_replaced);
+    const struct maybe_signed_intmax expr_val = eval_int_const_expr(*expr_rule_macros_replaced, file);
     return msi_is_nonzero(expr_val);
 }
 
-struct earley_rule *eval_if_section(const struct earley_rule if_section_rule, const sstr_macro_args_and_body_map macro_map) {
+struct earley_rule *eval_if_section(const struct earley_rule if_section_rule, const ident_id_macro_args_and_body_map macro_map, const struct diagnostic_file *const file) {
     const struct earley_rule if_group_rule = *if_section_rule.completed_from.data[0];
     switch ((enum if_group_tag)if_group_rule.rhs.tag) {
         case IF_GROUP_IF: {
             const struct earley_rule pp_tokens_rule = *if_group_rule.completed_from.data[0];
-            if (check_condition_in_pp_tokens_rule(pp_tokens_rule, macro_map)) {
+            if (check_condition_in_pp_tokens_rule(pp_tokens_rule, macro_map, file)) {
                 struct earley_rule *group_opt_rule = if_group_rule.completed_from.data[1];
                 return group_opt_rule;
             }
@@ -608,8 +618,8 @@ struct earley_rule *eval_if_section(const struct earley_rule if_section_rule, co
         case IF_GROUP_IFDEF: {
             const struct earley_rule identifier_rule = *if_group_rule.completed_from.data[0];
             const struct symbol identifier_symbol = identifier_rule.rhs.symbols.data[0];
-            const sstr identifier_name = identifier_symbol.val.terminal.token.name;
-            if (sstr_macro_args_and_body_map_contains(&macro_map, identifier_name)) {
+            const ident_id identifier_name = identifier_symbol.val.terminal.token.ident;
+            if (ident_id_macro_args_and_body_map_contains(&macro_map, identifier_name)) {
                 struct earley_rule *group_opt_rule = if_group_rule.completed_from.data[1];
                 return group_opt_rule;
             }
@@ -618,8 +628,8 @@ struct earley_rule *eval_if_section(const struct earley_rule if_section_rule, co
         case IF_GROUP_IFNDEF: {
             const struct earley_rule identifier_rule = *if_group_rule.completed_from.data[0];
             const struct symbol identifier_symbol = identifier_rule.rhs.symbols.data[0];
-            const sstr identifier_name = identifier_symbol.val.terminal.token.name;
-            if (!sstr_macro_args_and_body_map_contains(&macro_map, identifier_name)) {
+            const ident_id identifier_name = identifier_symbol.val.terminal.token.ident;
+            if (!ident_id_macro_args_and_body_map_contains(&macro_map, identifier_name)) {
                 struct earley_rule *group_opt_rule = if_group_rule.completed_from.data[1];
                 return group_opt_rule;
             }
@@ -632,7 +642,7 @@ struct earley_rule *eval_if_section(const struct earley_rule if_section_rule, co
         for (size_t i = 0; i < elif_groups_rule.completed_from.len; i++) {
             const struct earley_rule elif_group_rule = *elif_groups_rule.completed_from.data[i];
             const struct earley_rule pp_tokens_rule = *elif_group_rule.completed_from.data[0];
-            if (check_condition_in_pp_tokens_rule(pp_tokens_rule, macro_map)) {
+            if (check_condition_in_pp_tokens_rule(pp_tokens_rule, macro_map, file)) {
                 struct earley_rule *group_opt_rule = elif_group_rule.completed_from.data[1];
                 return group_opt_rule;
             }
@@ -11,6 +11,7 @@ struct maybe_signed_intmax {
     } val;
     bool is_signed;
 };
-struct earley_rule *eval_if_section(struct earley_rule if_section_rule, sstr_macro_args_and_body_map macro_map);
+// Diagnostics point into file, which the section is from
+struct earley_rule *eval_if_section(struct earley_rule if_section_rule, ident_id_macro_args_and_body_map macro_map, const struct diagnostic_file *file);
 
 #endif //ICK_CONDITIONAL_INCLUSION_H
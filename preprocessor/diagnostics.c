@@ -1,56 +1,87 @@
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "diagnostics.h"
+#include "driver/diagnostics.h"
 
 #include <stdio.h>
 
-#include "data_structures/vector.h"
-
 #define VFPRINTF_VAARGS_FOLLOW(_stream, _fmt) \
     va_list args;                             \
     va_start(args, _fmt);                     \
     vfprintf(_stream, _fmt, args);            \
     va_end(args)
 
-static void preprocessor_message_prefix(FILE *stream, const size_t line, const size_t first_char, const size_t last_char) {
-    if (first_char == last_char) {
-        fprintf(stream, "%s (line %zu, char %zu): ", "insert filename here", line, first_char);
-    } else {
-        fprintf(stream, "%s (line %zu, chars %zu-%zu): ", "insert filename here", line, first_char, last_char);
-    }
+struct source_location location_in(const struct diagnostic_file *const file, const sstr span) {
+    return (struct source_location) { .file = file, .span = span };
 }
 
-__attribute__((noreturn))
-void preprocessor_fatal_error(const size_t line, const size_t first_char, const size_t last_char, const char *msg_fmt, ...) {
-    preprocessor_message_prefix(stderr, line, first_char, last_char);
-    fprintf(stderr, "fatal error: ");
-    VFPRINTF_VAARGS_FOLLOW(stderr, msg_fmt);
-    fprintf(stderr, "\n");
-    exit(1);
+struct source_location file_location(const struct diagnostic_file *const file) {
+    return (struct source_location) { .file = file, .span = { .data = NULL, .len = 0 } };
 }
 
-void preprocessor_error(const size_t line, const size_t first_char, const size_t last_char, const char *msg_fmt, ...) {
-    preprocessor_message_prefix(stderr, line, first_char, last_char);
-    fprintf(stderr, "error: ");
-    VFPRINTF_VAARGS_FOLLOW(stderr, msg_fmt);
-    fprintf(stderr, "\n");
+static bool span_is_in(const sstr span, const sstr text) {
+    const uintptr_t start = (uintptr_t)span.data, text_start = (uintptr_t)text.data;
+    return span.data != NULL && start >= text_start && start + span.len <= text_start + text.len;
 }
 
-void preprocessor_warning(const size_t line, const size_t first_char, const size_t last_char, const char *msg_fmt, ...) {
-    preprocessor_message_prefix(stderr, line, first_char, last_char);
-    fprintf(stderr, "warning: ");
-    VFPRINTF_VAARGS_FOLLOW(stderr, msg_fmt);
-    fprintf(stderr, "\n");
+// The 1-based line and column of a byte of the raw file
+static void raw_line_and_column(const sstr raw, const size_t raw_index, size_t *const line, size_t *const column) {
+    size_t line_start = 0;
+    *line = 1;
+    for (size_t i = 0; i < raw_index && i < raw.len; i++) {
+        if (raw.data[i] == '\n') {
+            (*line)++;
+            line_start = i + 1;
+        }
+    }
+    *column = raw_index - line_start + 1;
 }
 
-static size_t original_index(size_t index, const size_t_harr trigraph_indices, const size_t_harr escaped_newline_indices) {
-    // Get the index from before the escaped newlines were replaced
-    for (size_t i = 0; i < escaped_newline_indices.len; i++) {
-        if (escaped_newline_indices.data[i] <= index) index += 2;
+static void preprocessor_message_prefix(FILE *const stream, const struct source_location location) {
+    const struct diagnostic_file *const file = location.file;
+    if (file == NULL) {
+        fprintf(stream, "%s: ", ick_progname);
+        return;
+    }
+    if (!span_is_in(location.span, file->logical_lines)) {
+        fprintf(stream, "%s: ", file->fname);
+        return;
     }
-    // Get the index from before the trigraphs were replaced
-    for (size_t i = 0; i < trigraph_indices.len; i++) {
-        if (trigraph_indices.data[i] <= index) index += 2;
+    const size_t logical_start = (size_t)(location.span.data - file->logical_lines.data);
+    const size_t logical_last = location.span.len > 0 ? logical_start + location.span.len - 1 : logical_start;
+    size_t line, first_char, last_line, last_char;
+    raw_line_and_column(file->raw, source_map_raw_index(file->source_map, logical_start), &line, &first_char);
+    raw_line_and_column(file->raw, source_map_raw_index(file->source_map, logical_last), &last_line, &last_char);
+    if (last_line != line || last_char == first_char) {
+        fprintf(stream, "%s (line %zu, char %zu): ", file->fname, line, first_char);
+    } else {
+        fprintf(stream, "%s (line %zu, chars %zu-%zu): ", file->fname, line, first_char, last_char);
     }
-    return index;
+}
+
+__attribute__((noreturn))
+void preprocessor_fatal_error(const struct source_location location, const char *msg_fmt, ...) {
+    FILE *const stream = diagnostic_stream();
+    preprocessor_message_prefix(stream, location);
+    fprintf(stream, "fatal error: ");
+    VFPRINTF_VAARGS_FOLLOW(stream, msg_fmt);
+    fprintf(stream, "\n");
+    end_after_fatal_error();
+}
+
+void preprocessor_error(const struct source_location location, const char *msg_fmt, ...) {
+    FILE *const stream = diagnostic_stream();
+    preprocessor_message_prefix(stream, location);
+    fprintf(stream, "error: ");
+    VFPRINTF_VAARGS_FOLLOW(stream, msg_fmt);
+    fprintf(stream, "\n");
+}
+
+void preprocessor_warning(const struct source_location location, const char *msg_fmt, ...) {
+    FILE *const stream = diagnostic_stream();
+    preprocessor_message_prefix(stream, location);
+    fprintf(stream, "warning: ");
+    VFPRINTF_VAARGS_FOLLOW(stream, msg_fmt);
+    fprintf(stream, "\n");
 }
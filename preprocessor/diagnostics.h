@@ -2,13 +2,42 @@
 #define TEST_DIAGNOSTICS_H
 
 #include <stddef.h>
+#include "source_map.h"
+#include "data_structures/sstr.h"
 
-__attribute__((format(printf, 4, 5), noreturn))
-void preprocessor_fatal_error(size_t line, size_t first_char, size_t last_char, const char *msg_fmt, ...);
-__attribute__((format(printf, 4, 5)))
-void preprocessor_error(size_t line, size_t first_char, size_t last_char, const char *msg_fmt, ...);
-__attribute__((format(printf, 4, 5)))
-void preprocessor_warning(size_t line, size_t first_char, size_t last_char, const char *msg_fmt, ...);
+/*
+ * A file that diagnostics can point into. Places are found in its logical lines (the output of phase 2), and the source
+ * map takes them back to the raw contents, where lines and columns are counted.
+ */
+struct diagnostic_file {
+    const char *fname;
+    sstr raw;
+    sstr logical_lines;
+    struct source_map source_map;
+};
+
+/*
+ * What a diagnostic is about: the part of the file's logical lines that span is a slice of (usually a token's name).
+ * If span isn't part of them (e.g. it's from the body of a macro defined in another file), only the file is reported,
+ * and if file is NULL, neither is.
+ */
+struct source_location {
+    const struct diagnostic_file *file;
+    sstr span;
+};
+
+#define NO_SOURCE_LOCATION ((struct source_location) { .file = NULL, .span = { .data = NULL, .len = 0 } })
+
+struct source_location location_in(const struct diagnostic_file *file, sstr span);
+// The file as a whole
+struct source_location file_location(const struct diagnostic_file *file);
+
+__attribute__((format(printf, 2, 3), noreturn))
+void preprocessor_fatal_error(struct source_location location, const char *msg_fmt, ...);
+__attribute__((format(printf, 2, 3)))
+void preprocessor_error(struct source_location location, const char *msg_fmt, ...);
+__attribute__((format(printf, 2, 3)))
+void preprocessor_warning(struct source_location location, const char *msg_fmt, ...);
 
 
 #endif //TEST_DIAGNOSTICS_H
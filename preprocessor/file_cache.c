@@ -0,0 +1,249 @@
+#include "file_cache.h"
+#include "diagnostics.h"
+#include "phases_1_2.h"
+#include "token_cache.h"
+#include "data_structures/map.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool is_blank_line(const struct earley_rule *const group_part_rule) {
+    if (group_part_rule->rhs.tag != GROUP_PART_TEXT) return false;
+    const struct earley_rule *const text_line_rule = group_part_rule->completed_from.data[0];
+    return text_line_rule->completed_from.data[0]->rhs.tag == OPT_NONE;
+}
+
+static ident_id find_include_guard(const struct earley_rule *const group_opt_rule) {
+    const ident_id no_guard = NO_IDENT;
+    if (group_opt_rule->rhs.tag == OPT_NONE) return no_guard;
+    const struct earley_rule *const group_rule = group_opt_rule->completed_from.data[0];
+    const struct earley_rule *if_section_rule = NULL;
+    for (size_t i = 0; i < group_rule->completed_from.len; i++) {
+        const struct earley_rule *const group_part_rule = group_rule->completed_from.data[i];
+        if (is_blank_line(group_part_rule)) continue;
+        if (group_part_rule->rhs.tag != GROUP_PART_IF || if_section_rule != NULL) return no_guard;
+        if_section_rule = group_part_rule->completed_from.data[0];
+    }
+    if (if_section_rule == NULL) return no_guard;
+    const struct earley_rule *const if_group_rule = if_section_rule->completed_from.data[0];
+    const struct earley_rule *const elif_groups_opt_rule = if_section_rule->completed_from.data[1];
+    const struct earley_rule *const else_group_opt_rule = if_section_rule->completed_from.data[2];
+    if (if_group_rule->rhs.tag != IF_GROUP_IFNDEF || elif_groups_opt_rule->rhs.tag != OPT_NONE || else_group_opt_rule->rhs.tag != OPT_NONE) {
+        return no_guard;
+    }
+    const struct earley_rule *const identifier_rule = if_group_rule->completed_from.data[0];
+    return identifier_rule->rhs.symbols.data[0].val.terminal.token.ident;
+}
+
+struct lexed_source lex_source(const sstr contents) {
+    const struct phases_1_2_info logical_lines = apply_phases_1_2(contents);
+    return (struct lexed_source) {
+        .logical_lines = logical_lines.result,
+        .source_map = logical_lines.map,
+        .tokens = get_pp_tokens(logical_lines.result, false, DISCARD_COMMENTS),
+        .cache_entry = { .data = NULL, .len = 0 }
+    };
+}
+
+bool try_parse_lexed_source(const struct lexed_source lexed, struct parsed_file *const out) {
+    erule_p_harr_p_harr charts;
+    const struct earley_rule *const parse_root = parse_full_file(&lexed.tokens, &charts);
+    if (parse_root == NULL) {
+        free_charts(charts);
+        return false;
+    }
+    *out = (struct parsed_file) {
+        .logical_lines = lexed.logical_lines,
+        .source_map = lexed.source_map,
+        .tokens = lexed.tokens,
+        .cache_entry = lexed.cache_entry,
+        .charts = charts,
+        .group_opt_rule = parse_root->completed_from.data[0],
+        .include_guard = find_include_guard(parse_root->completed_from.data[0])
+    };
+    return true;
+}
+
+void parsed_file_free_internals(const struct parsed_file *const parsed, const sstr contents) {
+    free_charts(parsed->charts);
+    const struct lexed_source lexed = {
+        .logical_lines = parsed->logical_lines,
+        .source_map = parsed->source_map,
+        .tokens = parsed->tokens,
+        .cache_entry = parsed->cache_entry
+    };
+    lexed_source_free_internals(&lexed, contents);
+}
+
+struct parsed_file parse_source(const char *const fname, const sstr contents, const bool use_token_cache) {
+    struct lexed_source lexed;
+    if (!use_token_cache || !token_cache_enabled()) {
+        lexed = lex_source(contents);
+    } else {
+        const struct token_cache_key key = token_cache_key(contents);
+        if (!token_cache_lookup(key, &lexed)) {
+            lexed = lex_source(contents);
+            token_cache_store(key, lexed);
+        }
+    }
+    struct parsed_file parsed;
+    if (!try_parse_lexed_source(lexed, &parsed)) {
+        // A file that doesn't parse has tokens, since an empty one does
+        const struct diagnostic_file file = {
+            .fname = fname, .raw = contents, .logical_lines = lexed.logical_lines, .source_map = lexed.source_map
+        };
+        const struct preprocessing_token stuck_at = token_stream_get(&lexed.tokens, find_parse_failure(&lexed.tokens));
+        preprocessor_fatal_error(location_in(&file, stuck_at.name), "Parsing failed");
+    }
+    return parsed;
+}
+
+size_t hash_file_id(const file_id id, const size_t n_buckets) {
+    return ((size_t)id.ino * 31 + (size_t)id.dev) % n_buckets;
+}
+
+bool file_ids_eq(const file_id id1, const file_id id2) {
+    return id1.dev == id2.dev && id1.ino == id2.ino;
+}
+
+typedef struct cache_slot {
+    struct timespec mtime;
+    off_t size;
+    struct cached_file *file;
+} cache_slot;
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(file_id, cache_slot, hash_file_id, file_ids_eq)
+
+// Files that are no longer in the cache, but are still being used
+typedef struct cached_file *dropped_file;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(dropped_file)
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static file_id_cache_slot_map cache;
+static bool cache_initialized = false;
+static dropped_file_vec dropped_files;
+static struct file_cache_stats stats = { .hits = 0, .misses = 0 };
+
+// Must be called with cache_lock held
+static void initialize_cache(void) {
+    if (!cache_initialized) {
+        cache = file_id_cache_slot_map_new(64);
+        dropped_files = dropped_file_vec_new(0);
+        cache_initialized = true;
+    }
+}
+
+static void free_cached_file(struct cached_file *const file) {
+    parsed_file_free_internals(&file->parsed, file->buffer.contents);
+    close_source_buffer(&file->buffer);
+    FREE(file);
+}
+
+// Looks the file up, and counts the lookup as a hit or miss. Returns NULL on a miss.
+static const struct cached_file *lookup(const file_id id, const struct stat *const st) {
+    pthread_mutex_lock(&cache_lock);
+    initialize_cache();
+    struct cached_file *file = NULL;
+    if (file_id_cache_slot_map_contains(&cache, id)) {
+        const cache_slot slot = file_id_cache_slot_map_get(&cache, id);
+        if (slot.size == st->st_size && slot.mtime.tv_sec == st->st_mtim.tv_sec && slot.mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            file = slot.file;
+            file->n_users++;
+        }
+    }
+    if (file != NULL) stats.hits++;
+    else stats.misses++;
+    pthread_mutex_unlock(&cache_lock);
+    return file;
+}
+
+// Adds a file that the caller is using
+static void insert(const file_id id, const cache_slot slot) {
+    pthread_mutex_lock(&cache_lock);
+    initialize_cache();
+    slot.file->n_users = 1;
+    // If the file changed, the stale entry is replaced. It's only freed if no translation unit is using it.
+    // If another thread parsed the same file at the same time, the later parse wins.
+    struct cached_file *stale = NULL;
+    if (file_id_cache_slot_map_contains(&cache, id)) {
+        stale = file_id_cache_slot_map_get(&cache, id).file;
+        file_id_cache_slot_map_remove(&cache, id);
+        if (stale->n_users > 0) {
+            dropped_file_vec_append(&dropped_files, stale);
+            stale = NULL;
+        }
+    }
+    file_id_cache_slot_map_add(&cache, id, slot);
+    pthread_mutex_unlock(&cache_lock);
+    if (stale != NULL) free_cached_file(stale);
+}
+
+// Adds a file that never goes in the cache, so it's freed as soon as it's released
+static void insert_dropped(struct cached_file *const file) {
+    pthread_mutex_lock(&cache_lock);
+    initialize_cache();
+    file->n_users = 1;
+    dropped_file_vec_append(&dropped_files, file);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void file_cache_release(const struct cached_file *const file) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached_file *unused = NULL;
+    struct cached_file *const current = file_id_cache_slot_map_contains(&cache, file->id) ? file_id_cache_slot_map_get(&cache, file->id).file : NULL;
+    if (current == file) {
+        current->n_users--;
+    } else {
+        for (size_t i = 0; i < dropped_files.arr.len; i++) {
+            struct cached_file *const dropped = dropped_files.arr.data[i];
+            if (dropped != file) continue;
+            dropped->n_users--;
+            if (dropped->n_users == 0) {
+                dropped_files.arr.data[i] = dropped_files.arr.data[dropped_files.arr.len - 1];
+                dropped_files.arr.len--;
+                unused = dropped;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    if (unused != NULL) free_cached_file(unused);
+}
+
+const struct cached_file *file_cache_get(const char *const fname) {
+    struct stat st;
+    // A hit costs one stat; the file is only opened if it has to be read
+    if (stat(fname, &st) == 0 && S_ISREG(st.st_mode)) {
+        const struct cached_file *const cached = lookup((file_id) { .dev = st.st_dev, .ino = st.st_ino }, &st);
+        if (cached != NULL) return cached;
+    }
+    const int fd = open(fname, O_RDONLY);
+    if (fd == -1) return NULL;
+    // The file could have been replaced since the stat, so what's cached is keyed on the file that was opened
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // Only regular files have an identity that's worth caching
+        struct cached_file *const file = MALLOC(sizeof(struct cached_file));
+        file->id = (file_id) { .dev = 0, .ino = 0 };
+        file->buffer = read_source_buffer_fd(fd);
+        close(fd);
+        file->parsed = parse_source(fname, file->buffer.contents, true);
+        insert_dropped(file);
+        return file;
+    }
+    const file_id id = { .dev = st.st_dev, .ino = st.st_ino };
+    struct cached_file *const file = MALLOC(sizeof(struct cached_file));
+    file->id = id;
+    file->buffer = read_source_buffer_fd(fd);
+    close(fd);
+    file->parsed = parse_source(fname, file->buffer.contents, true);
+    insert(id, (cache_slot) { .mtime = st.st_mtim, .size = st.st_size, .file = file });
+    return file;
+}
+
+struct file_cache_stats file_cache_get_stats(void) {
+    pthread_mutex_lock(&cache_lock);
+    const struct file_cache_stats current = stats;
+    pthread_mutex_unlock(&cache_lock);
+    return current;
+}
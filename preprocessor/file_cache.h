@@ -0,0 +1,88 @@
+#ifndef ICK_FILE_CACHE_H
+#define ICK_FILE_CACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "parser.h"
+#include "pp_token.h"
+#include "source_map.h"
+#include "token_cache.h"
+#include "driver/source_buffer.h"
+
+/*
+ * A source file after translation phases 1-3 and parsing, ready for directives to be executed.
+ */
+struct parsed_file {
+    sstr logical_lines; // the output of phase 2
+    struct source_map source_map;
+    struct token_stream tokens; // of logical_lines
+    sstr cache_entry; // the token cache entry the above point into, as in struct lexed_source
+    erule_p_harr_p_harr charts; // the Earley charts, which own group_opt_rule and everything under it
+    const struct earley_rule *group_opt_rule;
+    // If the whole file is wrapped in #ifndef X ... #endif with no #elif or #else, this is X; otherwise it's NO_IDENT
+    ident_id include_guard;
+};
+
+/*
+ * Runs phases 1-3 on contents, which were read from fname, and parses the result. If use_token_cache is true and the
+ * token cache is on, phases 1-3 are skipped when the cache already has the tokens for these exact contents.
+ */
+struct parsed_file parse_source(const char *fname, sstr contents, bool use_token_cache);
+
+// Runs phases 1-3 on contents, without the token cache
+struct lexed_source lex_source(sstr contents);
+
+/*
+ * Parses the output of phase 3. Returns false if it doesn't parse.
+ */
+bool try_parse_lexed_source(struct lexed_source lexed, struct parsed_file *out);
+
+/*
+ * Frees parsed, which was parsed from contents. contents isn't freed.
+ */
+void parsed_file_free_internals(const struct parsed_file *parsed, sstr contents);
+
+typedef struct file_id {
+    dev_t dev;
+    ino_t ino;
+} file_id;
+
+size_t hash_file_id(file_id id, size_t n_buckets);
+bool file_ids_eq(file_id id1, file_id id2);
+
+/*
+ * A file's contents and parse tree, shared by every inclusion of it in every translation unit.
+ * Cached files are never modified, so they can be used from any thread. A file is freed once it's been replaced in the
+ * cache and no translation unit is using it anymore.
+ */
+struct cached_file {
+    file_id id; // all zeros for files that aren't regular files
+    struct source_buffer buffer;
+    struct parsed_file parsed;
+    size_t n_users; // how many file_cache_get results haven't been released; only used with the cache locked
+};
+typedef const struct cached_file *cached_file_p;
+
+/*
+ * Returns the cached parse of fname, parsing it first if it isn't cached yet or if it's changed since it was cached.
+ * Files are identified by device and inode, so different paths to the same file share an entry;
+ * a change is detected from the modification time and size.
+ * Returns NULL if fname can't be opened. Otherwise, the result must be released with file_cache_release once it's no
+ * longer used.
+ */
+const struct cached_file *file_cache_get(const char *fname);
+
+/*
+ * Says that a result of file_cache_get is no longer used. It's freed if it's been replaced in the cache and nothing else
+ * is using it.
+ */
+void file_cache_release(const struct cached_file *file);
+
+struct file_cache_stats {
+    size_t hits;
+    size_t misses;
+};
+
+struct file_cache_stats file_cache_get_stats(void);
+
+#endif //ICK_FILE_CACHE_H
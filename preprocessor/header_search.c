@@ -0,0 +1,211 @@
+#include "header_search.h"
+#include "data_structures/map.h"
+#include "debug/malloc.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct dir_entry {
+    unsigned char type; // DT_REG, DT_DIR, etc., as given by readdir
+} dir_entry;
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(char_p, dir_entry, hash_cstr, cstrs_eq)
+
+struct dir_listing {
+    bool exists;
+    dev_t dev;
+    struct timespec mtime;
+    size_t generation; // the generation the listing was last known to be current in; only used with listings_lock held
+    char_p_dir_entry_map entries;
+};
+typedef struct dir_listing *dir_listing_p;
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(char_p, dir_listing_p, hash_cstr, cstrs_eq)
+
+// Listings are never modified after they're added, so they can be read without holding the lock
+static pthread_mutex_t listings_lock = PTHREAD_MUTEX_INITIALIZER;
+static char_p_dir_listing_p_map listings;
+static bool listings_initialized = false;
+static size_t generation = 0;
+static struct header_search_stats stats = { .lookups = 0, .negative_lookups = 0, .directory_reads = 0, .stat_calls = 0 };
+
+static char *copy_cstr(const char *const str, const size_t len) {
+    char *const copy = MALLOC(len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Must be called with listings_lock held
+static dir_listing_p read_dir_listing(const char *const dir) {
+    dir_listing_p listing = MALLOC(sizeof(struct dir_listing));
+    listing->exists = false;
+    listing->generation = generation;
+    listing->entries = char_p_dir_entry_map_new(0);
+    stats.directory_reads++;
+    DIR *const dir_stream = opendir(dir);
+    if (dir_stream == NULL) return listing;
+    struct stat st;
+    stats.stat_calls++;
+    if (fstat(dirfd(dir_stream), &st) != 0) {
+        closedir(dir_stream);
+        return listing;
+    }
+    listing->exists = true;
+    listing->dev = st.st_dev;
+    listing->mtime = st.st_mtim;
+    const struct dirent *entry;
+    while ((entry = readdir(dir_stream)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char *const name = copy_cstr(entry->d_name, strlen(entry->d_name));
+        char_p_dir_entry_map_add(&listing->entries, name, (dir_entry) { .type = entry->d_type });
+    }
+    closedir(dir_stream);
+    return listing;
+}
+
+// Must be called with listings_lock held. Adding, removing, or renaming an entry changes a directory's mtime.
+static bool listing_is_current(const struct dir_listing *const listing, const char *const dir) {
+    struct stat st;
+    stats.stat_calls++;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return !listing->exists;
+    return listing->exists && listing->dev == st.st_dev
+        && listing->mtime.tv_sec == st.st_mtim.tv_sec && listing->mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static dir_listing_p get_dir_listing(const char *const dir, const size_t dir_len) {
+    char *const dir_copy = copy_cstr(dir, dir_len);
+    pthread_mutex_lock(&listings_lock);
+    if (!listings_initialized) {
+        listings = char_p_dir_listing_p_map_new(64);
+        listings_initialized = true;
+    }
+    stats.lookups++;
+    dir_listing_p listing;
+    if (char_p_dir_listing_p_map_contains(&listings, dir_copy)) {
+        listing = char_p_dir_listing_p_map_get(&listings, dir_copy);
+        if (listing->generation != generation && !listing_is_current(listing, dir_copy)) {
+            // The old listing is left alone (and leaked), since other threads might still be reading it
+            listing = read_dir_listing(dir_copy);
+            char_p_dir_listing_p_map_remove(&listings, dir_copy);
+            char_p_dir_listing_p_map_add(&listings, dir_copy, listing);
+        } else {
+            listing->generation = generation;
+            FREE(dir_copy);
+        }
+    } else {
+        listing = read_dir_listing(dir_copy);
+        char_p_dir_listing_p_map_add(&listings, dir_copy, listing);
+    }
+    pthread_mutex_unlock(&listings_lock);
+    return listing;
+}
+
+static void count_negative_lookup(void) {
+    pthread_mutex_lock(&listings_lock);
+    stats.negative_lookups++;
+    pthread_mutex_unlock(&listings_lock);
+}
+
+// Checks whether there's a (non-directory) file at path, using the listing of its directory. Takes ownership of path.
+static struct header_search_result look_up_path(char *const path) {
+    const struct header_search_result not_found = { .path = NULL, .is_system_header = false };
+    const char *const last_slash = strrchr(path, '/');
+    dir_listing_p listing;
+    const char *basename;
+    if (last_slash == NULL) {
+        listing = get_dir_listing(".", 1);
+        basename = path;
+    } else {
+        // The directory of "/name" is "/", not ""
+        listing = get_dir_listing(path, last_slash == path ? 1 : (size_t)(last_slash - path));
+        basename = last_slash + 1;
+    }
+    // basename can't be cast back to non-const, but the map only reads keys
+    char *const key = (char *)(uintptr_t)basename;
+    if (!listing->exists || !char_p_dir_entry_map_contains(&listing->entries, key)) {
+        count_negative_lookup();
+        FREE(path);
+        return not_found;
+    }
+    const dir_entry entry = char_p_dir_entry_map_get(&listing->entries, key);
+    if (entry.type == DT_DIR) {
+        count_negative_lookup();
+        FREE(path);
+        return not_found;
+    }
+    if (entry.type != DT_REG) {
+        // Symlinks need to be followed, and some file systems don't report entry types
+        struct stat st;
+        pthread_mutex_lock(&listings_lock);
+        stats.stat_calls++;
+        pthread_mutex_unlock(&listings_lock);
+        if (stat(path, &st) != 0 || S_ISDIR(st.st_mode)) {
+            count_negative_lookup();
+            FREE(path);
+            return not_found;
+        }
+    }
+    return (struct header_search_result) { .path = path, .is_system_header = false };
+}
+
+static char *join_path(const char *const dir, const size_t dir_len, const char *const name) {
+    const size_t name_len = strlen(name);
+    char *const path = MALLOC(dir_len + 1 + name_len + 1);
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(&path[dir_len + 1], name, name_len + 1);
+    return path;
+}
+
+static struct header_search_result search_dirs(const char_p_harr dirs, const char *const name) {
+    for (size_t i = 0; i < dirs.len; i++) {
+        const struct header_search_result result = look_up_path(join_path(dirs.data[i], strlen(dirs.data[i]), name));
+        if (result.path != NULL) return result;
+    }
+    return (struct header_search_result) { .path = NULL, .is_system_header = false };
+}
+
+struct header_search_result find_header(const struct include_search_path *const search_path, const char *const includer_fname,
+                                        const char *const name, const bool quoted) {
+    if (name[0] == '/') {
+        return look_up_path(copy_cstr(name, strlen(name)));
+    }
+    struct header_search_result result;
+    if (quoted) {
+        if (includer_fname != NULL) {
+            // An includer without a slash in its name is in the working directory
+            const char *const last_slash = strrchr(includer_fname, '/');
+            result = last_slash == NULL
+                ? look_up_path(copy_cstr(name, strlen(name)))
+                : look_up_path(join_path(includer_fname, (size_t)(last_slash - includer_fname), name));
+            if (result.path != NULL) return result;
+        }
+        result = search_dirs(search_path->quote_dirs, name);
+        if (result.path != NULL) return result;
+    }
+    result = search_dirs(search_path->dirs, name);
+    if (result.path != NULL) return result;
+    result = search_dirs(search_path->system_dirs, name);
+    if (result.path != NULL) {
+        result.is_system_header = true;
+        return result;
+    }
+    return look_up_path(copy_cstr(name, strlen(name)));
+}
+
+void header_search_revalidate(void) {
+    pthread_mutex_lock(&listings_lock);
+    generation++;
+    pthread_mutex_unlock(&listings_lock);
+}
+
+struct header_search_stats header_search_get_stats(void) {
+    pthread_mutex_lock(&listings_lock);
+    const struct header_search_stats current = stats;
+    pthread_mutex_unlock(&listings_lock);
+    return current;
+}
@@ -0,0 +1,67 @@
+#ifndef ICK_HEADER_SEARCH_H
+#define ICK_HEADER_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "file_cache.h"
+#include "data_structures/vector.h"
+
+__attribute__((unused))
+static size_t hash_cstr(const char_p str, const size_t n_buckets) {
+    size_t hash = 5381;
+    for (const char *p = str; *p != '\0'; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % n_buckets;
+}
+
+__attribute__((unused))
+static bool cstrs_eq(const char_p str1, const char_p str2) {
+    return strcmp(str1, str2) == 0;
+}
+
+/*
+ * Where #include looks for files, in the order the directories were given.
+ * "quoted" names are searched for in the including file's directory, then quote_dirs, then dirs, then system_dirs;
+ * <angled> names skip the first two.
+ */
+struct include_search_path {
+    char_p_harr quote_dirs; // -iquote
+    char_p_harr dirs; // -I
+    char_p_harr system_dirs; // -isystem
+};
+
+struct header_search_result {
+    char *path; // malloc'd; NULL if the file wasn't found
+    bool is_system_header; // found in one of the -isystem directories
+};
+
+/*
+ * Finds the file named by an #include directive. includer_fname is the file containing the directive, or NULL.
+ * Absolute names are used as-is, and if a relative name isn't found in any search directory, it's looked up relative
+ * to the working directory.
+ *
+ * Every directory is read once, the first time anything is looked up in it, and its entries are kept in a hash table
+ * shared by all threads; after that, looking up a file that doesn't exist costs no system calls at all.
+ * Listings aren't refreshed until header_search_revalidate is called, so until then, files created in a directory
+ * after it's been read aren't found.
+ */
+struct header_search_result find_header(const struct include_search_path *search_path, const char *includer_fname, const char *name, bool quoted);
+
+/*
+ * Makes the next lookup in each directory check whether the directory has changed (by its mtime) since it was read,
+ * and read it again if it has. For long-running processes, which can't assume the file system stays put.
+ */
+void header_search_revalidate(void);
+
+struct header_search_stats {
+    size_t lookups; // candidate paths checked
+    size_t negative_lookups; // candidate paths that didn't exist
+    size_t directory_reads; // opendir/readdir passes
+    size_t stat_calls; // for directories, and for symlinks and entries whose type readdir didn't give
+};
+
+struct header_search_stats header_search_get_stats(void);
+
+#endif //ICK_HEADER_SEARCH_H
@@ -0,0 +1,453 @@
+#include "incremental.h"
+#include "diagnostics.h"
+#include "debug/malloc.h"
+#include "driver/diagnostics.h"
+#include <string.h>
+
+// The state before a top-level group part, from which preprocessing can resume
+typedef struct checkpoint {
+    size_t part_index;
+    size_t n_changes; // how many of the session's changes had been made
+    size_t n_output_tokens;
+    uint64_t state_fingerprint;
+    bool at_start_of_included_file;
+} checkpoint;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(checkpoint)
+
+struct incremental_session {
+    uchar_vec text; // the last text that parsed, which everything below is for
+    bool parse_failed; // if true, the text has been edited since, and unparsed_text doesn't parse
+    uchar_vec unparsed_text;
+    struct preprocessor_context ctx;
+    erule_p_vec parts; // the top-level group parts of the text
+    size_t_vec part_ends; // where each part ends in the text; each part starts where the one before it ends, and any text
+                          // after the last one has no tokens
+    checkpoint_vec checkpoints; // one before every part that starts a text section, in order
+    state_change_vec changes; // every change made by the main file, in order
+    pp_token_vec output;
+    struct incremental_stats last_stats;
+};
+
+// The previous run's checkpoints, which a new run can stop at. Previous part index p is now p - last + undamaged_start.
+struct previous_run {
+    checkpoint_harr checkpoints;
+    size_t last; // the first part after the damage, as the previous run numbered it
+    size_t undamaged_start; // the same part, as it's numbered now
+};
+
+static size_t part_start(const struct incremental_session *const session, const size_t part_index) {
+    return part_index == 0 ? 0 : session->part_ends.arr.data[part_index - 1];
+}
+
+// Text sections are expanded as a whole, so preprocessing can only stop and resume before a part that isn't a text line
+static bool starts_segment(const erule_p_harr parts, const size_t part_index) {
+    return part_index == 0 || parts.data[part_index]->rhs.tag != GROUP_PART_TEXT;
+}
+
+static size_t count_tokens(const struct earley_rule *const rule) {
+    size_t n_tokens = 0;
+    for (size_t i = 0; i < rule->rhs.symbols.len; i++) {
+        if (rule->rhs.symbols.data[i].is_terminal) n_tokens++;
+    }
+    for (size_t i = 0; i < rule->completed_from.len; i++) {
+        n_tokens += count_tokens(rule->completed_from.data[i]);
+    }
+    return n_tokens;
+}
+
+/*
+ * Appends the top-level group parts of parsed, which is the parse of the len bytes of text starting at offset,
+ * and where each of them ends in the text. Text without any tokens has no group parts, so if it's at the end of the
+ * file, it isn't covered by any part.
+ */
+static void append_parts(const struct parsed_file parsed, const size_t offset, const size_t len, erule_p_vec *const parts, size_t_vec *const part_ends) {
+    if (parsed.group_opt_rule->rhs.tag == OPT_NONE) return;
+    const erule_p_harr group_parts = parsed.group_opt_rule->completed_from.data[0]->completed_from;
+    size_t n_tokens = 0;
+    for (size_t i = 0; i < group_parts.len; i++) {
+        erule_p_vec_append(parts, group_parts.data[i]);
+        n_tokens += count_tokens(group_parts.data[i]);
+        // Every group part ends with a newline, and the next one starts right after it. The last one gets the rest.
+        size_t end = offset + len;
+        if (i + 1 < group_parts.len) {
+            const size_t newline_offset = token_stream_offset(&parsed.tokens, (token_handle)(n_tokens - 1));
+            end = offset + source_map_raw_index(parsed.source_map, newline_offset) + 1;
+        }
+        size_t_vec_append(part_ends, end);
+    }
+}
+
+// Whether lexing text[start, end) by itself gives the same tokens as lexing it as part of the text
+static bool lexes_on_its_own(const sstr text, const size_t start, const size_t end, const struct parsed_file parsed) {
+    if (end == text.len || end == start) return true;
+    // It has to end at the end of a line, and that line can't be spliced onto the next one
+    if (text.data[end - 1] != '\n') return false;
+    if (end - start >= 2 && text.data[end - 2] == '\\') return false;
+    if (end - start >= 4 && memcmp(&text.data[end - 4], "?\?/", 3) == 0) return false;
+    // An unterminated comment swallows the rest of the input, including the last newline
+    const struct token_stream *const tokens = &parsed.tokens;
+    const token_handle last = (token_handle)(tokens->len - 1);
+    return tokens->len > 0 && token_stream_offset(tokens, last) == parsed.logical_lines.len - 1
+        && token_stream_kind(tokens, last) == TOKEN_NEWLINE;
+}
+
+static void undo_change(struct preprocessor_context *const ctx, const state_change change) {
+    switch (change.kind) {
+        case STATE_CHANGE_DEFINE:
+            ident_id_macro_args_and_body_map_remove(&ctx->macro_map, change.macro_name);
+            break;
+        case STATE_CHANGE_UNDEF:
+            ident_id_macro_args_and_body_map_add(&ctx->macro_map, change.macro_name, change.macro);
+            break;
+        case STATE_CHANGE_PRAGMA_ONCE:
+            file_id_cached_file_p_map_remove(&ctx->pragma_once_files, change.file->id);
+            break;
+    }
+    ctx->state_fingerprint ^= state_change_hash(change);
+}
+
+static void redo_change(struct preprocessor_context *const ctx, const state_change change) {
+    switch (change.kind) {
+        case STATE_CHANGE_DEFINE:
+            ident_id_macro_args_and_body_map_add(&ctx->macro_map, change.macro_name, change.macro);
+            break;
+        case STATE_CHANGE_UNDEF:
+            ident_id_macro_args_and_body_map_remove(&ctx->macro_map, change.macro_name);
+            break;
+        case STATE_CHANGE_PRAGMA_ONCE:
+            file_id_cached_file_p_map_add(&ctx->pragma_once_files, change.file->id, change.file);
+            break;
+    }
+    ctx->state_fingerprint ^= state_change_hash(change);
+}
+
+/*
+ * Executes the parts from resume (which starts a segment) on, one segment at a time, adding a checkpoint before each
+ * segment. base is the checkpoint at resume; the context's changes and output are counted from there.
+ * Stops before the first undamaged segment whose state matches the previous run's checkpoint there, and returns the
+ * index of that checkpoint in previous, or previous.checkpoints.len if it runs to the end.
+ */
+static size_t run_segments(struct incremental_session *const session, const checkpoint base, const struct previous_run previous, size_t *const n_parts_run) {
+    struct preprocessor_context *const ctx = &session->ctx;
+    const erule_p_harr parts = session->parts.arr;
+    size_t candidate = 0;
+    while (candidate < previous.checkpoints.len && previous.checkpoints.data[candidate].part_index < previous.last) candidate++;
+    *n_parts_run = 0;
+    for (size_t i = base.part_index; i < parts.len;) {
+        if (i >= previous.undamaged_start) {
+            while (candidate < previous.checkpoints.len
+                   && previous.checkpoints.data[candidate].part_index - previous.last + previous.undamaged_start < i) {
+                candidate++;
+            }
+            if (candidate < previous.checkpoints.len) {
+                const checkpoint old = previous.checkpoints.data[candidate];
+                if (old.part_index - previous.last + previous.undamaged_start == i && old.state_fingerprint == ctx->state_fingerprint
+                    && old.at_start_of_included_file == ctx->at_start_of_included_file) {
+                    return candidate;
+                }
+            }
+        }
+        checkpoint_vec_append(&session->checkpoints, (checkpoint) {
+            .part_index = i,
+            .n_changes = base.n_changes + ctx->changes->arr.len,
+            .n_output_tokens = base.n_output_tokens + ctx->token_collector->arr.len,
+            .state_fingerprint = ctx->state_fingerprint,
+            .at_start_of_included_file = ctx->at_start_of_included_file
+        });
+        size_t segment_end = i + 1;
+        while (segment_end < parts.len && !starts_segment(parts, segment_end)) segment_end++;
+        preprocess_group_parts((erule_p_harr) { .data = &parts.data[i], .len = segment_end - i }, ctx);
+        *n_parts_run += segment_end - i;
+        i = segment_end;
+    }
+    if (base.part_index == parts.len) {
+        // There's nothing to run, but the next edit still needs somewhere to start from
+        checkpoint_vec_append(&session->checkpoints, base);
+    }
+    return previous.checkpoints.len;
+}
+
+// The text is never freed, since the tokens point into it
+static sstr copy_text(const unsigned char *const data, const size_t len) {
+    unsigned char *const copy = MALLOC(len == 0 ? 1 : len);
+    memcpy(copy, data, len);
+    return (sstr) { .data = copy, .len = len };
+}
+
+// Where a byte at or after the end of the edit ends up
+static size_t moved_index(const struct text_edit edit, const size_t old_index) {
+    return old_index - edit.end + edit.start + edit.replacement.len;
+}
+
+struct incremental_session *incremental_session_new(const sstr text, const char *const fname, const struct preprocessor_options options) {
+    struct incremental_session *const session = MALLOC(sizeof(struct incremental_session));
+    session->text = uchar_vec_copy_from_arr(text.data, text.len);
+    session->parse_failed = false;
+    session->unparsed_text = uchar_vec_new(0);
+    session->parts = erule_p_vec_new(0);
+    session->part_ends = size_t_vec_new(0);
+    session->checkpoints = checkpoint_vec_new(0);
+    session->changes = state_change_vec_new(0);
+    session->output = pp_token_vec_new(0);
+    session->ctx = start_main_file(options, fname, &session->output);
+    // The prelude is never redone, so its changes don't need to be undoable
+    session->ctx.changes = &session->changes;
+
+    const sstr contents = copy_text(text.data, text.len);
+    const struct parsed_file parsed = parse_source(fname, contents, false);
+    session->ctx.current_source = (struct diagnostic_file) {
+        .fname = fname, .raw = contents, .logical_lines = parsed.logical_lines, .source_map = parsed.source_map
+    };
+    append_parts(parsed, 0, text.len, &session->parts, &session->part_ends);
+    const checkpoint start = {
+        .part_index = 0, .n_changes = 0, .n_output_tokens = 0, .state_fingerprint = 0,
+        .at_start_of_included_file = session->ctx.at_start_of_included_file
+    };
+    const struct previous_run no_previous_run = {
+        .checkpoints = { .data = NULL, .len = 0 }, .last = 0, .undamaged_start = session->parts.arr.len
+    };
+    size_t n_parts_run;
+    run_segments(session, start, no_previous_run, &n_parts_run);
+    session->last_stats = (struct incremental_stats) {
+        .n_bytes_relexed = text.len,
+        .n_group_parts_reparsed = session->parts.arr.len,
+        .n_group_parts_rerun = n_parts_run,
+        .converged = false
+    };
+    return session;
+}
+
+static bool tokens_eq(const struct preprocessing_token token1, const struct preprocessing_token token2) {
+    return token1.type == token2.type && token1.after_whitespace == token2.after_whitespace && sstrs_eq(token1.name, token2.name);
+}
+
+/*
+ * Brings the session up to date with new_text, which is the session's text after edit; the replacement points into it.
+ * Takes ownership of new_text if it parses. Otherwise, returns false, and sets *error_offset to where in new_text
+ * parsing got stuck; nothing but the stats is changed.
+ */
+static bool apply_edit(struct incremental_session *const session, const struct text_edit edit, const uchar_vec new_text, struct token_delta *const delta, size_t *const error_offset) {
+    const sstr old_text = session->text.arr;
+    // From now on the parts come from more than one parse, so diagnostics can only name the file
+    session->ctx.current_source.raw = (sstr) { .data = NULL, .len = 0 };
+    session->ctx.current_source.logical_lines = (sstr) { .data = NULL, .len = 0 };
+
+    // The damaged parts are [first, last): the ones that overlap the edit, or the one it's inserted at the start of
+    const size_t n_parts = session->parts.arr.len;
+    const size_t parts_end = part_start(session, n_parts);
+    size_t first = 0;
+    while (first < n_parts && session->part_ends.arr.data[first] <= edit.start) first++;
+    if (first == n_parts && n_parts > 0 && parts_end == old_text.len && old_text.data[old_text.len - 1] != '\n') {
+        // Text added at the end goes on the last line
+        first--;
+    }
+    size_t last = first;
+    while (last < n_parts && part_start(session, last) < edit.end) last++;
+    if (last == first && first < n_parts) last++;
+
+    const size_t chunk_start = part_start(session, first);
+    sstr chunk;
+    struct parsed_file parsed;
+    while (true) {
+        // Past the last part there can only be text without tokens, like a comment that was left open, which has to be
+        // lexed again along with whatever comes before it. So a chunk that takes in the last part goes to the end.
+        size_t chunk_end = last == n_parts ? new_text.arr.len : moved_index(edit, session->part_ends.arr.data[last - 1]);
+        if (chunk_end < chunk_start) chunk_end = chunk_start;
+        if (chunk_end > new_text.arr.len) chunk_end = new_text.arr.len;
+        if (chunk_end == 0 && last < n_parts) {
+            // The next part now starts the file, so its first token isn't after whitespace anymore
+            last++;
+            continue;
+        }
+        chunk =copy_text(&new_text.arr.data[chunk_start], chunk_end - chunk_start);
+        struct lexed_source lexed = lex_source(chunk);
+        if (chunk_start > 0 && lexed.tokens.len > 0 && token_stream_offset(&lexed.tokens, 0) == 0) {
+            // The chunk starts a line, so the whitespace before its first token is the newline before it
+            token_stream_set_after_whitespace(&lexed.tokens, 0, true);
+        }
+        const bool parses = try_parse_lexed_source(lexed, &parsed);
+        if (parses && lexes_on_its_own(new_text.arr, chunk_start, chunk_end, parsed)) break;
+        if (parses) {
+            parsed_file_free_internals(&parsed, chunk);
+        } else {
+            if (last == n_parts) {
+                // A chunk that goes to the end lexes on its own, so this is as far as it can grow
+                const size_t stuck_at = token_stream_offset(&lexed.tokens, find_parse_failure(&lexed.tokens));
+                *error_offset = chunk_start + source_map_raw_index(lexed.source_map, stuck_at);
+            }
+            lexed_source_free_internals(&lexed, chunk);
+        }
+        FREE(chunk.data);
+        if (last == n_parts) {
+            session->last_stats = (struct incremental_stats) {
+                .n_bytes_relexed = chunk_end - chunk_start, .n_group_parts_reparsed = 0, .n_group_parts_rerun = 0, .converged = false
+            };
+            return false;
+        }
+        // The edit reaches past its own parts (e.g. it opened an #if or a comment), so take in twice as many
+        last += last - first > 0 ? last - first : 1;
+        if (last > n_parts) last = n_parts;
+    }
+
+    const erule_p_vec old_parts = session->parts;
+    const size_t_vec old_part_ends = session->part_ends;
+    session->parts = erule_p_vec_copy_from_arr(old_parts.arr.data, first);
+    session->part_ends = size_t_vec_copy_from_arr(old_part_ends.arr.data, first);
+    append_parts(parsed, chunk_start, chunk.len, &session->parts, &session->part_ends);
+    const size_t undamaged_start = session->parts.arr.len;
+    for (size_t i = last; i < n_parts; i++) {
+        erule_p_vec_append(&session->parts, old_parts.arr.data[i]);
+        size_t_vec_append(&session->part_ends, moved_index(edit, old_part_ends.arr.data[i]));
+    }
+    erule_p_vec_free_internals(&old_parts);
+    size_t_vec_free_internals(&old_part_ends);
+
+    // Go back to the last checkpoint before the damage, by undoing every change made after it
+    const checkpoint_vec old_checkpoints = session->checkpoints;
+    size_t resume_index = 0;
+    while (resume_index + 1 < old_checkpoints.arr.len && old_checkpoints.arr.data[resume_index + 1].part_index <= first) resume_index++;
+    const checkpoint resume = old_checkpoints.arr.data[resume_index];
+    struct preprocessor_context *const ctx = &session->ctx;
+    const state_change_vec old_changes = session->changes;
+    for (size_t i = old_changes.arr.len; i > resume.n_changes; i--) {
+        undo_change(ctx, old_changes.arr.data[i - 1]);
+    }
+    ctx->at_start_of_included_file = resume.at_start_of_included_file;
+
+    state_change_vec new_changes = state_change_vec_new(0);
+    pp_token_vec new_tokens = pp_token_vec_new(0);
+    ctx->changes = &new_changes;
+    ctx->token_collector = &new_tokens;
+    session->checkpoints = checkpoint_vec_copy_from_arr(old_checkpoints.arr.data, resume_index);
+    const struct previous_run previous = {
+        .checkpoints = {
+            .data = &old_checkpoints.arr.data[resume_index],
+            .len = old_checkpoints.arr.len - resume_index
+        },
+        .last = last,
+        .undamaged_start = undamaged_start
+    };
+    size_t n_parts_run;
+    const size_t converged_index = run_segments(session, resume, previous, &n_parts_run);
+    const bool converged = converged_index < previous.checkpoints.len;
+
+    // Splice the new changes, output, and checkpoints in between the old ones from before and after them
+    const pp_token_vec old_output = session->output;
+    size_t old_end = old_output.arr.len;
+    session->changes = state_change_vec_copy_from_arr(old_changes.arr.data, resume.n_changes);
+    state_change_vec_append_all(&session->changes, new_changes);
+    session->output = pp_token_vec_copy_from_arr(old_output.arr.data, resume.n_output_tokens);
+    pp_token_vec_append_all(&session->output, new_tokens);
+    size_t new_end = session->output.arr.len;
+    if (converged) {
+        // The state is the same as it was at the old checkpoint, so the old changes after it still apply
+        const checkpoint old = previous.checkpoints.data[converged_index];
+        for (size_t i = old.n_changes; i < old_changes.arr.len; i++) {
+            redo_change(ctx, old_changes.arr.data[i]);
+        }
+        state_change_vec_append_all_arr(&session->changes, &old_changes.arr.data[old.n_changes], old_changes.arr.len - old.n_changes);
+        pp_token_vec_append_all_arr(&session->output, &old_output.arr.data[old.n_output_tokens], old_output.arr.len - old.n_output_tokens);
+        old_end = old.n_output_tokens;
+        for (size_t i = converged_index; i < previous.checkpoints.len; i++) {
+            checkpoint moved = previous.checkpoints.data[i];
+            moved.part_index = moved.part_index - last + undamaged_start;
+            moved.n_changes = moved.n_changes - old.n_changes + resume.n_changes + new_changes.arr.len;
+            moved.n_output_tokens = moved.n_output_tokens - old.n_output_tokens + new_end;
+            checkpoint_vec_append(&session->checkpoints, moved);
+        }
+    }
+    ctx->changes = &session->changes;
+    ctx->token_collector = &session->output;
+
+    // Tokens at either end of the rerun part often come out the same as before
+    const pp_token_harr output = session->output.arr;
+    size_t start = resume.n_output_tokens;
+    while (start < old_end && start < new_end && tokens_eq(old_output.arr.data[start], output.data[start])) start++;
+    while (old_end > start && new_end > start && tokens_eq(old_output.arr.data[old_end - 1], output.data[new_end - 1])) {
+        old_end--;
+        new_end--;
+    }
+    *delta = (struct token_delta) {
+        .parse_failed = false,
+        .error_offset = 0,
+        .start = start,
+        .n_removed = old_end - start,
+        .inserted = { .data = &output.data[start], .len = new_end - start }
+    };
+
+    session->last_stats = (struct incremental_stats) {
+        .n_bytes_relexed = chunk.len,
+        .n_group_parts_reparsed = undamaged_start - first,
+        .n_group_parts_rerun = n_parts_run,
+        .converged = converged
+    };
+    uchar_vec_free_internals(&session->text);
+    session->text = new_text;
+    checkpoint_vec_free_internals(&old_checkpoints);
+    state_change_vec_free_internals(&old_changes);
+    state_change_vec_free_internals(&new_changes);
+    pp_token_vec_free_internals(&old_output);
+    pp_token_vec_free_internals(&new_tokens);
+    return true;
+}
+
+// The smallest edit that turns text into new_text; its replacement points into new_text
+static struct text_edit difference(const sstr text, const sstr new_text) {
+    const size_t max_common = text.len < new_text.len ? text.len : new_text.len;
+    size_t prefix = 0;
+    while (prefix < max_common && text.data[prefix] == new_text.data[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < max_common - prefix && text.data[text.len - 1 - suffix] == new_text.data[new_text.len - 1 - suffix]) suffix++;
+    return (struct text_edit) {
+        .start = prefix,
+        .end = text.len - suffix,
+        .replacement = { .data = &new_text.data[prefix], .len = new_text.len - suffix - prefix }
+    };
+}
+
+struct token_delta incremental_session_edit(struct incremental_session *const session, const struct text_edit edit) {
+    const sstr current_text = incremental_session_text(session);
+    if (edit.start > edit.end || edit.end > current_text.len) {
+        driver_error("The edit of bytes %zu to %zu is outside the text, which is %zu bytes long.", edit.start, edit.end, current_text.len);
+    }
+    uchar_vec new_text = uchar_vec_new(current_text.len - (edit.end - edit.start) + edit.replacement.len);
+    uchar_vec_append_all_arr(&new_text, current_text.data, edit.start);
+    uchar_vec_append_all_harr(&new_text, edit.replacement);
+    uchar_vec_append_all_arr(&new_text, &current_text.data[edit.end], current_text.len - edit.end);
+
+    // The parts are still for the last text that parsed, so an edit to text that doesn't parse is redone from there
+    const struct text_edit parsed_text_edit = session->parse_failed ? difference(session->text.arr, new_text.arr) : (struct text_edit) {
+        .start = edit.start,
+        .end = edit.end,
+        .replacement = { .data = &new_text.arr.data[edit.start], .len = edit.replacement.len }
+    };
+    struct token_delta delta;
+    size_t error_offset = 0;
+    uchar_vec_free_internals(&session->unparsed_text);
+    if (apply_edit(session, parsed_text_edit, new_text, &delta, &error_offset)) {
+        session->parse_failed = false;
+        session->unparsed_text = uchar_vec_new(0);
+        return delta;
+    }
+    session->parse_failed = true;
+    session->unparsed_text = new_text;
+    return (struct token_delta) {
+        .parse_failed = true,
+        .error_offset = error_offset,
+        .start = 0,
+        .n_removed = 0,
+        .inserted = { .data = session->output.arr.data, .len = 0 }
+    };
+}
+
+pp_token_harr incremental_session_output(const struct incremental_session *const session) {
+    return session->output.arr;
+}
+
+sstr incremental_session_text(const struct incremental_session *const session) {
+    return session->parse_failed ? session->unparsed_text.arr : session->text.arr;
+}
+
+struct incremental_stats incremental_session_last_stats(const struct incremental_session *const session) {
+    return session->last_stats;
+}
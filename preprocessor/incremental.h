@@ -0,0 +1,70 @@
+#ifndef ICK_INCREMENTAL_H
+#define ICK_INCREMENTAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "preprocessor.h"
+#include "data_structures/sstr.h"
+
+/*
+ * Preprocesses a main file that's being edited, redoing only what an edit could have changed.
+ *
+ * The main file is kept as a list of top-level group parts (lines, and whole #if sections), each with its byte range
+ * in the text. An edit re-lexes and re-parses only the group parts it touches, growing the range if the new text
+ * doesn't parse on its own (e.g. when an #endif is added or removed). Directives are then executed again from the
+ * last checkpoint before the first damaged group part. There's a checkpoint before every top-level group part that
+ * isn't a text line, since that's where the text collected so far is expanded. Re-execution stops at the first
+ * checkpoint after the damage where the macros, the #pragma once files, and the pending whitespace are the same as
+ * they were there in the previous run; everything after it is reused.
+ *
+ * Only the main file is tracked. Included files are assumed not to change while a session is open.
+ */
+struct incremental_session;
+
+// Replaces the bytes [start, end) of the current text with replacement
+struct text_edit {
+    size_t start;
+    size_t end;
+    sstr replacement;
+};
+
+// How to turn the previous output into the new one: replace n_removed tokens starting at start with inserted
+struct token_delta {
+    // If true, the new text doesn't parse (e.g. an #if is still missing its #endif), and the output is still that of
+    // the last text that did, so nothing is removed or inserted
+    bool parse_failed;
+    size_t error_offset; // if parse_failed, where in the new text parsing got stuck
+    size_t start;
+    size_t n_removed;
+    pp_token_harr inserted; // points into the session's output, so it's only valid until the next edit
+};
+
+struct incremental_stats {
+    size_t n_bytes_relexed;
+    size_t n_group_parts_reparsed;
+    size_t n_group_parts_rerun;
+    bool converged; // whether re-execution stopped before the end of the file
+};
+
+/*
+ * Preprocesses text, which is the contents of fname, from scratch. The text is copied.
+ */
+struct incremental_session *incremental_session_new(sstr text, const char *fname, struct preprocessor_options options);
+
+/*
+ * Applies an edit to the text, and brings the output up to date. If the new text doesn't parse, the session keeps the
+ * output of the last text that did, and the next edit that makes the text parse brings it up to date from there.
+ * Other errors, like an #include of a file that doesn't exist, still exit with an error.
+ */
+struct token_delta incremental_session_edit(struct incremental_session *session, struct text_edit edit);
+
+// The output tokens for the current text; only valid until the next edit
+pp_token_harr incremental_session_output(const struct incremental_session *session);
+
+// The text as of the last edit, whether or not it parses
+sstr incremental_session_text(const struct incremental_session *session);
+
+// What the last edit (or the initial run) had to redo
+struct incremental_stats incremental_session_last_stats(const struct incremental_session *session);
+
+#endif //ICK_INCREMENTAL_H
@@ -1,10 +1,12 @@
 #include "macro_expansion.h"
 #include "preprocessor/diagnostics.h"
+#include "preprocessor/pch.h"
+#include "debug/trace.h"
 #include <stdio.h>
 
 static struct earley_rule get_replacement_list_rule(const struct earley_rule control_line_rule) {
     if (control_line_rule.lhs != &tr_control_line) {
-        preprocessor_fatal_error(0, 0, 0, "get_replacement_list_rule called with non-control line");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "get_replacement_list_rule called with non-control line");
     }
 
     switch (control_line_rule.rhs.tag) {
@@ -17,7 +19,7 @@ static struct earley_rule get_replacement_list_rule(const struct earley_rule con
         case CONTROL_LINE_DEFINE_FUNCTION_LIKE_MIXED_ARGS:
             return *control_line_rule.completed_from.data[3];
         default:
-            preprocessor_fatal_error(0, 0, 0, "get_replacement_list_rule called with non-define control line");
+            preprocessor_fatal_error(NO_SOURCE_LOCATION, "get_replacement_list_rule called with non-define control line");
     }
 }
 
@@ -47,23 +49,31 @@ static bool replacement_lists_identical(const pp_token_harr list1, const pp_toke
     return true;
 }
 
-void define_object_like_macro(const struct earley_rule rule, sstr_macro_args_and_body_map *macros) {
+// Looks up a macro, reading its definition out of the PCH it came from first if that hasn't been done yet. NULL if it isn't defined.
+static const struct macro_args_and_body *find_macro(const ident_id_macro_args_and_body_map *const macros, const ident_id name) {
+    struct macro_args_and_body *const macro = ident_id_macro_args_and_body_map_get_ptr(macros, name);
+    if (macro != NULL && macro->pch != NULL) pch_read_macro(macro);
+    return macro;
+}
+
+void define_object_like_macro(const struct earley_rule rule, ident_id_macro_args_and_body_map *macros, const struct diagnostic_file *const file) {
     if (rule.lhs != &tr_control_line || rule.rhs.tag != CONTROL_LINE_DEFINE_OBJECT_LIKE) {
-        preprocessor_fatal_error(0, 0, 0, "rule passed to define_object_like_macro is not an object-like macro");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "rule passed to define_object_like_macro is not an object-like macro");
     }
     const struct preprocessing_token macro_name_token = get_macro_name_token(rule);
 
     const pp_token_harr replacement_tokens = get_replacement_tokens(rule);
 
-    if (sstr_macro_args_and_body_map_contains(macros, macro_name_token.name)) {
-        const struct macro_args_and_body existing_macro = sstr_macro_args_and_body_map_get(macros, macro_name_token.name);
+    const struct macro_args_and_body *const existing_macro_p = find_macro(macros, macro_name_token.ident);
+    if (existing_macro_p != NULL) {
+        const struct macro_args_and_body existing_macro = *existing_macro_p;
         if (!replacement_lists_identical(replacement_tokens, existing_macro.replacements)) {
-            preprocessor_error(0, 0, 0, "macro already exists");
+            preprocessor_error(location_in(file, macro_name_token.name), "macro already exists");
         }
         return;
     }
 
-    sstr_macro_args_and_body_map_add(macros, macro_name_token.name,
+    ident_id_macro_args_and_body_map_add(macros, macro_name_token.ident,
         (struct macro_args_and_body) {
             .is_function_like = false,
             .args = {.data = NULL, .len = 0},
@@ -73,20 +83,20 @@ void define_object_like_macro(const struct earley_rule rule, sstr_macro_args_and
     );
 }
 
-static void append_identifier_names(sstr_vec *vec, const struct earley_rule identifier_list_rule) {
+static void append_identifier_names(ident_id_vec *vec, const struct earley_rule identifier_list_rule) {
     for (size_t i = 0; i < identifier_list_rule.completed_from.len; i++) {
         const struct earley_rule identifier_rule = *identifier_list_rule.completed_from.data[i];
         const struct preprocessing_token token = identifier_rule.rhs.symbols.data[0].val.terminal.token;
-        sstr_vec_append(vec, token.name);
+        ident_id_vec_append(vec, token.ident);
     }
 }
 
-static sstr_harr get_macro_params(const struct earley_rule control_line_rule) {
+static ident_id_harr get_macro_params(const struct earley_rule control_line_rule) {
     if (control_line_rule.lhs != &tr_control_line || (control_line_rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_MIXED_ARGS && control_line_rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_ONLY_VARARGS && control_line_rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_NO_VARARGS)) {
-        preprocessor_fatal_error(0, 0, 0, "rule passed to define_object_like_macro is not an object-like macro");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "rule passed to define_object_like_macro is not an object-like macro");
     }
 
-    sstr_vec params = sstr_vec_new(0);
+    ident_id_vec params = ident_id_vec_new(0);
 
     switch (control_line_rule.rhs.tag) {
         case CONTROL_LINE_DEFINE_FUNCTION_LIKE_NO_VARARGS: {
@@ -104,44 +114,45 @@ static sstr_harr get_macro_params(const struct earley_rule control_line_rule) {
             for (size_t i = 0; i < identifier_list_rule.completed_from.len; i++) {
                 const struct earley_rule identifier_rule = *identifier_list_rule.completed_from.data[i];
                 const struct preprocessing_token token = identifier_rule.rhs.symbols.data[0].val.terminal.token;
-                sstr_vec_append(&params, token.name);
+                ident_id_vec_append(&params, token.ident);
             }
             break;
         }
         default:
-            preprocessor_fatal_error(0, 0, 0, "rule passed to define_object_like_macro is not an object-like macro");
+            preprocessor_fatal_error(NO_SOURCE_LOCATION, "rule passed to define_object_like_macro is not an object-like macro");
     }
 
     return params.arr;
 }
 
-static bool args_identical(const sstr_harr args1, const sstr_harr args2) {
+static bool args_identical(const ident_id_harr args1, const ident_id_harr args2) {
     if (args1.len != args2.len) return false;
     for (size_t i = 0; i < args1.len; i++) {
-        if (!sstrs_eq(args1.data[i], args2.data[i])) return false;
+        if (args1.data[i] != args2.data[i]) return false;
     }
     return true;
 }
 
-void define_function_like_macro(const struct earley_rule rule, sstr_macro_args_and_body_map *const macros) {
+void define_function_like_macro(const struct earley_rule rule, ident_id_macro_args_and_body_map *const macros, const struct diagnostic_file *const file) {
     if (rule.lhs != &tr_control_line || (rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_MIXED_ARGS && rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_ONLY_VARARGS && rule.rhs.tag != CONTROL_LINE_DEFINE_FUNCTION_LIKE_NO_VARARGS)) {
-        preprocessor_fatal_error(0, 0, 0, "rule passed to define_function_like_macro is not an function-like macro");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "rule passed to define_function_like_macro is not an function-like macro");
     }
     const struct preprocessing_token macro_name_token = rule.completed_from.data[0]->rhs.symbols.data[0].val.terminal.token;
     const pp_token_harr replacement_tokens = get_replacement_tokens(rule);
-    const sstr_harr args = get_macro_params(rule);
+    const ident_id_harr args = get_macro_params(rule);
 
-    if (sstr_macro_args_and_body_map_contains(macros, macro_name_token.name)) {
-        const struct macro_args_and_body existing_macro = sstr_macro_args_and_body_map_get(macros, macro_name_token.name);
+    const struct macro_args_and_body *const existing_macro_p = find_macro(macros, macro_name_token.ident);
+    if (existing_macro_p != NULL) {
+        const struct macro_args_and_body existing_macro = *existing_macro_p;
         const bool replacements_same = replacement_lists_identical(replacement_tokens, existing_macro.replacements);
         const bool args_same = args_identical(args, existing_macro.args);
         if (!replacements_same || !args_same) {
-            preprocessor_error(0, 0, 0, "macro already exists");
+            preprocessor_error(location_in(file, macro_name_token.name), "macro already exists");
         }
         return;
     }
 
-    sstr_macro_args_and_body_map_add(macros, macro_name_token.name,
+    ident_id_macro_args_and_body_map_add(macros, macro_name_token.ident,
         (struct macro_args_and_body){
             .is_function_like = true,
             .args = args,
@@ -151,11 +162,11 @@ void define_function_like_macro(const struct earley_rule rule, sstr_macro_args_a
     );
 }
 
-static struct macro_use_info get_macro_use_info(const token_with_ignore_list_harr tokens, const size_t macro_inv_start, const macro_args_and_body macro_def) {
-    const sstr_vec new_dont_replace = sstr_vec_copy(tokens.data[macro_inv_start].dont_replace);
+static struct macro_use_info get_macro_use_info(const token_with_ignore_list_harr tokens, const size_t macro_inv_start, const macro_args_and_body macro_def, const struct diagnostic_file *const file) {
+    const ident_id_vec new_dont_replace = ident_id_vec_copy(tokens.data[macro_inv_start].dont_replace);
     const bool after_whitespace = tokens.data[macro_inv_start].token.after_whitespace;
 
-    if (macro_inv_start == tokens.len - 1 || !token_is_str(tokens.data[macro_inv_start + 1].token, "(")) {
+    if (macro_inv_start == tokens.len - 1 || tokens.data[macro_inv_start + 1].token.kind != TOKEN_LEFT_PAREN) {
         // object-like use
         if (macro_def.is_function_like) {
             // object-like use of function-like macro
@@ -165,7 +176,7 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
         }
         // object-like use of object-like macro
         return (struct macro_use_info) {
-            .macro_name = tokens.data[macro_inv_start].token.name,
+            .macro_name = tokens.data[macro_inv_start].token.ident,
             .after_whitespace = after_whitespace,
             .end_index = macro_inv_start + 1,
             .args = {.data = NULL, .len = 0},
@@ -176,7 +187,7 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
     } else if (!macro_def.is_function_like) {
         // function-like use of object-like macro
         return (struct macro_use_info) {
-                .macro_name = tokens.data[macro_inv_start].token.name,
+                .macro_name = tokens.data[macro_inv_start].token.ident,
                 .after_whitespace = after_whitespace,
                 .end_index = macro_inv_start + 1,
                 .args = {.data = NULL, .len = 0},
@@ -186,6 +197,7 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
         };
     }
     // function-like use of function-like macro
+    const struct source_location use_location = location_in(file, tokens.data[macro_inv_start].token.name);
 
     token_with_ignore_list_harr_vec given_args = token_with_ignore_list_harr_vec_new(0);
     token_with_ignore_list_vec current_arg = token_with_ignore_list_vec_new(0);
@@ -194,9 +206,9 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
     int net_open_parens = 1;
     size_t i = macro_inv_start + 2; // skip the macro name and first open paren
     for (; i < tokens.len; i++) {
-        if (token_is_str(tokens.data[i].token, "(")) {
+        if (tokens.data[i].token.kind == TOKEN_LEFT_PAREN) {
             net_open_parens++;
-        } else if (token_is_str(tokens.data[i].token, ")")) {
+        } else if (tokens.data[i].token.kind == TOKEN_RIGHT_PAREN) {
             net_open_parens--;
             if (net_open_parens == 0) {
                 i++;
@@ -206,7 +218,7 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
         if (in_varargs) {
             token_with_ignore_list_vec_append(&vararg_tokens, tokens.data[i]);
         } else {
-            if (net_open_parens == 1 && token_is_str(tokens.data[i].token, ",")) {
+            if (net_open_parens == 1 && tokens.data[i].token.kind == TOKEN_COMMA) {
                 // argument-separating comma
                 token_with_ignore_list_harr_vec_append(&given_args, current_arg.arr);
                 if (macro_def.accepts_varargs && given_args.arr.len == macro_def.args.len) {
@@ -219,12 +231,12 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
         }
     }
     if (net_open_parens > 0) {
-        preprocessor_fatal_error(0, 0, 0, "%d open parens in macro call are unmatched by a closed paren", net_open_parens);
+        preprocessor_fatal_error(use_location, "%d open parens in macro call are unmatched by a closed paren", net_open_parens);
     }
 
     if (!in_varargs && (
             current_arg.arr.len > 0 // non-empty arg at end, e.g. A(x, y)
-            || (i >= 2 && token_is_str(tokens.data[i-2].token, ",")) // empty arg at end, e.g. A(x,)
+            || (i >= 2 && tokens.data[i-2].token.kind == TOKEN_COMMA) // empty arg at end, e.g. A(x,)
             || (current_arg.arr.len == 0 && given_args.arr.len == 0 && macro_def.args.len >= 1) // macro that requires at least one non-variadic argument called with empty parens (e.g. `X()` or `X(  )`)
         )
     ) {
@@ -234,23 +246,23 @@ static struct macro_use_info get_macro_use_info(const token_with_ignore_list_har
     if (macro_def.accepts_varargs) {
         if (given_args.arr.len < macro_def.args.len) {
             // TODO explain in the error why empty parens are (sometimes) treated as 1 argument instead of 0
-            preprocessor_fatal_error(0, 0, 0,
+            preprocessor_fatal_error(use_location,
                 "too few args given to variadic macro; expected at least %zu, got %zu", macro_def.args.len + 1, given_args.arr.len);
         } else if (given_args.arr.len > macro_def.args.len) {
-            preprocessor_fatal_error(0, 0, 0,
+            preprocessor_fatal_error(use_location,
                 "(this should never happen) too many args given to variadic macro...?");
         } else if (!in_varargs) { // given_args.arr.len == macro_def.args.len
-            preprocessor_fatal_error(0, 0, 0,
+            preprocessor_fatal_error(use_location,
                 "no variable arguments given to variadic macro");
         }
     }
     if (given_args.arr.len != macro_def.args.len) {
-        preprocessor_fatal_error(0, 0, 0,
+        preprocessor_fatal_error(use_location,
             "wrong number of args given to macro; expected %zu, got %zu", macro_def.args.len, given_args.arr.len);
     }
 
     return (struct macro_use_info) {
-        .macro_name = tokens.data[macro_inv_start].token.name,
+        .macro_name = tokens.data[macro_inv_start].token.ident,
         .after_whitespace = after_whitespace,
         .end_index = i,
         .args = given_args.arr,
@@ -287,49 +299,50 @@ static sstr concatenate(const sstr arg1, const sstr arg2) {
     return out.arr;
 }
 
-static ssize_t get_arg_index(const sstr token_name, const struct macro_args_and_body macro_def) {
+static ssize_t get_arg_index(const struct preprocessing_token token, const struct macro_args_and_body macro_def) {
+    if (token.ident == NO_IDENT) return -1;
     for (size_t i = 0; i < macro_def.args.len; i++) {
-        if (sstrs_eq(token_name, macro_def.args.data[i])) {
+        if (token.ident == macro_def.args.data[i]) {
             return (ssize_t)i;
         }
     }
     return -1;
 }
 
-static bool sstr_harr_contains(const sstr_harr arr, const sstr view) {
+static bool ident_id_harr_contains(const ident_id_harr arr, const ident_id id) {
     for (size_t i = 0; i < arr.len; i++) {
-        if (sstrs_eq(arr.data[i], view)) {
+        if (arr.data[i] == id) {
             return true;
         }
     }
     return false;
 }
 
-static token_with_ignore_list_harr replace_macros_helper(token_with_ignore_list_harr tokens, size_t scan_start, sstr_macro_args_and_body_map macro_map, enum exclude_from_detection exclude_concatenation_type);
+static token_with_ignore_list_harr replace_macros_helper(token_with_ignore_list_harr tokens, size_t scan_start, ident_id_macro_args_and_body_map macro_map, enum exclude_from_detection exclude_concatenation_type, const struct diagnostic_file *file);
 
-static token_with_ignore_list_harr replace_arg(const token_with_ignore_list_harr arg, const sstr_macro_args_and_body_map macro_map, const sstr macro_name, const sstr_vec ignore_list, const enum exclude_from_detection exclude_concatenation_type) {
+static token_with_ignore_list_harr replace_arg(const token_with_ignore_list_harr arg, const ident_id_macro_args_and_body_map macro_map, const ident_id macro_name, const ident_id_vec ignore_list, const enum exclude_from_detection exclude_concatenation_type, const struct diagnostic_file *const file) {
     token_with_ignore_list_vec arg_tokens = token_with_ignore_list_vec_new(0);
     for (size_t i = 0; i < arg.len; i++) {
-        sstr_vec new_ignore_list = sstr_vec_copy(ignore_list);
-        sstr_vec_append_all(&new_ignore_list, arg.data[i].dont_replace);
+        ident_id_vec new_ignore_list = ident_id_vec_copy(ignore_list);
+        ident_id_vec_append_all(&new_ignore_list, arg.data[i].dont_replace);
         token_with_ignore_list_vec_append(&arg_tokens, (struct token_with_ignore_list) {
                 .token = arg.data[i].token, .dont_replace = new_ignore_list
         });
     }
-    const token_with_ignore_list_harr out = replace_macros_helper(arg_tokens.arr, 0, macro_map, exclude_concatenation_type);
+    const token_with_ignore_list_harr out = replace_macros_helper(arg_tokens.arr, 0, macro_map, exclude_concatenation_type, file);
     for (size_t i = 0; i < out.len; i++) {
-        sstr_vec_append(&out.data[i].dont_replace, macro_name);
+        ident_id_vec_append(&out.data[i].dont_replace, macro_name);
     }
     return out;
 }
 
-static pp_token_harr eval_stringifies(const struct macro_args_and_body macro_info, const struct macro_use_info use_info) {
+static pp_token_harr eval_stringifies(const struct macro_args_and_body macro_info, const struct macro_use_info use_info, const struct diagnostic_file *const file) {
     pp_token_vec out = pp_token_vec_new(0);
     for (size_t i = 0; i < macro_info.replacements.len;) {
-        if (i != macro_info.replacements.len - 1 && token_is_str(macro_info.replacements.data[i], "#") && macro_info.is_function_like) {
-            const ssize_t arg_index = get_arg_index(macro_info.replacements.data[i+1].name, macro_info);
+        if (i != macro_info.replacements.len - 1 && macro_info.replacements.data[i].kind == TOKEN_HASH && macro_info.is_function_like) {
+            const ssize_t arg_index = get_arg_index(macro_info.replacements.data[i+1], macro_info);
             if (arg_index == -1) {
-                preprocessor_fatal_error(0, 0, 0, "can't stringify non-argument");
+                preprocessor_fatal_error(location_in(file, macro_info.replacements.data[i].name), "can't stringify non-argument");
             }
 
             pp_token_vec_append(&out, (struct preprocessing_token){
@@ -338,8 +351,8 @@ static pp_token_harr eval_stringifies(const struct macro_args_and_body macro_inf
                 .after_whitespace = macro_info.replacements.data[i].after_whitespace
             });
             i += 2;
-        } else if (i == macro_info.replacements.len - 1 && token_is_str(macro_info.replacements.data[i], "#") && macro_info.is_function_like) {
-            preprocessor_fatal_error(0, 0, 0, "# operator can't appear at the end of a macro");
+        } else if (i == macro_info.replacements.len - 1 && macro_info.replacements.data[i].kind == TOKEN_HASH && macro_info.is_function_like) {
+            preprocessor_fatal_error(location_in(file, macro_info.replacements.data[i].name), "# operator can't appear at the end of a macro");
         } else {
             pp_token_vec_append(&out, macro_info.replacements.data[i]);
             i++;
@@ -351,8 +364,11 @@ static pp_token_harr eval_stringifies(const struct macro_args_and_body macro_inf
 typedef _Bool boolean;
 DEFINE_VEC_TYPE_AND_FUNCTIONS(boolean)
 
-static token_with_ignore_list_vec get_replacement(struct macro_args_and_body macro_info, struct macro_use_info use_info, const sstr_macro_args_and_body_map macro_map, const enum exclude_from_detection exclude_concatenation_type) {
-    printf("getting replacement for call of macro %.*s\n", (int)use_info.macro_name.len, (const char*)use_info.macro_name.data);
+static token_with_ignore_list_vec get_replacement(struct macro_args_and_body macro_info, struct macro_use_info use_info, const ident_id_macro_args_and_body_map macro_map, const enum exclude_from_detection exclude_concatenation_type, const struct diagnostic_file *const file) {
+    if (TRACING(MACRO, TRACE_BASIC)) {
+        const sstr macro_name = ident_spelling(use_info.macro_name);
+        fprintf(trace_file(), "getting replacement for call of macro %.*s\n", (int)macro_name.len, (const char*)macro_name.data);
+    }
 
     // TODO error if __VA_ARGS__ is used outside a variadic macro
 
@@ -364,17 +380,17 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
         use_info.args = new_given_args.arr;
 
         // Similarly, we need to add an extra argument to the macro info, called __VA_ARGS__
-        sstr_vec new_arg_names = sstr_vec_new(macro_info.args.len + 1);
-        sstr_vec_append_all_harr(&new_arg_names, macro_info.args);
-        sstr_vec_append(&new_arg_names, SSTR_FROM_LITERAL("__VA_ARGS__"));
+        ident_id_vec new_arg_names = ident_id_vec_new(macro_info.args.len + 1);
+        ident_id_vec_append_all_harr(&new_arg_names, macro_info.args);
+        ident_id_vec_append(&new_arg_names, IDENT_VA_ARGS);
         macro_info.args = new_arg_names.arr;
     }
 
     token_with_ignore_list_vec replaced_tokens = token_with_ignore_list_vec_new(0);
     boolean_vec needs_concat = boolean_vec_new(0);
 
-    sstr_vec dont_replace_list = sstr_vec_copy(use_info.dont_replace);
-    sstr_vec_append(&dont_replace_list, use_info.macro_name);
+    ident_id_vec dont_replace_list = ident_id_vec_copy(use_info.dont_replace);
+    ident_id_vec_append(&dont_replace_list, use_info.macro_name);
 
     /*
      The purpose of the dont_add_left_operand flag is to handle cases like this one:
@@ -396,7 +412,7 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
     */
     bool dont_add_left_operand = false;
 
-    const pp_token_harr stringifies_expanded = eval_stringifies(macro_info, use_info);
+    const pp_token_harr stringifies_expanded = eval_stringifies(macro_info, use_info, file);
 
     // Token concatenation is evaluated in 2 stages:
     // 1. Every token is macro-replaced appropriately, including the operands to the token concatenation.
@@ -405,20 +421,20 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
     // This for loop is step 1.
     for (size_t i = 0; i < stringifies_expanded.len;) {
         // If ## is after this token, then...
-        if (i != stringifies_expanded.len - 1 && token_is_str(stringifies_expanded.data[i+1], "##")) {
+        if (i != stringifies_expanded.len - 1 && stringifies_expanded.data[i+1].kind == TOKEN_HASH_HASH) {
             if (i+1 == stringifies_expanded.len - 1) {
-                preprocessor_fatal_error(0, 0, 0, "## can't appear at beginning or end of macro");
+                preprocessor_fatal_error(location_in(file, stringifies_expanded.data[i+1].name), "## can't appear at beginning or end of macro");
             }
 
             // Figure out whether the operands are macro arguments, and if so, what the indices of the arguments are
-            const ssize_t left_operand_arg_i = get_arg_index(stringifies_expanded.data[i].name, macro_info);
-            const ssize_t right_operand_arg_i = get_arg_index(stringifies_expanded.data[i + 2].name, macro_info);
+            const ssize_t left_operand_arg_i = get_arg_index(stringifies_expanded.data[i], macro_info);
+            const ssize_t right_operand_arg_i = get_arg_index(stringifies_expanded.data[i + 2], macro_info);
 
             if (!dont_add_left_operand) {
                 if (left_operand_arg_i == -1) {
                     // If the left operand isn't an argument, it doesn't need to be replaced. Add it to the tokens list.
                     token_with_ignore_list_vec_append(&replaced_tokens, (struct token_with_ignore_list) {
-                            .token = stringifies_expanded.data[i], .dont_replace = sstr_vec_copy(dont_replace_list)
+                            .token = stringifies_expanded.data[i], .dont_replace = ident_id_vec_copy(dont_replace_list)
                     });
                     // The left operand shouldn't be concatenated with the token before it
                     boolean_vec_append(&needs_concat, false);
@@ -430,7 +446,7 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
                                     .after_whitespace = stringifies_expanded.data[i].after_whitespace,
                                     // type intentionally omitted
                             },
-                            .dont_replace = sstr_vec_copy(dont_replace_list)
+                            .dont_replace = ident_id_vec_copy(dont_replace_list)
                     });
                     // The left operand shouldn't be concatenated with the token before it
                     boolean_vec_append(&needs_concat, false);
@@ -446,7 +462,7 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
             if (right_operand_arg_i == -1) {
                 // Like with the left operand, if the right operand isn't an argument, just add it to the tokens list
                 token_with_ignore_list_vec_append(&replaced_tokens, (struct token_with_ignore_list) {
-                        .token = stringifies_expanded.data[i+2], .dont_replace = sstr_vec_copy(dont_replace_list)
+                        .token = stringifies_expanded.data[i+2], .dont_replace = ident_id_vec_copy(dont_replace_list)
                 });
                 // Indicate it should be concatenated with the preceding token (which is the left operand)
                 boolean_vec_append(&needs_concat, true);
@@ -458,7 +474,7 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
                                 .after_whitespace = stringifies_expanded.data[i].after_whitespace,
                                 // type intentionally omitted
                         },
-                        .dont_replace = sstr_vec_copy(dont_replace_list)
+                        .dont_replace = ident_id_vec_copy(dont_replace_list)
                 });
                 // This placemarker token still needs to be concatenated with the left operand
                 boolean_vec_append(&needs_concat, true);
@@ -474,25 +490,25 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
             }
             dont_add_left_operand = true;
             i += 2;
-        } else if (i == 0 && token_is_str(stringifies_expanded.data[i], "##")) {
-            preprocessor_fatal_error(0, 0, 0, "## can't appear at beginning or end of macro");
+        } else if (i == 0 && stringifies_expanded.data[i].kind == TOKEN_HASH_HASH) {
+            preprocessor_fatal_error(location_in(file, stringifies_expanded.data[i].name), "## can't appear at beginning or end of macro");
         } else if (dont_add_left_operand) {
             i++;
             dont_add_left_operand = false;
         } else {
             // This is a normal token, i.e. not an operand to the ## operator, and not the ## operator itself; and the same for the # operator, since stringifications were expanded earlier
             // Figure out whether it's a macro argument, and if so, what its index is
-            const ssize_t arg_index = get_arg_index(stringifies_expanded.data[i].name, macro_info);
+            const ssize_t arg_index = get_arg_index(stringifies_expanded.data[i], macro_info);
             if (arg_index == -1) {
                 // If it's not an argument, just add it to the tokens list
                 token_with_ignore_list_vec_append(&replaced_tokens, (struct token_with_ignore_list) {
-                    .token = stringifies_expanded.data[i], .dont_replace = sstr_vec_copy(dont_replace_list) }
+                    .token = stringifies_expanded.data[i], .dont_replace = ident_id_vec_copy(dont_replace_list) }
                 );
                 // It isn't the right operand of the ## operator, so it shouldn't be concatenated with the preceding token
                 boolean_vec_append(&needs_concat, false);
             } else {
                 // If it's an argument, add the given argument's tokens to the list
-                const token_with_ignore_list_harr new_arg = replace_arg(use_info.args.data[arg_index], macro_map, use_info.macro_name, use_info.dont_replace, exclude_concatenation_type);
+                const token_with_ignore_list_harr new_arg = replace_arg(use_info.args.data[arg_index], macro_map, use_info.macro_name, use_info.dont_replace, exclude_concatenation_type, file);
                 token_with_ignore_list_vec_append_all_harr(&replaced_tokens, new_arg);
                 // None of its tokens are the right operand of the ## operator, so they shouldn't be concatenated with the preceding token
                 for (size_t j = 0; j < new_arg.len; j++) {
@@ -512,12 +528,17 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
 
             const bool token_valid = is_valid_token(concat_result, exclude_concatenation_type);
             if (!token_valid && concat_result.len != 0) {
-                preprocessor_fatal_error(0, 0, 0, "concat result %.*s is not a valid token", (int)concat_result.len, (const char*)concat_result.data);
+                preprocessor_fatal_error(location_in(file, replaced_tokens.arr.data[i].token.name), "concat result %.*s is not a valid token", (int)concat_result.len, (const char*)concat_result.data);
             }
             // If a token needs to be concatenated with the preceding token, then we retroactively modify the preceding token
             out.arr.data[out.arr.len - 1].token.name = concat_result;
             if (token_valid) {
-                out.arr.data[out.arr.len - 1].token.type = get_token_type_from_str(concat_result, exclude_concatenation_type);
+                const enum pp_token_type type = get_token_type_from_str(concat_result, exclude_concatenation_type);
+                out.arr.data[out.arr.len - 1].token.type = type;
+                out.arr.data[out.arr.len - 1].token.ident = type == IDENTIFIER ? intern(concat_result) : NO_IDENT;
+                out.arr.data[out.arr.len - 1].token.kind = get_token_kind(concat_result, type);
+            } else {
+                out.arr.data[out.arr.len - 1].token.kind = TOKEN_OTHER;
             }
         } else {
             token_with_ignore_list_vec_append(&out, replaced_tokens.arr.data[i]);
@@ -532,24 +553,26 @@ static token_with_ignore_list_vec get_replacement(struct macro_args_and_body mac
     return out;
 }
 
-static token_with_ignore_list_harr replace_macros_helper(const token_with_ignore_list_harr tokens, const size_t scan_start, const sstr_macro_args_and_body_map macro_map, const enum exclude_from_detection exclude_concatenation_type) {
+static token_with_ignore_list_harr replace_macros_helper(const token_with_ignore_list_harr tokens, const size_t scan_start, const ident_id_macro_args_and_body_map macro_map, const enum exclude_from_detection exclude_concatenation_type, const struct diagnostic_file *const file) {
     token_with_ignore_list_vec out = token_with_ignore_list_vec_new(0);
 
     bool ignore_replacements = false;
     size_t new_scan_start = tokens.len;
     for (size_t i = 0; i < tokens.len;) {
-        if (sstr_macro_args_and_body_map_contains(&macro_map, tokens.data[i].token.name)
-        && !ignore_replacements
-        && !sstr_harr_contains(tokens.data[i].dont_replace.arr, tokens.data[i].token.name)
-        && i >= scan_start) {
-            const struct macro_args_and_body macro_info = sstr_macro_args_and_body_map_get(&macro_map, tokens.data[i].token.name);
-            const struct macro_use_info use_info = get_macro_use_info(tokens, i, macro_info);
+        const struct macro_args_and_body *macro_info_p;
+        if (!ignore_replacements
+        && i >= scan_start
+        && tokens.data[i].token.ident != NO_IDENT
+        && (macro_info_p = find_macro(&macro_map, tokens.data[i].token.ident)) != NULL
+        && !ident_id_harr_contains(tokens.data[i].dont_replace.arr, tokens.data[i].token.ident)) {
+            const struct macro_args_and_body macro_info = *macro_info_p;
+            const struct macro_use_info use_info = get_macro_use_info(tokens, i, macro_info, file);
             if (!use_info.is_valid) {
                 token_with_ignore_list_vec_append(&out, tokens.data[i]);
                 i++;
                 continue;
             }
-            const token_with_ignore_list_vec replaced_tokens = get_replacement(macro_info, use_info, macro_map, exclude_concatenation_type);
+            const token_with_ignore_list_vec replaced_tokens = get_replacement(macro_info, use_info, macro_map, exclude_concatenation_type, file);
             token_with_ignore_list_vec_append_all(&out, replaced_tokens);
             new_scan_start = i;
             i = use_info.end_index;
@@ -562,21 +585,21 @@ static token_with_ignore_list_harr replace_macros_helper(const token_with_ignore
     if (new_scan_start == tokens.len) {
         return out.arr;
     } else {
-        return replace_macros_helper(out.arr, new_scan_start, macro_map, exclude_concatenation_type);
+        return replace_macros_helper(out.arr, new_scan_start, macro_map, exclude_concatenation_type, file);
     }
 }
 
-pp_token_harr replace_macros(const pp_token_harr tokens, const sstr_macro_args_and_body_map macro_map,  const enum exclude_from_detection exclude_concatenation_type) {
+pp_token_harr replace_macros(const pp_token_harr tokens, const ident_id_macro_args_and_body_map macro_map,  const enum exclude_from_detection exclude_concatenation_type, const struct diagnostic_file *const file) {
     token_with_ignore_list_vec tokens_with_ignore_list = token_with_ignore_list_vec_new(tokens.len);
     for (size_t i = 0; i < tokens.len; i++) {
-        if (!token_is_str(tokens.data[i], "\n")) {
+        if (tokens.data[i].kind != TOKEN_NEWLINE) {
             token_with_ignore_list_vec_append(&tokens_with_ignore_list, (struct token_with_ignore_list) {
                     .token = tokens.data[i],
-                    .dont_replace = sstr_vec_new(0)
+                    .dont_replace = ident_id_vec_new(0)
             });
         }
     }
-    const token_with_ignore_list_harr replaced = replace_macros_helper(tokens_with_ignore_list.arr, 0, macro_map, exclude_concatenation_type);
+    const token_with_ignore_list_harr replaced = replace_macros_helper(tokens_with_ignore_list.arr, 0, macro_map, exclude_concatenation_type, file);
     pp_token_vec out = pp_token_vec_new(replaced.len);
     for (size_t i = 0; i < replaced.len; i++) {
         if (replaced.data[i].token.name.len > 0) { // remove placemarkers
@@ -589,64 +612,68 @@ pp_token_harr replace_macros(const pp_token_harr tokens, const sstr_macro_args_a
 
 void reconstruct_macro_use(const struct macro_use_info info) {
     // Print the macro name
-    printf("Macro use: %.*s", (int)info.macro_name.len, (const char*)info.macro_name.data);
+    const sstr macro_name = ident_spelling(info.macro_name);
+    fprintf(trace_file(), "Macro use: %.*s", (int)macro_name.len, (const char*)macro_name.data);
 
     // If the macro is function-like and there are arguments, print them within parentheses
     if (info.is_function_like) {
-        printf("(");
+        fprintf(trace_file(), "(");
         for (size_t i = 0; i < info.args.len; i++) {
             // Print each argument
             for (size_t j = 0; j < info.args.data[i].len; j++) {
                 if (info.args.data[i].data[j].token.after_whitespace && j != 0) {
-                    printf(" ");
+                    fprintf(trace_file(), " ");
                 }
-                printf("%.*s", (int)info.args.data[i].data[j].token.name.len, (const char*)info.args.data[i].data[j].token.name.data);
+                fprintf(trace_file(), "%.*s", (int)info.args.data[i].data[j].token.name.len, (const char*)info.args.data[i].data[j].token.name.data);
             }
             if (i < info.args.len - 1) {
-                printf(", ");
+                fprintf(trace_file(), ", ");
             }
         }
-        printf(")");
-        printf(" - Number of arguments given: %zu", info.args.len);
+        fprintf(trace_file(), ")");
+        fprintf(trace_file(), " - Number of arguments given: %zu", info.args.len);
     }
-    printf("\n");
+    fprintf(trace_file(), "\n");
 }
 
 
-void print_macros(const sstr_macro_args_and_body_map *const macros) {
+void print_macros(const ident_id_macro_args_and_body_map *const macros) {
     for (size_t i = 0; i < macros->n_buckets; i++) {
-        const NODE_T(sstr, macro_args_and_body) *node = macros->buckets[i];
+        const NODE_T(ident_id, macro_args_and_body) *node = macros->buckets[i];
         while (node != NULL) {
-            printf("Macro: ");
-            for (size_t j = 0; j < node->key.len; j++) {
-                printf("%c", node->key.data[j]);
+            const sstr name = ident_spelling(node->key);
+            fprintf(trace_file(), "Macro: %.*s", (int)name.len, (const char*)name.data);
+
+            if (node->value.pch != NULL) {
+                fprintf(trace_file(), " (not read from the PCH yet)\n");
+                node = node->next;
+                continue;
             }
 
             if (node->value.is_function_like) {
-                printf("(");
+                fprintf(trace_file(), "(");
                 for (size_t arg_index = 0; arg_index < node->value.args.len; arg_index++) {
-                    for (size_t k = 0; k < node->value.args.data[arg_index].len; k++) {
-                        printf("%c", node->value.args.data[arg_index].data[k]);
-                    }
+                    const sstr arg_name = ident_spelling(node->value.args.data[arg_index]);
+                    fprintf(trace_file(), "%.*s", (int)arg_name.len, (const char*)arg_name.data);
                     if (arg_index < node->value.args.len - 1 || node->value.accepts_varargs) {
-                        printf(", ");
+                        fprintf(trace_file(), ", ");
                     }
                 }
                 if (node->value.accepts_varargs) {
-                    printf("...");
+                    fprintf(trace_file(), "...");
                 }
-                printf(")");
+                fprintf(trace_file(), ")");
             }
 
-            printf(" -> ");
+            fprintf(trace_file(), " -> ");
             for (size_t j = 0; j < node->value.replacements.len; j++) {
                 const struct preprocessing_token token = node->value.replacements.data[j];
-                if (token.after_whitespace && j != 0) printf(" ");
+                if (token.after_whitespace && j != 0) fprintf(trace_file(), " ");
                 for (size_t k = 0; k < token.name.len; k++) {
-                    printf("%c", token.name.data[k]);
+                    fprintf(trace_file(), "%c", token.name.data[k]);
                 }
             }
-            printf("\n");
+            fprintf(trace_file(), "\n");
             node = node->next;
         }
     }
@@ -2,10 +2,113 @@
 #include "preprocessor/diagnostics.h"
 #include "preprocessor/macro_expansion.h"
 #include "preprocessor/conditional_inclusion.h"
+#include "data_structures/map.h"
 #include "data_structures/vector.h"
 #include "debug/color_print.h"
+#include "debug/trace.h"
 
-static erule_p_harr get_earley_rules(const struct production_rule *const rule, const erule_p_harr *const origin) {
+typedef const struct production_rule *production_rule_p;
+
+static size_t hash_production_rule_p(const production_rule_p rule, const size_t n_buckets) {
+    return ((uintptr_t)rule >> 4) % n_buckets;
+}
+
+static bool production_rule_ps_eq(const production_rule_p rule1, const production_rule_p rule2) {
+    return rule1 == rule2;
+}
+
+// The lists are kept behind pointers because the map copies its values when it grows, and complete can add to the
+// list it's looping over
+DEFINE_MAP_TYPE_AND_FUNCTIONS(production_rule_p, erule_p_vec_p, hash_production_rule_p, production_rule_ps_eq)
+
+// Open addressing, with NULL in the empty slots. The number of slots is a power of 2, and at most half are used.
+struct item_set {
+    erule_p *slots;
+    size_t n_slots;
+    size_t n_items;
+};
+
+/*
+ * The items of a chart, in the order they were added, and two indexes over them: the set of items, to spot duplicates
+ * while the chart is being built, and for each nonterminal, the items that have it after their dot, which are the ones
+ * a completed item of that nonterminal with this chart as its origin advances.
+ */
+struct earley_chart {
+    erule_p_vec items;
+    struct item_set seen; // freed once the chart is built
+    production_rule_p_erule_p_vec_p_map waiting;
+};
+
+static bool is_completed(const struct earley_rule rule) {
+    return rule.dot == rule.rhs.symbols.len;
+}
+
+// Items are the same if they have the same rule, alternative, dot and origin, even if they were completed from different items
+static bool same_item(const struct earley_rule *const item1, const struct earley_rule *const item2) {
+    return item1->lhs == item2->lhs
+        && item1->rhs.tag == item2->rhs.tag
+        && item1->dot == item2->dot
+        && item1->origin_chart == item2->origin_chart;
+}
+
+static size_t hash_item(const struct earley_rule *const item) {
+    uint64_t hash = (uintptr_t)item->lhs;
+    hash = hash * 31 + (uint64_t)item->rhs.tag;
+    hash = hash * 31 + item->dot;
+    hash = hash * 31 + (uintptr_t)item->origin_chart;
+    hash ^= hash >> 32;
+    return (size_t)(hash * 0x9e3779b97f4a7c15u >> 32);
+}
+
+// The slot that item (or an item that's the same) is in, or the empty slot it would go in
+static size_t find_item_slot(const struct item_set *const set, const struct earley_rule *const item) {
+    const size_t mask = set->n_slots - 1;
+    for (size_t i = hash_item(item) & mask;; i = (i + 1) & mask) {
+        if (set->slots[i] == NULL || same_item(set->slots[i], item)) return i;
+    }
+}
+
+static struct item_set item_set_new(const size_t n_slots) {
+    struct item_set set = { .slots = MALLOC(n_slots * sizeof(erule_p)), .n_slots = n_slots, .n_items = 0 };
+    memset(set.slots, 0, n_slots * sizeof(erule_p));
+    return set;
+}
+
+// Returns false, and doesn't add item, if an item that's the same is already in the set
+static bool item_set_add(struct item_set *const set, struct earley_rule *const item) {
+    if (2 * (set->n_items + 1) > set->n_slots) {
+        struct item_set bigger = item_set_new(set->n_slots * 2);
+        for (size_t i = 0; i < set->n_slots; i++) {
+            if (set->slots[i] != NULL) bigger.slots[find_item_slot(&bigger, set->slots[i])] = set->slots[i];
+        }
+        bigger.n_items = set->n_items;
+        FREE(set->slots);
+        *set = bigger;
+    }
+    const size_t slot = find_item_slot(set, item);
+    if (set->slots[slot] != NULL) return false;
+    set->slots[slot] = item;
+    set->n_items++;
+    return true;
+}
+
+static struct earley_chart *chart_new(void) {
+    struct earley_chart *const chart = MALLOC(sizeof(struct earley_chart));
+    *chart = (struct earley_chart) {
+        .items = erule_p_vec_new(0),
+        .seen = item_set_new(16),
+        .waiting = production_rule_p_erule_p_vec_p_map_new(8)
+    };
+    return chart;
+}
+
+// Called once nothing more will be added to the chart
+static void chart_finish(struct earley_chart *const chart) {
+    FREE(chart->seen.slots);
+    chart->seen = (struct item_set) { .slots = NULL, .n_slots = 0, .n_items = 0 };
+}
+
+static erule_p_harr get_earley_rules(const struct production_rule *const rule, const struct earley_chart *const origin) {
     erule_p_vec out = erule_p_vec_new(rule->alternatives.len);
     for (size_t i = 0; i < rule->alternatives.len; i ++) {
         struct earley_rule *const to_append = MALLOC(sizeof(struct earley_rule));
@@ -21,54 +124,72 @@ static void print_rule(struct earley_rule rule);
 
 static struct symbol symbol_after_dot(const struct earley_rule rule) {
     if (rule.dot >= rule.rhs.symbols.len) {
-        preprocessor_fatal_error(0, 0, 0, "out of bounds array access in symbol_after_dot");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "out of bounds array access in symbol_after_dot");
     }
     return rule.rhs.symbols.data[rule.dot];
 }
 
-static erule_p_harr predict(const struct earley_rule rule, const erule_p_harr *const rule_chart) {
+static erule_p_harr predict(const struct earley_rule rule, const struct earley_chart *const rule_chart) {
     if (rule.dot == rule.rhs.symbols.len || symbol_after_dot(rule).is_terminal) {
         return (erule_p_harr) { .data = NULL, .len = 0 };
     } else {
         const erule_p_harr out = get_earley_rules(symbol_after_dot(rule).val.rule, rule_chart);
-        for (size_t i = 0; i < out.len; i++) {
-            print_with_color(TEXT_COLOR_LIGHT_BLUE, "{predictor} ");
-            print_rule(*out.data[i]);
-            print_with_color(TEXT_COLOR_LIGHT_CYAN, " {source:} ");
-            print_rule(rule);
-            printf("\n");
+        if (TRACING(EARLEY, TRACE_DETAILED)) {
+            for (size_t i = 0; i < out.len; i++) {
+                print_with_color(TEXT_COLOR_LIGHT_BLUE, "{predictor} ");
+                print_rule(*out.data[i]);
+                print_with_color(TEXT_COLOR_LIGHT_CYAN, " {source:} ");
+                print_rule(rule);
+                fprintf(trace_file(), "\n");
+            }
         }
         return out;
     }
 }
 
-static bool rule_is_duplicate(const erule_p_harr rules, const struct earley_rule rule) {
-    for (size_t i = 0; i < rules.len; i++) {
-        if (rule.lhs == rules.data[i]->lhs // Left hand rule is the same
-        && rule.rhs.tag == rules.data[i]->rhs.tag  // Alternative is the same
-        && rule.dot == rules.data[i]->dot // Dot is in the same place
-        && rule.origin_chart == rules.data[i]->origin_chart // Same origin
-        ) {
-            return true;
+// Adds item to the chart and its indexes, unless an item that's the same is already there
+static bool chart_add(struct earley_chart *const chart, struct earley_rule *const item) {
+    if (!item_set_add(&chart->seen, item)) return false;
+    erule_p_vec_append(&chart->items, item);
+    if (!is_completed(*item) && !symbol_after_dot(*item).is_terminal) {
+        const production_rule_p awaited = symbol_after_dot(*item).val.rule;
+        erule_p_vec_p *const waiting = production_rule_p_erule_p_vec_p_map_get_ptr(&chart->waiting, awaited);
+        if (waiting != NULL) {
+            erule_p_vec_append(*waiting, item);
+        } else {
+            erule_p_vec *const new_waiting = MALLOC(sizeof(erule_p_vec));
+            *new_waiting = erule_p_vec_new(1);
+            erule_p_vec_append(new_waiting, item);
+            production_rule_p_erule_p_vec_p_map_add(&chart->waiting, awaited, new_waiting);
         }
     }
-    return false;
+    return true;
 }
 
-static void recursively_predict(const struct earley_rule rule, erule_p_vec *const rule_chart) {
-    const erule_p_harr first_predictions = predict(rule, &rule_chart->arr);
-    for (size_t i = 0; i < first_predictions.len; i++) {
-        struct earley_rule *const predict_from = MALLOC(sizeof(struct earley_rule));
-        *predict_from = *first_predictions.data[i];
-        if (!rule_is_duplicate(rule_chart->arr, *predict_from)) {
-            erule_p_vec_append(rule_chart, predict_from);
-            recursively_predict(*predict_from, rule_chart);
+// Adds the predictions for rule to the chart, then theirs, and so on, depth first
+static void predict_all(const struct earley_rule rule, struct earley_chart *const rule_chart) {
+    const erule_p_harr first_predictions = predict(rule, rule_chart);
+    if (first_predictions.len == 0) return;
+    // An explicit stack rather than recursion, since a grammar can nest deep enough to overflow the C stack.
+    // Predictions are pushed in reverse, so they're added in the same order a recursive version would add them.
+    erule_p_vec to_add = erule_p_vec_new(first_predictions.len);
+    for (size_t i = first_predictions.len; i > 0; i--) {
+        erule_p_vec_append(&to_add, first_predictions.data[i - 1]);
+    }
+    FREE(first_predictions.data);
+    while (to_add.arr.len > 0) {
+        struct earley_rule *const prediction = to_add.arr.data[--to_add.arr.len];
+        if (!chart_add(rule_chart, prediction)) {
+            FREE(prediction);
+            continue;
+        }
+        const erule_p_harr next_predictions = predict(*prediction, rule_chart);
+        for (size_t i = next_predictions.len; i > 0; i--) {
+            erule_p_vec_append(&to_add, next_predictions.data[i - 1]);
         }
+        FREE(next_predictions.data);
     }
-}
-
-static bool is_completed(const struct earley_rule rule) {
-    return rule.dot == rule.rhs.symbols.len;
+    erule_p_vec_free_internals(&to_add);
 }
 
 static bool check_terminal(const struct symbol sym, const struct preprocessing_token token) {
@@ -76,49 +197,60 @@ static bool check_terminal(const struct symbol sym, const struct preprocessing_t
         switch(sym.val.terminal.type) {
             case TERMINAL_FN:
                 return sym.val.terminal.matcher.fn(token);
-            case TERMINAL_STR:
-                return token_is_str(token, (const char*)sym.val.terminal.matcher.str);
+            case TERMINAL_KIND:
+                return token.kind == sym.val.terminal.matcher.kind;
+            case TERMINAL_IDENT:
+                return token.ident == sym.val.terminal.matcher.ident;
         }
     } else {
         return false;
     }
 }
 
-static void complete(struct earley_rule *const rule, erule_p_vec *const out) {
+static void complete(struct earley_rule *const rule, struct earley_chart *const out) {
     if (!is_completed(*rule)) {
         return;
     }
-    for (size_t i = 0; i < rule->origin_chart->len; i++) {
-        const struct earley_rule possible_origin = *rule->origin_chart->data[i];
-        if (!is_completed(possible_origin) && !symbol_after_dot(possible_origin).is_terminal && symbol_after_dot(possible_origin).val.rule == rule->lhs) {
-            erule_p_vec new_completed_from = erule_p_vec_new(possible_origin.completed_from.len + 1);
-            erule_p_vec_append_all_harr(&new_completed_from, possible_origin.completed_from);
-            erule_p_vec_append(&new_completed_from, rule);
-            struct earley_rule *const to_append = MALLOC(sizeof(struct earley_rule));
-            *to_append = (struct earley_rule) {
-                    .lhs=possible_origin.lhs, .rhs=possible_origin.rhs, .dot=possible_origin.dot + 1,
-                    .origin_chart=possible_origin.origin_chart, .completed_from=new_completed_from.arr
-            };
-            if (!rule_is_duplicate(out->arr, *to_append)) {
-                erule_p_vec_append(out, to_append);
-                print_with_color(TEXT_COLOR_LIGHT_GREEN, "{completer} ");
-                print_rule(*to_append);
-                print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{trigger:} ");
-                print_rule(*rule);
-                print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{origin:} ");
-                print_rule(possible_origin);
-                print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{completed from:} ");
-                for (size_t j = 0; j < to_append->completed_from.len; j++) {
-                    printf("\n\t\t");
-                    print_rule(*to_append->completed_from.data[j]);
-                }
-                printf("\n");
+    const erule_p_vec_p *const waiting_p = production_rule_p_erule_p_vec_p_map_get_ptr(&rule->origin_chart->waiting, rule->lhs);
+    if (waiting_p == NULL) {
+        return;
+    }
+    // If the origin is out, the list can grow while it's looped over, and the items added to it are advanced too
+    const erule_p_vec *const waiting = *waiting_p;
+    for (size_t i = 0; i < waiting->arr.len; i++) {
+        const struct earley_rule possible_origin = *waiting->arr.data[i];
+        erule_p_vec new_completed_from = erule_p_vec_new(possible_origin.completed_from.len + 1);
+        erule_p_vec_append_all_harr(&new_completed_from, possible_origin.completed_from);
+        erule_p_vec_append(&new_completed_from, rule);
+        struct earley_rule *const to_append = MALLOC(sizeof(struct earley_rule));
+        *to_append = (struct earley_rule) {
+                .lhs=possible_origin.lhs, .rhs=possible_origin.rhs, .dot=possible_origin.dot + 1,
+                .origin_chart=possible_origin.origin_chart, .completed_from=new_completed_from.arr,
+                .owns_symbols=false, .owns_completed_from=true
+        };
+        if (!chart_add(out, to_append)) {
+            erule_p_vec_free_internals(&new_completed_from);
+            FREE(to_append);
+            continue;
+        }
+        if (TRACING(EARLEY, TRACE_DETAILED)) {
+            print_with_color(TEXT_COLOR_LIGHT_GREEN, "{completer} ");
+            print_rule(*to_append);
+            print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{trigger:} ");
+            print_rule(*rule);
+            print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{origin:} ");
+            print_rule(possible_origin);
+            print_with_color(TEXT_COLOR_LIGHT_CYAN, "\n\t{completed from:} ");
+            for (size_t j = 0; j < to_append->completed_from.len; j++) {
+                fprintf(trace_file(), "\n\t\t");
+                print_rule(*to_append->completed_from.data[j]);
             }
+            fprintf(trace_file(), "\n");
         }
     }
 }
 
-static void scan(const struct earley_rule rule, const struct preprocessing_token token, erule_p_vec *const out) {
+static void scan(const struct earley_rule rule, const struct preprocessing_token token, struct earley_chart *const out) {
     if (is_completed(rule) || !symbol_after_dot(rule).is_terminal || !check_terminal(symbol_after_dot(rule), token)) {
         return;
     }
@@ -134,27 +266,35 @@ static void scan(const struct earley_rule rule, const struct preprocessing_token
     scanned_rule->rhs.symbols.data[scanned_rule->dot - 1].val.terminal.token = token;
     // Mark that terminal as containing a token
     scanned_rule->rhs.symbols.data[scanned_rule->dot - 1].val.terminal.is_filled = true;
+    // The symbols are its own, but completed_from is still the old rule's
+    scanned_rule->owns_symbols = true;
+    scanned_rule->owns_completed_from = false;
+
+    if (TRACING(EARLEY, TRACE_DETAILED)) {
+        print_with_color(TEXT_COLOR_YELLOW, "{scanner} ");
+        print_rule(*scanned_rule);
+        fprintf(trace_file(), "\n");
+    }
 
-    print_with_color(TEXT_COLOR_YELLOW, "{scanner} ");
-    print_rule(*scanned_rule);
-    printf("\n");
-
-    erule_p_vec_append(out, scanned_rule);
+    if (!chart_add(out, scanned_rule)) {
+        FREE(scanned_rule->rhs.symbols.data);
+        FREE(scanned_rule);
+    }
 }
 
-static erule_p_vec *next_chart(const erule_p_vec *const old_chart, const struct preprocessing_token token) {
-    erule_p_vec *const out = MALLOC(sizeof(erule_p_vec));
-    *out = erule_p_vec_new(0);
+static struct earley_chart *next_chart(const struct earley_chart *const old_chart, const struct preprocessing_token token) {
+    struct earley_chart *const out = chart_new();
     // Scan
-    for (size_t i = 0; i < old_chart->arr.len; i++) {
-        scan(*old_chart->arr.data[i], token, out);
+    for (size_t i = 0; i < old_chart->items.arr.len; i++) {
+        scan(*old_chart->items.arr.data[i], token, out);
     }
     // Complete and predict in a loop
-    for (size_t i = 0; i < out->arr.len; i++) {
-        struct earley_rule *const rule = out->arr.data[i];
+    for (size_t i = 0; i < out->items.arr.len; i++) {
+        struct earley_rule *const rule = out->items.arr.data[i];
         complete(rule, out);
-        recursively_predict(*rule, out);
+        predict_all(*rule, out);
     }
+    chart_finish(out);
 
     return out;
 }
@@ -166,25 +306,30 @@ static void print_symbol(const struct symbol sym) {
     if (sym.is_terminal) {
         switch (sym.val.terminal.type) {
             case TERMINAL_FN:
-                printf("[function] ");
+                fprintf(trace_file(), "[function] ");
                 if (sym.val.terminal.is_filled) {
-                    printf("(filled: ");
+                    fprintf(trace_file(), "(filled: ");
                     set_color(TEXT_COLOR_GREEN);
                     print_token(sym.val.terminal.token);
                     clear_color();
-                    printf(") ");
+                    fprintf(trace_file(), ") ");
                 }
                 break;
-            case TERMINAL_STR:
-                if (strcmp("\n", (const char *)sym.val.terminal.matcher.str) == 0) {
+            case TERMINAL_KIND:
+                if (sym.val.terminal.matcher.kind == TOKEN_NEWLINE) {
                     print_with_color(TEXT_COLOR_GREEN, "[newline] ");
                 } else {
-                    print_with_color(TEXT_COLOR_GREEN, "%s ", (const char*)sym.val.terminal.matcher.str);
+                    print_with_color(TEXT_COLOR_GREEN, "%s ", token_kind_spelling(sym.val.terminal.matcher.kind));
                 }
                 break;
+            case TERMINAL_IDENT: {
+                const sstr spelling = ident_spelling(sym.val.terminal.matcher.ident);
+                print_with_color(TEXT_COLOR_GREEN, "%.*s ", (int)spelling.len, (const char*)spelling.data);
+                break;
+            }
         }
     } else {
-        printf("%s ", sym.val.rule->name);
+        fprintf(trace_file(), "%s ", sym.val.rule->name);
     }
 }
 
@@ -199,7 +344,7 @@ pp_token_harr pp_tokens_rule_as_harr(const struct earley_rule pp_tokens_rule) {
 }
 
 static void print_rule(const struct earley_rule rule) {
-    printf("%s -> ", rule.lhs->name);
+    fprintf(trace_file(), "%s -> ", rule.lhs->name);
     for (size_t i = 0; i < rule.rhs.symbols.len; i++) {
         if (rule.dot == i) {
             print_with_color(TEXT_COLOR_LIGHT_PURPLE, "• ");
@@ -215,59 +360,86 @@ void print_chart(const erule_p_harr *const chart) {
     for (size_t i = 0; i < chart->len; i++) {
         const struct earley_rule rule = *chart->data[i];
         print_rule(rule);
-        printf("\n");
+        fprintf(trace_file(), "\n");
     }
 }
 
 static void print_token(const struct preprocessing_token token) {
     for (size_t j = 0; j < token.name.len; j++) {
         if (token.name.data[j] == '\n') {
-            printf("[newline]");
+            fprintf(trace_file(), "[newline]");
         } else {
-            printf("%c", token.name.data[j]);
+            fprintf(trace_file(), "%c", token.name.data[j]);
         }
     }
 }
 
-erule_p_harr_p_harr make_charts(const pp_token_harr tokens, const struct production_rule *const start_rule) {
+struct chart_builder {
+    erule_p_harr_p_vec charts;
+    const struct earley_chart *last_chart;
+};
+
+static struct chart_builder start_charts(const struct production_rule *const start_rule) {
     erule_p_harr_p_vec out = erule_p_harr_p_vec_new(0);
 
-    erule_p_vec *const initial_chart = MALLOC(sizeof(struct erule_p_vec));
-    *initial_chart = erule_p_vec_new(1);
-    erule_p_harr_p_vec_append(&out, &initial_chart->arr);
+    struct earley_chart *const initial_chart = chart_new();
+    erule_p_harr_p_vec_append(&out, &initial_chart->items.arr);
 
     for (size_t i = 0; i < start_rule->alternatives.len; i++) {
         struct earley_rule *const rule = MALLOC(sizeof(struct earley_rule));
         *rule = (struct earley_rule) {
-            .lhs=start_rule, .rhs=start_rule->alternatives.data[i], .dot=0, .origin_chart=&initial_chart->arr /* sketchy */, .completed_from={.data = NULL, .len = 0}
+            .lhs=start_rule, .rhs=start_rule->alternatives.data[i], .dot=0, .origin_chart=initial_chart, .completed_from={.data = NULL, .len = 0}
         };
-        erule_p_vec_append(initial_chart, rule);
+        chart_add(initial_chart, rule);
     }
 
-    print_with_color(TEXT_COLOR_LIGHT_RED, "\nInitial Chart:\n");
-    print_chart(&initial_chart->arr);
+    if (TRACING(EARLEY, TRACE_DETAILED)) {
+        print_with_color(TEXT_COLOR_LIGHT_RED, "\nInitial Chart:\n");
+        print_chart(&initial_chart->items.arr);
+    }
 
-    for (size_t i = 0; i < initial_chart->arr.len; i++) {
-        struct earley_rule *const rule = initial_chart->arr.data[i];
+    for (size_t i = 0; i < initial_chart->items.arr.len; i++) {
+        struct earley_rule *const rule = initial_chart->items.arr.data[i];
         complete(rule, initial_chart);
-        recursively_predict(*rule, initial_chart);
+        predict_all(*rule, initial_chart);
     }
+    chart_finish(initial_chart);
+    return (struct chart_builder) { .charts = out, .last_chart = initial_chart };
+}
 
-    const erule_p_vec *old_chart = initial_chart;
-    for (size_t i = 0; i < tokens.len; i++) {
-        const struct preprocessing_token token = tokens.data[i];
+// Adds the chart after the i-th token, which is token
+static void add_chart(struct chart_builder *const builder, const size_t i, const struct preprocessing_token token) {
+    if (TRACING(EARLEY, TRACE_DETAILED)) {
         print_with_color(TEXT_COLOR_RED, "\nChart after processing token %zu (", i);
         set_color(TEXT_COLOR_GREEN);
         print_token(token);
         clear_color();
         print_with_color(TEXT_COLOR_RED, "):\n");
-        erule_p_vec *const new_chart = next_chart(old_chart, tokens.data[i]);
-        erule_p_harr_p_vec_append(&out, &new_chart->arr);
-        old_chart = new_chart;
     }
-    printf("\n");
+    struct earley_chart *const new_chart = next_chart(builder->last_chart, token);
+    erule_p_harr_p_vec_append(&builder->charts, &new_chart->items.arr);
+    builder->last_chart = new_chart;
+}
+
+erule_p_harr_p_harr make_charts(const pp_token_harr tokens, const struct production_rule *const start_rule) {
+    struct chart_builder builder = start_charts(start_rule);
+    for (size_t i = 0; i < tokens.len; i++) {
+        add_chart(&builder, i, tokens.data[i]);
+    }
+    if (TRACING(EARLEY, TRACE_DETAILED)) fprintf(trace_file(), "\n");
 
-    return out.arr;
+    return builder.charts.arr;
+}
+
+// Like make_charts, but reads the tokens straight from a stream
+static erule_p_harr_p_harr make_charts_from_stream(const struct token_stream *const tokens, const struct production_rule *const start_rule) {
+    struct chart_builder builder = start_charts(start_rule);
+    for (token_handle i = 0; i < tokens->len; i++) {
+        add_chart(&builder, i, token_stream_get(tokens, i));
+    }
+    if (TRACING(EARLEY, TRACE_DETAILED)) fprintf(trace_file(), "\n");
+
+    return builder.charts.arr;
 }
 
 static void flatten_list_rules(struct earley_rule *root);
@@ -307,7 +479,8 @@ static void flatten_list_rules(struct earley_rule *const root) {
     if (root->lhs->is_list_rule) { // TODO autodetect list rules
         const erule_p_harr old_completed_from = root->completed_from;
         root->completed_from = flatten_list_rule(*root);
-        FREE(old_completed_from.data);
+        if (root->owns_completed_from) FREE(old_completed_from.data);
+        root->owns_completed_from = true;
     }
     for (size_t i = 0; i < root->completed_from.len; i++) {
         flatten_list_rules(root->completed_from.data[i]);
@@ -325,24 +498,88 @@ void print_tree(const struct earley_rule *const root, const size_t indent) {
         print_with_color(colors[i % num_colors], ".\t");
     }
     print_rule(*root);
-    printf("\n");
+    fprintf(trace_file(), "\n");
     for (size_t i = 0; i < root->completed_from.len; i++) {
         print_tree(root->completed_from.data[i], indent + 1);
     }
 }
 
+static struct earley_rule *finish_parse(const erule_p_harr_p_harr charts, const struct production_rule *root_rule) {
+    if (TRACING(EARLEY, TRACE_BASIC)) {
+        for (size_t i = 0; i < charts.len; i++) {
+            print_with_color(TEXT_COLOR_LIGHT_RED, "Chart %zu:\n", i);
+            print_chart(charts.data[i]);
+        }
+        fprintf(trace_file(), "\n");
+    }
+
+    return get_tree_root(charts, root_rule);
+}
+
 struct earley_rule *parse(const pp_token_harr tokens, const struct production_rule *root_rule) {
-    print_with_color(TEXT_COLOR_LIGHT_RED, "Parsing with root rule %s\n", root_rule->name);
-    const erule_p_harr_p_harr charts = make_charts(tokens, root_rule);
+    if (TRACING(EARLEY, TRACE_BASIC)) print_with_color(TEXT_COLOR_LIGHT_RED, "Parsing with root rule %s\n", root_rule->name);
+    return finish_parse(make_charts(tokens, root_rule), root_rule);
+}
+
+struct earley_rule *parse_full_file(const struct token_stream *const tokens, erule_p_harr_p_harr *const charts) {
+    if (TRACING(EARLEY, TRACE_BASIC)) print_with_color(TEXT_COLOR_LIGHT_RED, "Parsing with root rule %s\n", tr_preprocessing_file.name);
+    *charts = make_charts_from_stream(tokens, &tr_preprocessing_file);
+    return finish_parse(*charts, &tr_preprocessing_file);
+}
+
+// The chart that items are the items of
+static struct earley_chart *chart_of(erule_p_harr *const items) {
+    return (struct earley_chart *)(void *)((unsigned char *)items - offsetof(struct earley_chart, items.arr));
+}
+
+void free_charts(const erule_p_harr_p_harr charts) {
     for (size_t i = 0; i < charts.len; i++) {
-        print_with_color(TEXT_COLOR_LIGHT_RED, "Chart %zu:\n", i);
-        print_chart(charts.data[i]);
+        struct earley_chart *const chart = chart_of(charts.data[i]);
+        for (size_t j = 0; j < chart->items.arr.len; j++) {
+            struct earley_rule *const item = chart->items.arr.data[j];
+            if (item->owns_symbols) FREE(item->rhs.symbols.data);
+            if (item->owns_completed_from) FREE(item->completed_from.data);
+            FREE(item);
+        }
+        erule_p_vec_free_internals(&chart->items);
+        for (size_t j = 0; j < chart->waiting.n_buckets; j++) {
+            for (const NODE_T(production_rule_p, erule_p_vec_p) *node = chart->waiting.buckets[j]; node != NULL; node = node->next) {
+                erule_p_vec_free_internals(node->value);
+                FREE(node->value);
+            }
+        }
+        production_rule_p_erule_p_vec_p_map_free_internals(&chart->waiting);
+        FREE(chart->waiting.buckets);
+        FREE(chart);
     }
-    printf("\n");
+    FREE(charts.data);
+}
 
-    return get_tree_root(charts, root_rule);
+token_handle find_parse_failure(const struct token_stream *const tokens) {
+    const erule_p_harr_p_harr charts = make_charts_from_stream(tokens, &tr_preprocessing_file);
+    // The chart after each token holds every parse that can go on past it
+    token_handle failure = tokens->len > 0 ? (token_handle)(tokens->len - 1) : 0;
+    for (size_t i = 1; i < charts.len; i++) {
+        if (charts.data[i]->len == 0) {
+            failure = (token_handle)(i - 1);
+            break;
+        }
+    }
+    free_charts(charts);
+    return failure;
 }
 
-struct earley_rule *parse_full_file(const pp_token_harr tokens) {
-    return parse(tokens, &tr_preprocessing_file);
+bool rule_first_token(const struct earley_rule *const rule, struct preprocessing_token *const out) {
+    // Each nonterminal symbol was completed from the next rule in completed_from (for a list rule, the first one is
+    // its first element)
+    size_t n_rules_seen = 0;
+    for (size_t i = 0; i < rule->rhs.symbols.len; i++) {
+        const symbol sym = rule->rhs.symbols.data[i];
+        if (sym.is_terminal) {
+            *out = sym.val.terminal.token;
+            return true;
+        }
+        if (n_rules_seen < rule->completed_from.len && rule_first_token(rule->completed_from.data[n_rules_seen++], out)) return true;
+    }
+    return false;
 }
@@ -3,18 +3,20 @@
 
 #include "data_structures/vector.h"
 #include "preprocessor/pp_token.h"
+#include "preprocessor/token_stream.h"
 #include <stddef.h>
 #include <stdbool.h>
 #include <ctype.h>
 
 enum terminal_symbol_type {
-    TERMINAL_FN, TERMINAL_STR
+    TERMINAL_FN, TERMINAL_KIND, TERMINAL_IDENT
 };
 
 struct terminal {
     union {
         bool (*fn)(struct preprocessing_token);
-        unsigned char *str;
+        enum token_kind kind; // a punctuator or a newline
+        ident_id ident; // a directive name or a keyword
     } matcher;
     enum terminal_symbol_type type;
     struct preprocessing_token token;
@@ -44,6 +46,8 @@ struct production_rule {
     bool is_list_rule;
 };
 
+struct earley_chart; // a chart's items, and indexes over them
+
 typedef struct earley_rule *erule_p;
 DEFINE_VEC_TYPE_AND_FUNCTIONS(erule_p)
 
@@ -52,8 +56,11 @@ struct earley_rule {
     const struct production_rule *lhs;
     struct alternative rhs;
     size_t dot;  // if dot is n, then it's "behind" the symbol at index n (i.e. rhs.symbols.data[n])
-    const erule_p_harr *origin_chart;
+    const struct earley_chart *origin_chart;
     erule_p_harr completed_from;
+    // Items share these arrays with the item they were made from, unless they had to change them
+    bool owns_symbols;
+    bool owns_completed_from;
 };
 
 typedef erule_p_vec *erule_p_vec_p;
@@ -64,11 +71,25 @@ erule_p_harr_p_harr make_charts(pp_token_harr tokens, const struct production_ru
 
 pp_token_harr pp_tokens_rule_as_harr(struct earley_rule pp_tokens_rule);
 
+// These two write to the trace file
 void print_chart(const erule_p_harr *chart);
 void print_tree(const struct earley_rule *root, size_t indent);
 
 struct earley_rule *parse(pp_token_harr tokens, const struct production_rule *root_rule);
-struct earley_rule *parse_full_file(pp_token_harr tokens);
+/*
+ * Parses a whole file. The rules in the tree belong to the charts, which are put in *charts even if there's no parse;
+ * they can be freed with free_charts once the tree isn't needed anymore.
+ */
+struct earley_rule *parse_full_file(const struct token_stream *tokens, erule_p_harr_p_harr *charts);
+void free_charts(erule_p_harr_p_harr charts);
+/*
+ * Where parse_full_file gives up on tokens that don't parse: the first token that no parse can go on past, or the last
+ * token if they end too soon (e.g. before an #endif). Only meant for diagnostics, since it parses them all over again.
+ */
+token_handle find_parse_failure(const struct token_stream *tokens);
+
+// The first token a completed rule was made from; false if it was made from no tokens
+bool rule_first_token(const struct earley_rule *rule, struct preprocessing_token *out);
 
 extern const struct production_rule tr_preprocessing_file;
 extern const struct production_rule tr_group_opt;
@@ -0,0 +1,235 @@
+#include "pch.h"
+#include "debug/malloc.h"
+#include "driver/diagnostics.h"
+#include "driver/output_sink.h"
+#include <errno.h>
+#include <string.h>
+
+// FNV-1a; the string table sees every token spelling in the prefix, so it needs a better spread than hash_ssstr
+static size_t hash_string_table_key(const sstr str, const size_t n_buckets) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < str.len; i++) {
+        hash = (hash ^ str.data[i]) * 1099511628211u;
+    }
+    return (size_t)(hash % n_buckets);
+}
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(sstr, size_t, hash_string_table_key, sstrs_eq)
+
+struct pch_writer {
+    uchar_vec strings;
+    sstr_size_t_map string_offsets; // so each distinct string is only stored once
+    uchar_vec macros;
+    uchar_vec bodies;
+    uchar_vec tokens;
+};
+
+static void append_bytes(uchar_vec *const vec, const void *const data, const size_t len) {
+    uchar_vec_append_all_arr(vec, data, len);
+}
+
+static struct pch_string add_string(struct pch_writer *const writer, const sstr str) {
+    size_t offset;
+    if (sstr_size_t_map_contains(&writer->string_offsets, str)) {
+        offset = sstr_size_t_map_get(&writer->string_offsets, str);
+    } else {
+        offset = writer->strings.arr.len;
+        append_bytes(&writer->strings, str.data, str.len);
+        sstr_size_t_map_add(&writer->string_offsets, str, offset);
+    }
+    return (struct pch_string) { .offset = (uint32_t)offset, .len = (uint32_t)str.len };
+}
+
+static void append_token(struct pch_writer *const writer, uchar_vec *const dest, const struct preprocessing_token token) {
+    const struct pch_token record = {
+        .name = add_string(writer, token.name),
+        .type = (uint8_t)token.type,
+        .after_whitespace = token.after_whitespace,
+        .padding = {0, 0}
+    };
+    append_bytes(dest, &record, sizeof(record));
+}
+
+static void append_macro(struct pch_writer *const writer, const ident_id name, macro_args_and_body macro) {
+    if (macro.pch != NULL) pch_read_macro(&macro);
+    const struct pch_macro record = {
+        .name = add_string(writer, ident_spelling(name)),
+        .flags = (macro.is_function_like ? PCH_MACRO_FUNCTION_LIKE : 0) | (macro.accepts_varargs ? PCH_MACRO_ACCEPTS_VARARGS : 0),
+        .n_args = (uint32_t)macro.args.len,
+        .n_replacements = (uint32_t)macro.replacements.len,
+        .body_offset = (uint32_t)writer->bodies.arr.len // relative to the bodies for now; fixed up once the layout is known
+    };
+    append_bytes(&writer->macros, &record, sizeof(record));
+    for (size_t i = 0; i < macro.args.len; i++) {
+        const struct pch_string arg = add_string(writer, ident_spelling(macro.args.data[i]));
+        append_bytes(&writer->bodies, &arg, sizeof(arg));
+    }
+    for (size_t i = 0; i < macro.replacements.len; i++) {
+        append_token(writer, &writer->bodies, macro.replacements.data[i]);
+    }
+}
+
+void write_pch(const char *const fname, const ident_id_macro_args_and_body_map *const macros, const pp_token_harr tokens) {
+    struct pch_writer writer = {
+        .strings = uchar_vec_new(0),
+        .string_offsets = sstr_size_t_map_new(1024),
+        .macros = uchar_vec_new(0),
+        .bodies = uchar_vec_new(0),
+        .tokens = uchar_vec_new(0)
+    };
+    size_t n_macros = 0;
+    for (size_t i = 0; i < macros->n_buckets; i++) {
+        for (const NODE_T(ident_id, macro_args_and_body) *node = macros->buckets[i]; node != NULL; node = node->next) {
+            append_macro(&writer, node->key, node->value);
+            n_macros++;
+        }
+    }
+    for (size_t i = 0; i < tokens.len; i++) {
+        append_token(&writer, &writer.tokens, tokens.data[i]);
+    }
+
+    const size_t macros_offset = sizeof(struct pch_header);
+    const size_t bodies_offset = macros_offset + writer.macros.arr.len;
+    const size_t tokens_offset = bodies_offset + writer.bodies.arr.len;
+    const size_t strings_offset = tokens_offset + writer.tokens.arr.len;
+    if (strings_offset + writer.strings.arr.len > UINT32_MAX) {
+        driver_error("The prefix header is too big to be written to a PCH file.");
+    }
+    for (size_t i = 0; i < n_macros; i++) {
+        struct pch_macro *const record = (struct pch_macro *)(void *)&writer.macros.arr.data[i * sizeof(struct pch_macro)];
+        record->body_offset += (uint32_t)bodies_offset;
+    }
+    struct pch_header header = {
+        .n_macros = (uint32_t)n_macros,
+        .macros_offset = (uint32_t)macros_offset,
+        .n_tokens = (uint32_t)tokens.len,
+        .tokens_offset = (uint32_t)tokens_offset,
+        .strings_len = (uint32_t)writer.strings.arr.len,
+        .strings_offset = (uint32_t)strings_offset
+    };
+    memcpy(header.magic, PCH_MAGIC, sizeof(header.magic));
+
+    const int fd = open_output_file(fname);
+    if (fd == -1) {
+        driver_error("Couldn't open PCH file \"%s\". Errno: %d (%s).", fname, errno, strerror(errno));
+    }
+    struct output_sink sink = output_sink_new(fd);
+    output_sink_write(&sink, (const unsigned char *)&header, sizeof(header));
+    output_sink_write(&sink, writer.macros.arr.data, writer.macros.arr.len);
+    output_sink_write(&sink, writer.bodies.arr.data, writer.bodies.arr.len);
+    output_sink_write(&sink, writer.tokens.arr.data, writer.tokens.arr.len);
+    output_sink_write(&sink, writer.strings.arr.data, writer.strings.arr.len);
+    output_sink_free(&sink);
+    close_output_file(fd);
+
+    sstr_size_t_map_free_internals(&writer.string_offsets);
+    FREE(writer.strings.arr.data);
+    FREE(writer.macros.arr.data);
+    FREE(writer.bodies.arr.data);
+    FREE(writer.tokens.arr.data);
+}
+
+static const struct pch_header *get_header(const struct pch *const pch) {
+    return (const struct pch_header *)(const void *)pch->buffer.contents.data;
+}
+
+// Whether n_items items of item_size bytes starting at offset fit in the file
+static bool in_file(const struct pch *const pch, const size_t offset, const size_t n_items, const size_t item_size) {
+    const size_t len = pch->buffer.contents.len;
+    return offset <= len && n_items <= (len - offset) / item_size;
+}
+
+static bool string_is_valid(const struct pch *const pch, const struct pch_string str) {
+    const struct pch_header *const header = get_header(pch);
+    return str.offset <= header->strings_len && str.len <= header->strings_len - str.offset;
+}
+
+static sstr get_string(const struct pch *const pch, const struct pch_string str) {
+    unsigned char *const strings = pch->buffer.contents.data + get_header(pch)->strings_offset;
+    return (sstr) { .data = strings + str.offset, .len = str.len };
+}
+
+__attribute__((noreturn))
+static void invalid_pch(const struct pch *const pch) {
+    driver_error("\"%s\" is not a valid PCH file.", pch->fname);
+}
+
+static pp_token_harr read_tokens(const struct pch *const pch, const size_t offset, const size_t n_tokens) {
+    const struct pch_token *const records = (const struct pch_token *)(const void *)(pch->buffer.contents.data + offset);
+    pp_token_harr tokens = { .data = n_tokens == 0 ? NULL : MALLOC(n_tokens * sizeof(struct preprocessing_token)), .len = n_tokens };
+    for (size_t i = 0; i < n_tokens; i++) {
+        if (!string_is_valid(pch, records[i].name) || records[i].type > COMMENT) invalid_pch(pch);
+        const sstr name = get_string(pch, records[i].name);
+        const enum pp_token_type type = (enum pp_token_type)records[i].type;
+        tokens.data[i] = (struct preprocessing_token) {
+            .name = name,
+            .type = type,
+            .kind = get_token_kind(name, type),
+            .ident = type == IDENTIFIER ? intern(name) : NO_IDENT,
+            .after_whitespace = records[i].after_whitespace
+        };
+    }
+    return tokens;
+}
+
+const struct pch *load_pch(const char *const fname) {
+    struct pch *const pch = MALLOC(sizeof(struct pch));
+    char *const fname_copy = MALLOC(strlen(fname) + 1);
+    strcpy(fname_copy, fname);
+    pch->fname = fname_copy;
+    if (!open_source_buffer(fname, &pch->buffer)) {
+        driver_error("PCH file \"%s\" does not exist.", fname);
+    }
+    const struct pch_header *const header = get_header(pch);
+    if (pch->buffer.contents.len < sizeof(struct pch_header)
+    || memcmp(header->magic, PCH_MAGIC, sizeof(header->magic)) != 0
+    || header->macros_offset % 4 != 0 || header->tokens_offset % 4 != 0
+    || !in_file(pch, header->macros_offset, header->n_macros, sizeof(struct pch_macro))
+    || !in_file(pch, header->tokens_offset, header->n_tokens, sizeof(struct pch_token))
+    || !in_file(pch, header->strings_offset, header->strings_len, 1)) {
+        invalid_pch(pch);
+    }
+    const struct pch_macro *const macros = (const struct pch_macro *)(const void *)(pch->buffer.contents.data + header->macros_offset);
+    for (size_t i = 0; i < header->n_macros; i++) {
+        if (!string_is_valid(pch, macros[i].name)) invalid_pch(pch);
+    }
+    pch->tokens = read_tokens(pch, header->tokens_offset, header->n_tokens);
+    return pch;
+}
+
+void pch_seed_macros(const struct pch *const pch, ident_id_macro_args_and_body_map *const macros) {
+    const struct pch_header *const header = get_header(pch);
+    if (macros->n_buckets < header->n_macros) {
+        ident_id_macro_args_and_body_map_expand(macros, header->n_macros);
+    }
+    const struct pch_macro *const records = (const struct pch_macro *)(const void *)(pch->buffer.contents.data + header->macros_offset);
+    for (size_t i = 0; i < header->n_macros; i++) {
+        ident_id_macro_args_and_body_map_add(macros, intern(get_string(pch, records[i].name)), (struct macro_args_and_body) {
+            .args = {.data = NULL, .len = 0},
+            .accepts_varargs = (records[i].flags & PCH_MACRO_ACCEPTS_VARARGS) != 0,
+            .is_function_like = (records[i].flags & PCH_MACRO_FUNCTION_LIKE) != 0,
+            .replacements = {.data = NULL, .len = 0},
+            .pch = pch,
+            .pch_record_offset = header->macros_offset + i * sizeof(struct pch_macro)
+        });
+    }
+}
+
+void pch_read_macro(macro_args_and_body *const macro) {
+    const struct pch *const pch = macro->pch;
+    const struct pch_macro record = *(const struct pch_macro *)(const void *)(pch->buffer.contents.data + macro->pch_record_offset);
+    const size_t args_size = record.n_args * sizeof(struct pch_string);
+    if (record.body_offset % 4 != 0
+    || !in_file(pch, record.body_offset, record.n_args, sizeof(struct pch_string))
+    || !in_file(pch, record.body_offset + args_size, record.n_replacements, sizeof(struct pch_token))) {
+        invalid_pch(pch);
+    }
+    const struct pch_string *const args = (const struct pch_string *)(const void *)(pch->buffer.contents.data + record.body_offset);
+    macro->args = (ident_id_harr) { .data = record.n_args == 0 ? NULL : MALLOC(record.n_args * sizeof(ident_id)), .len = record.n_args };
+    for (size_t i = 0; i < record.n_args; i++) {
+        if (!string_is_valid(pch, args[i])) invalid_pch(pch);
+        macro->args.data[i] = intern(get_string(pch, args[i]));
+    }
+    macro->replacements = read_tokens(pch, record.body_offset + args_size, record.n_replacements);
+    macro->pch = NULL;
+}
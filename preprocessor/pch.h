@@ -0,0 +1,93 @@
+#ifndef ICK_PCH_H
+#define ICK_PCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "macro_expansion.h"
+#include "pp_token.h"
+#include "driver/source_buffer.h"
+
+/*
+ * Precompiled prefix headers. A PCH file holds the macros a prefix header leaves defined and the tokens it expands to,
+ * so translation units that start with the same prefix don't have to preprocess it again.
+ *
+ * The file is one read-only block that gets mmap'd and used in place. Every reference in it is an offset from the
+ * start of the file, so it can be mapped at any address. It's laid out as:
+ *     struct pch_header
+ *     struct pch_macro[n_macros]
+ *     macro bodies: each is struct pch_string[n_args] followed by struct pch_token[n_replacements]
+ *     struct pch_token[n_tokens]
+ *     the string table, which holds every macro name, parameter name, and token spelling once
+ * Integers are in the byte order of the machine that wrote the file.
+ */
+
+#define PCH_MAGIC "ICKPCH1"
+
+struct pch_header {
+    char magic[8]; // PCH_MAGIC, including its terminating null
+    uint32_t n_macros;
+    uint32_t macros_offset;
+    uint32_t n_tokens;
+    uint32_t tokens_offset;
+    uint32_t strings_len;
+    uint32_t strings_offset;
+};
+
+// A string in the string table
+struct pch_string {
+    uint32_t offset; // from the start of the string table
+    uint32_t len;
+};
+
+struct pch_token {
+    struct pch_string name;
+    uint8_t type; // an enum pp_token_type
+    uint8_t after_whitespace;
+    uint8_t padding[2];
+};
+
+#define PCH_MACRO_FUNCTION_LIKE 1u
+#define PCH_MACRO_ACCEPTS_VARARGS 2u
+
+struct pch_macro {
+    struct pch_string name;
+    uint32_t flags; // PCH_MACRO_*
+    uint32_t n_args;
+    uint32_t n_replacements;
+    uint32_t body_offset; // from the start of the file
+};
+
+/*
+ * A loaded PCH file. Token and macro names point straight into the mapping, which is never unmapped,
+ * and nothing in it changes after loading, so one PCH can be shared by every thread.
+ */
+struct pch {
+    const char *fname;
+    struct source_buffer buffer;
+    pp_token_harr tokens;
+};
+
+/*
+ * Writes the macros left defined after preprocessing a prefix header, and the tokens it expanded to, to fname.
+ */
+void write_pch(const char *fname, const ident_id_macro_args_and_body_map *macros, pp_token_harr tokens);
+
+/*
+ * Maps fname and checks that it's a PCH file. Only the token stream is read; macro bodies are left in the file
+ * until they're needed. Exits with an error if the file doesn't exist or isn't a valid PCH file.
+ * The PCH keeps its own copy of fname.
+ */
+const struct pch *load_pch(const char *fname);
+
+/*
+ * Adds every macro in the PCH to macros, without reading their bodies. Call pch_read_macro before using args
+ * or replacements of a macro whose pch field isn't NULL.
+ */
+void pch_seed_macros(const struct pch *pch, ident_id_macro_args_and_body_map *macros);
+
+/*
+ * Reads a seeded macro's parameters and replacement list out of its PCH, and clears its pch field.
+ */
+void pch_read_macro(macro_args_and_body *macro);
+
+#endif //ICK_PCH_H
@@ -0,0 +1,149 @@
+#include "phases_1_2.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include "debug/malloc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ICK_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Trigraphs start with '?', and line splices start with '\'. Every other byte is copied through unchanged,
+// so the search for the next '?' or '\' is the only part of the pass that touches every byte.
+
+static const unsigned char *find_candidate_scalar(const unsigned char *p, const unsigned char *const end) {
+    for (; p < end; p++) {
+        if (*p == '?' || *p == '\\') return p;
+    }
+    return end;
+}
+
+#ifdef ICK_X86_SIMD
+__attribute__((target("sse2")))
+static const unsigned char *find_candidate_sse2(const unsigned char *p, const unsigned char *const end) {
+    const __m128i question_marks = _mm_set1_epi8('?');
+    const __m128i backslashes = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(const void *)p);
+        const __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, question_marks), _mm_cmpeq_epi8(chunk, backslashes));
+        const unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return find_candidate_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *find_candidate_avx2(const unsigned char *p, const unsigned char *const end) {
+    const __m256i question_marks = _mm256_set1_epi8('?');
+    const __m256i backslashes = _mm256_set1_epi8('\\');
+    for (; end - p >= 32; p += 32) {
+        const __m256i chunk = _mm256_loadu_si256((const __m256i *)(const void *)p);
+        const __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, question_marks), _mm256_cmpeq_epi8(chunk, backslashes));
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return find_candidate_sse2(p, end);
+}
+#endif
+
+typedef const unsigned char *(*candidate_finder)(const unsigned char *p, const unsigned char *end);
+
+bool phases_1_2_search_supported(const enum phases_1_2_search search) {
+#ifdef ICK_X86_SIMD
+    if (search == PHASES_1_2_AVX2) return __builtin_cpu_supports("avx2");
+    if (search == PHASES_1_2_SSE2) return __builtin_cpu_supports("sse2");
+#endif
+    return search == PHASES_1_2_SCALAR;
+}
+
+static candidate_finder get_candidate_finder(const enum phases_1_2_search search) {
+#ifdef ICK_X86_SIMD
+    if (search == PHASES_1_2_AVX2) return find_candidate_avx2;
+    if (search == PHASES_1_2_SSE2) return find_candidate_sse2;
+#else
+    (void)search;
+#endif
+    return find_candidate_scalar;
+}
+
+static enum phases_1_2_search fastest_search(void) {
+    if (phases_1_2_search_supported(PHASES_1_2_AVX2)) return PHASES_1_2_AVX2;
+    if (phases_1_2_search_supported(PHASES_1_2_SSE2)) return PHASES_1_2_SSE2;
+    return PHASES_1_2_SCALAR;
+}
+
+static unsigned char trigraph_replacement(const unsigned char third_char) {
+    switch (third_char) {
+        case '=': return '#';
+        case '/': return '\\';
+        case '\'': return '^';
+        case '(': return '[';
+        case ')': return ']';
+        case '!': return '|';
+        case '<': return '{';
+        case '>': return '}';
+        case '-': return '~';
+        default: return '\0';
+    }
+}
+
+struct phases_1_2_info apply_phases_1_2(const sstr in) {
+    return apply_phases_1_2_with_search(in, fastest_search());
+}
+
+struct phases_1_2_info apply_phases_1_2_with_search(const sstr in, const enum phases_1_2_search search) {
+    source_map_breakpoint_vec breakpoints = source_map_breakpoint_vec_new(0);
+    const candidate_finder find_candidate = get_candidate_finder(search);
+
+    const unsigned char *const end = in.data + in.len;
+    unsigned char *out_chars = NULL; // only allocated once something actually needs to be rewritten
+    size_t out_len = 0;
+    size_t copied_up_to = 0; // everything in the input before this index has been handled
+    const unsigned char *p = in.data;
+    while ((p = find_candidate(p, end)) != end) {
+        const size_t i = (size_t)(p - in.data);
+        size_t rewritten_len; // the number of input characters that get replaced or removed
+        unsigned char replacement = '\0'; // '\0' if the characters are removed rather than replaced
+        if (*p == '?') {
+            replacement = i + 2 < in.len && p[1] == '?' ? trigraph_replacement(p[2]) : '\0';
+            if (replacement == '\0') {
+                p++;
+                continue;
+            }
+            rewritten_len = 3;
+            if (replacement == '\\' && i + 3 < in.len && p[3] == '\n') {
+                // ??/ followed by a newline is a line splice once the trigraph is replaced
+                replacement = '\0';
+                rewritten_len = 4;
+            }
+        } else if (i + 1 < in.len && p[1] == '\n') {
+            rewritten_len = 2;
+        } else {
+            p++;
+            continue;
+        }
+
+        if (out_chars == NULL) out_chars = MALLOC(in.len);
+        memcpy(&out_chars[out_len], &in.data[copied_up_to], i - copied_up_to);
+        out_len += i - copied_up_to;
+        if (replacement != '\0') out_chars[out_len++] = replacement;
+        copied_up_to = i + rewritten_len;
+        source_map_add_breakpoint(&breakpoints, out_len, copied_up_to - out_len);
+        p = &in.data[copied_up_to];
+    }
+
+    if (out_chars == NULL) {
+        // Nothing was rewritten, so the result is a view of the input
+        return (struct phases_1_2_info) {
+            .result = in,
+            .map = { .breakpoints = breakpoints.arr }
+        };
+    }
+    memcpy(&out_chars[out_len], &in.data[copied_up_to], in.len - copied_up_to);
+    out_len += in.len - copied_up_to;
+    return (struct phases_1_2_info) {
+        .result = { .data = out_chars, .len = out_len },
+        .map = { .breakpoints = breakpoints.arr }
+    };
+}
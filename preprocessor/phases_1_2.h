@@ -0,0 +1,32 @@
+#ifndef ICK_PHASES_1_2_H
+#define ICK_PHASES_1_2_H
+
+#include <stdbool.h>
+#include "data_structures/sstr.h"
+#include "source_map.h"
+
+struct phases_1_2_info {
+    sstr result;
+    struct source_map map; // maps indices into result back to indices into the input
+};
+
+/*
+ * Performs translation phases 1 (trigraph replacement) and 2 (line splicing) in a single pass.
+ * If the input contains neither trigraphs nor escaped newlines, the result is the input itself, not a copy.
+ */
+struct phases_1_2_info apply_phases_1_2(sstr in);
+
+/*
+ * The ways of finding the next '?' or '\', which is what the pass spends its time on. apply_phases_1_2 uses the fastest
+ * one the CPU supports; the others are here to compare against it.
+ */
+enum phases_1_2_search {
+    PHASES_1_2_SCALAR,
+    PHASES_1_2_SSE2,
+    PHASES_1_2_AVX2
+};
+bool phases_1_2_search_supported(enum phases_1_2_search search);
+// Like apply_phases_1_2, but with the given search, which must be supported
+struct phases_1_2_info apply_phases_1_2_with_search(sstr in, enum phases_1_2_search search);
+
+#endif //ICK_PHASES_1_2_H
@@ -1,26 +1,27 @@
 // ReSharper disable CppDFAUnreachableCode
-#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 #include "detector.h"
+#include "phases_1_2.h"
 #include "pp_token.h"
+#include "token_stream.h"
+#include "char_class.h"
 
+#include "data_structures/map.h"
 #include "data_structures/sstr.h"
+#include "debug/malloc.h"
+#include "debug/trace.h"
 #include "preprocessor/diagnostics.h"
 
 bool in_src_char_set(const unsigned char c) {
-    if (isdigit(c) || isalpha(c)) return true;
-    switch (c) {
-        case '!':case '"':case '#':case '%':case '&':case '\'':case '(':case ')':case '*':case '+':case ',':case '-':
-        case '.':case '/':case ':':case ';':case '<':case '=':case '>':case '?':case '[':case '\\':case ']':case '^':
-        case '_':case '{':case '|':case '}':case '~':
-        case ' ':case '\t':case '\v':case '\f':
-            return true;
-        default:
-            return false;
-    }
+    return char_has_class(c, CHAR_CLASS_SOURCE);
 }
 
 static bool is_octal_digit(const unsigned char c) {
-    return c >= '0' && c <= '7';
+    return char_has_class(c, CHAR_CLASS_OCTAL_DIGIT);
 }
 
 static struct header_name_detector detect_header_name(struct header_name_detector detector, const unsigned char c) {
@@ -65,7 +66,7 @@ static struct universal_character_name_detector detect_universal_character_name(
         detector.expected_digits = 8;
     } else if (detector.looking_for_uU) {
         detector.status = IMPOSSIBLE;
-    } else if (detector.looking_for_digits && isxdigit(c)) {
+    } else if (detector.looking_for_digits && char_has_class(c, CHAR_CLASS_HEX_DIGIT)) {
         detector.n_digits++;
         if (detector.n_digits == detector.expected_digits) {
             detector.status = MATCH;
@@ -86,7 +87,7 @@ static struct universal_character_name_detector detect_universal_character_name(
 static struct identifier_detector detect_identifier(struct identifier_detector detector, const unsigned char c) {
     if (detector.status == IMPOSSIBLE) return detector;
 
-    if (detector.is_first_char && isdigit(c)) {
+    if (detector.is_first_char && char_has_class(c, CHAR_CLASS_DIGIT)) {
         detector.status = IMPOSSIBLE;
     } else if (c == '\\' && !detector.looking_for_ucn) {
         detector.looking_for_ucn = true;
@@ -94,7 +95,7 @@ static struct identifier_detector detect_identifier(struct identifier_detector d
         detector.status = INCOMPLETE;
     } else if (c == '\\') {
         detector.status = IMPOSSIBLE;
-    } else if (!detector.looking_for_ucn && (isalpha(c) || c == '_' || isdigit(c))) {
+    } else if (!detector.looking_for_ucn && char_has_class(c, CHAR_CLASS_IDENTIFIER)) {
         detector.status = MATCH;
     } else if (!detector.looking_for_ucn) {
         detector.status = IMPOSSIBLE;
@@ -118,14 +119,14 @@ static struct identifier_detector detect_identifier(struct identifier_detector d
 static struct pp_number_detector detect_pp_number(struct pp_number_detector detector, const unsigned char c) {
     if (detector.status == IMPOSSIBLE) return detector;
 
-    if (detector.is_first_char && isdigit(c)) {
+    if (detector.is_first_char && char_has_class(c, CHAR_CLASS_DIGIT)) {
         detector.status = MATCH;
     } else if (detector.is_first_char && c == '.') {
         detector.looking_for_digit = true;
         detector.status = INCOMPLETE;
     } else if (detector.is_first_char) {
         detector.status = IMPOSSIBLE;
-    } else if (detector.looking_for_digit && isdigit(c)) {
+    } else if (detector.looking_for_digit && char_has_class(c, CHAR_CLASS_DIGIT)) {
         detector.looking_for_digit = false;
         detector.status = MATCH;
     } else if (detector.looking_for_digit) {
@@ -140,7 +141,7 @@ static struct pp_number_detector detect_pp_number(struct pp_number_detector dete
         } else if (c == '\\') {
             detector.looking_for_ucn = true;
             detector.status = INCOMPLETE;
-        } else if (!(isalpha(c) || c == '_' || isdigit(c) || c == '.'))  {
+        } else if (!(char_has_class(c, CHAR_CLASS_IDENTIFIER) || c == '.'))  {
             detector.status = IMPOSSIBLE;
         }
     }
@@ -192,7 +193,7 @@ static struct escape_sequence_detector detect_escape_sequence(struct escape_sequ
     } else if (detector.looking_for_octal && is_octal_digit(c)) {
         detector.n_octals++;
         if (detector.n_octals == 3) detector.next_char_invalid = true;
-    } else if (detector.looking_for_hex && isxdigit(c)) {
+    } else if (detector.looking_for_hex && char_has_class(c, CHAR_CLASS_HEX_DIGIT)) {
         detector.status = MATCH;
     } else {
         detector.status = IMPOSSIBLE;
@@ -267,17 +268,61 @@ static struct char_const_str_literal_detector detect_string_literal(struct char_
     return detect_char_const_str_literal(detector, '"', c);
 }
 
+static struct dense_trie punctuator_trie;
+static pthread_once_t punctuator_trie_once = PTHREAD_ONCE_INIT;
+
+static void build_punctuator_trie(void) {
+    punctuator_trie = dense_trie_new();
+#define X(kind, spelling) \
+    dense_trie_insert(&punctuator_trie, (const unsigned char *)(spelling), sizeof(spelling) - 1, TOKEN_##kind);
+    PUNCTUATORS(X)
+#undef X
+}
+
+// Every punctuator's value in the trie is its kind
+static const struct dense_trie *get_punctuator_trie(void) {
+    pthread_once(&punctuator_trie_once, build_punctuator_trie);
+    return &punctuator_trie;
+}
+
+size_t match_punctuator(const sstr text, enum token_kind *const kind) {
+    int value;
+    const size_t len = dense_trie_longest_match(get_punctuator_trie(), text.data, text.len, &value);
+    if (len > 0) *kind = (enum token_kind)value;
+    return len;
+}
+
+enum token_kind get_token_kind(const sstr name, const enum pp_token_type type) {
+    enum token_kind kind;
+    if (type == PUNCTUATOR && match_punctuator(name, &kind) == name.len) return kind;
+    if (type == SINGLE_CHAR && name.len == 1 && name.data[0] == '\n') return TOKEN_NEWLINE;
+    return TOKEN_OTHER;
+}
+
+static const char *const token_kind_spellings[] = {
+    [TOKEN_OTHER] = "",
+#define X(kind, spelling) [TOKEN_##kind] = (spelling),
+    PUNCTUATORS(X)
+#undef X
+    [TOKEN_NEWLINE] = "\n"
+};
+
+const char *token_kind_spelling(const enum token_kind kind) {
+    return token_kind_spellings[kind];
+}
+
 static struct punctuator_detector detect_punctuator(struct punctuator_detector detector, const unsigned char c) {
 
     if (detector.status == IMPOSSIBLE) return detector;
 
-    const struct trie *const next_place_in_trie = trie_get_child(detector.place_in_trie, c);
-    if (next_place_in_trie == NULL) {
+    const struct dense_trie *const trie = get_punctuator_trie();
+    const dense_trie_node next_node = dense_trie_child(trie, detector.node, c);
+    if (next_node == DENSE_TRIE_ROOT) {
         detector.status = IMPOSSIBLE;
     } else {
-        if (next_place_in_trie->match) detector.status = MATCH;
+        if (trie->values[next_node] != DENSE_TRIE_NO_VALUE) detector.status = MATCH;
         else detector.status = INCOMPLETE;
-        detector.place_in_trie = next_place_in_trie;
+        detector.node = next_node;
     }
     return detector;
 }
@@ -286,7 +331,7 @@ static struct single_char_detector detect_single_char(struct single_char_detecto
     if (detector.status == IMPOSSIBLE) return detector;
     else if (detector.status == MATCH) detector.status = IMPOSSIBLE;
     // newlines aren't actually tokens but they're significant in phase 4, so it's easier to treat them as tokens
-    else if (isspace(c) && c != '\n') detector.status = IMPOSSIBLE;
+    else if (char_has_class(c, CHAR_CLASS_SPACE) && c != '\n') detector.status = IMPOSSIBLE;
     else detector.status = MATCH;
     return detector;
 }
@@ -337,7 +382,7 @@ static struct preprocessing_token_detector detect_preprocessing_token(struct pre
         detector.header_name_detector = detect_header_name(detector.header_name_detector, c);
         detector.string_literal_detector.status = IMPOSSIBLE;
     } else {
-        preprocessor_fatal_error(0, 0, 0, "invalid value of exclude parameter in detect_preprocessing_token");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "invalid value of exclude parameter in detect_preprocessing_token");
     }
     detector.identifier_detector = detect_identifier(detector.identifier_detector, c);
     detector.pp_number_detector = detect_pp_number(detector.pp_number_detector, c);
@@ -373,22 +418,32 @@ static enum pp_token_type get_token_type(const struct preprocessing_token_detect
     else if (detector.comment_detector.status == MATCH) return COMMENT;
     else if (detector.single_char_detector.status == MATCH) return SINGLE_CHAR;
     else {
-        preprocessor_fatal_error(0, 0, 0, "token doesn't seem to have a type");
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "token doesn't seem to have a type");
     }
 }
 
-bool token_is_str(const struct preprocessing_token token, const char *const str) {
-    return sstr_cstr_eq(token.name, str);
+/*
+ * Where the lexer is relative to an #include directive, going by the tokens read so far that aren't comments. A header
+ * name can only come right after # include at the start of a line.
+ */
+enum include_context {
+    INCLUDE_CONTEXT_LINE_START, // at the start of the input, or after a newline
+    INCLUDE_CONTEXT_START_IN_INCLUDE, // at the start of an input that's the rest of an #include directive
+    INCLUDE_CONTEXT_HASH, // after # at the start of a line
+    INCLUDE_CONTEXT_DIRECTIVE, // after # include at the start of a line
+    INCLUDE_CONTEXT_OTHER
+};
+
+static enum include_context next_include_context(const enum include_context context, const enum token_kind kind, const ident_id ident) {
+    if (kind == TOKEN_NEWLINE) return INCLUDE_CONTEXT_LINE_START;
+    const bool at_line_start = context == INCLUDE_CONTEXT_LINE_START || context == INCLUDE_CONTEXT_START_IN_INCLUDE;
+    if (at_line_start && kind == TOKEN_HASH) return INCLUDE_CONTEXT_HASH;
+    if (context == INCLUDE_CONTEXT_HASH && ident == IDENT_INCLUDE) return INCLUDE_CONTEXT_DIRECTIVE;
+    return INCLUDE_CONTEXT_OTHER;
 }
 
-static bool in_include_directive(const pp_token_vec tokens, const bool starts_in_include) {
-    const bool at_beginning_of_file = tokens.arr.len == 2;
-    const bool after_hashtag_include = tokens.arr.len >= 2
-                                        && token_is_str(tokens.arr.data[tokens.arr.len - 2], "#")
-                                        && token_is_str(tokens.arr.data[tokens.arr.len - 1], "include");
-    const bool hashtag_after_newline = tokens.arr.len >= 3
-                                        && token_is_str(tokens.arr.data[tokens.arr.len - 3], "\n");
-    return (starts_in_include && tokens.arr.len == 0) || (after_hashtag_include && (at_beginning_of_file || hashtag_after_newline));
+static bool in_include_directive(const enum include_context context) {
+    return context == INCLUDE_CONTEXT_DIRECTIVE || context == INCLUDE_CONTEXT_START_IN_INCLUDE;
 }
 
 static struct preprocessing_token_detector get_initial_detector(void) {
@@ -406,7 +461,7 @@ static struct preprocessing_token_detector get_initial_detector(void) {
                     .accepting_sign=false, .is_first_char=true,.ucn_detector=initial_ucn_detector},
             .character_constant_detector=initial_ccsld,
             .string_literal_detector=initial_ccsld,
-            .punctuator_detector={.status=INCOMPLETE, .place_in_trie=&punctuators_trie},
+            .punctuator_detector={.status=INCOMPLETE, .node=DENSE_TRIE_ROOT},
             .single_char_detector={.status=INCOMPLETE},
             .comment_detector={.status=INCOMPLETE, .prev_status=INCOMPLETE, .is_multiline=false,
                     .is_first_char=true, .is_second_char=false, .next_char_invalid=false}
@@ -414,122 +469,763 @@ static struct preprocessing_token_detector get_initial_detector(void) {
     return initial_detector;
 }
 
-bool is_valid_token(const sstr token, const enum exclude_from_detection exclude) {
-    struct preprocessing_token_detector detector = get_initial_detector();
+/*
+ * The detectors above are the definition of what each kind of token looks like, but running all eight of them on every
+ * character is slow. So they're compiled into a DFA the first time a token is lexed: every state is a combination of
+ * detector states that can come up, found by feeding every byte to every state reachable from the two start states
+ * (one for after #include, where header names replace string literals). Two combinations are the same state if no
+ * later character can tell them apart, which is what detector_state_key encodes.
+ */
+typedef uint16_t dfa_state_index;
+#define DEAD_STATE 0 // every detector has failed; the DFA stays here
+
+typedef struct dfa_state {
+    enum detection_status status;
+    enum pp_token_type type; // if status is MATCH
+    enum token_kind kind; // if type is PUNCTUATOR
+    // A kind of run of bytes that all leave the DFA in this state, so they can be skipped over at once
+    enum char_run run;
+    unsigned char run_stop;
+} dfa_state;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(dfa_state)
+DEFINE_VEC_TYPE_AND_FUNCTIONS(dfa_state_index)
+
+struct lexer_dfa {
+    const dfa_state_index (*transitions)[256]; // the state after each byte, for each state
+    dfa_state_harr states;
+    dfa_state_index start_states[2]; // indexed by enum exclude_from_detection
+    bool skips_horizontal_space; // whether no token can start with horizontal whitespace
+};
+
+// A detector together with which token kind its context rules out, since that changes how it takes characters
+typedef struct contextual_detector {
+    struct preprocessing_token_detector detector;
+    enum exclude_from_detection exclude;
+} contextual_detector;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(contextual_detector)
+
+static size_t hash_detector_key(const sstr key, const size_t n_buckets) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < key.len; i++) {
+        hash = (hash ^ key.data[i]) * 1099511628211u;
+    }
+    return (size_t)(hash % n_buckets);
+}
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(sstr, dfa_state_index, hash_detector_key, sstrs_eq)
+
+static size_t hash_size_t(const size_t key, const size_t n_buckets) {
+    return key % n_buckets;
+}
+
+static bool size_ts_eq(const size_t key1, const size_t key2) {
+    return key1 == key2;
+}
+
+typedef bool boolean;
+DEFINE_MAP_TYPE_AND_FUNCTIONS(size_t, boolean, hash_size_t, size_ts_eq)
+
+static void add_ucn_key(uchar_vec *const key, const struct universal_character_name_detector detector) {
+    uchar_vec_append(key, (unsigned char)detector.status);
+    if (detector.status == IMPOSSIBLE) return;
+    const unsigned char fields[] = {
+        detector.looking_for_digits, detector.looking_for_uU, detector.is_first_char, detector.expected_digits, detector.n_digits
+    };
+    uchar_vec_append_all_arr(key, fields, sizeof(fields));
+}
+
+static void add_escape_sequence_key(uchar_vec *const key, const struct escape_sequence_detector detector) {
+    uchar_vec_append(key, (unsigned char)detector.status);
+    if (detector.status == IMPOSSIBLE) return;
+    const unsigned char fields[] = {
+        detector.is_first_char, detector.is_second_char, detector.looking_for_ucn, detector.looking_for_hex,
+        detector.looking_for_octal, detector.next_char_invalid, detector.n_octals
+    };
+    uchar_vec_append_all_arr(key, fields, sizeof(fields));
+    add_ucn_key(key, detector.ucn_detector);
+}
+
+static void add_char_const_str_literal_key(uchar_vec *const key, const struct char_const_str_literal_detector detector) {
+    uchar_vec_append(key, (unsigned char)detector.status);
+    if (detector.status == IMPOSSIBLE) return;
+    // The previous character only matters if it's a backslash
+    const unsigned char fields[] = {
+        detector.prev_esc_seq_status, detector.looking_for_open_quote, detector.in_literal, detector.looking_for_esc_seq,
+        detector.is_first_char, detector.just_opened, detector.prev_char == '\\'
+    };
+    uchar_vec_append_all_arr(key, fields, sizeof(fields));
+    // A new escape sequence detector is started at every backslash
+    if (detector.looking_for_esc_seq) add_escape_sequence_key(key, detector.esc_seq_detector);
+}
+
+// Encodes everything about a detector that can affect what it does with later characters
+static sstr detector_state_key(const contextual_detector state) {
+    uchar_vec key = uchar_vec_new(64);
+    const struct preprocessing_token_detector detector = state.detector;
+    uchar_vec_append(&key, (unsigned char)detector.status);
+    if (detector.status == IMPOSSIBLE) return key.arr;
+    uchar_vec_append(&key, (unsigned char)state.exclude);
+
+    uchar_vec_append(&key, (unsigned char)detector.header_name_detector.status);
+    if (detector.header_name_detector.status != IMPOSSIBLE) {
+        uchar_vec_append(&key, detector.header_name_detector.in_quotes);
+        uchar_vec_append(&key, detector.header_name_detector.is_first_char);
+    }
+
+    uchar_vec_append(&key, (unsigned char)detector.identifier_detector.status);
+    if (detector.identifier_detector.status != IMPOSSIBLE) {
+        uchar_vec_append(&key, detector.identifier_detector.looking_for_ucn);
+        uchar_vec_append(&key, detector.identifier_detector.is_first_char);
+        // A new UCN detector is started at every backslash
+        if (detector.identifier_detector.looking_for_ucn) add_ucn_key(&key, detector.identifier_detector.ucn_detector);
+    }
+
+    uchar_vec_append(&key, (unsigned char)detector.pp_number_detector.status);
+    if (detector.pp_number_detector.status != IMPOSSIBLE) {
+        const unsigned char fields[] = {
+            detector.pp_number_detector.accepting_sign, detector.pp_number_detector.looking_for_ucn,
+            detector.pp_number_detector.looking_for_digit, detector.pp_number_detector.is_first_char
+        };
+        uchar_vec_append_all_arr(&key, fields, sizeof(fields));
+        // Unlike the identifier detector, this one carries its UCN detector over from one UCN to the next
+        add_ucn_key(&key, detector.pp_number_detector.ucn_detector);
+    }
+
+    add_char_const_str_literal_key(&key, detector.character_constant_detector);
+    add_char_const_str_literal_key(&key, detector.string_literal_detector);
+
+    uchar_vec_append(&key, (unsigned char)detector.punctuator_detector.status);
+    if (detector.punctuator_detector.status != IMPOSSIBLE) {
+        uchar_vec_append_all_arr(&key, (const unsigned char *)&detector.punctuator_detector.node, sizeof(dense_trie_node));
+    }
+
+    uchar_vec_append(&key, (unsigned char)detector.single_char_detector.status);
+
+    const struct comment_detector comment = detector.comment_detector;
+    uchar_vec_append(&key, (unsigned char)comment.status);
+    if (comment.status != IMPOSSIBLE) {
+        // The previous character only matters if it could be the * of */
+        const unsigned char fields[] = {
+            comment.is_multiline, comment.is_first_char, comment.is_second_char, comment.next_char_invalid, comment.prev_char == '*'
+        };
+        uchar_vec_append_all_arr(&key, fields, sizeof(fields));
+    }
+    return key.arr;
+}
+
+// Returns the index of state in the DFA, adding it (to be explored later) if it's new
+static dfa_state_index intern_dfa_state(const contextual_detector state, contextual_detector_vec *const detectors, dfa_state_vec *const states, sstr_dfa_state_index_map *const indices) {
+    const sstr key = detector_state_key(state);
+    if (sstr_dfa_state_index_map_contains(indices, key)) {
+        const dfa_state_index index = sstr_dfa_state_index_map_get(indices, key);
+        FREE(key.data);
+        return index;
+    }
+    if (states->arr.len > UINT16_MAX) preprocessor_fatal_error(NO_SOURCE_LOCATION, "The lexer's DFA has too many states");
+    const dfa_state_index index = (dfa_state_index)states->arr.len;
+    contextual_detector_vec_append(detectors, state);
+    const enum pp_token_type type = state.detector.status == MATCH ? get_token_type(state.detector) : SINGLE_CHAR;
+    dfa_state_vec_append(states, (dfa_state) {
+        .status = state.detector.status,
+        .type = type,
+        .kind = type == PUNCTUATOR ? (enum token_kind)get_punctuator_trie()->values[state.detector.punctuator_detector.node] : TOKEN_OTHER,
+        .run = CHAR_RUN_NONE
+    });
+    sstr_dfa_state_index_map_add(indices, key, index);
+    return index;
+}
+
+static bool run_stays_in_state(const struct lexer_dfa *const dfa, const dfa_state_index state, const enum char_run run, const unsigned char stop) {
+    for (unsigned c = 0; c < 256; c++) {
+        if (char_in_run(run, stop, (unsigned char)c) && dfa->transitions[state][c] != state) return false;
+    }
+    return true;
+}
+
+// Finds the kind of run that covers the most bytes out of the ones that leave the state where it is
+static void find_char_run(const struct lexer_dfa *const dfa, const dfa_state_index state, dfa_state *const info) {
+    size_t n_leaving = 0;
+    unsigned char leaving = 0;
+    for (unsigned c = 0; c < 256; c++) {
+        if (dfa->transitions[state][c] != state) {
+            n_leaving++;
+            leaving = (unsigned char)c;
+        }
+    }
+    if (n_leaving == 1) {
+        info->run = CHAR_RUN_UNTIL_BYTE; // e.g. a comment, which only * can get out of
+        info->run_stop = leaving;
+        return;
+    }
+    static const unsigned char closing_chars[] = {'"', '\'', '>'};
+    for (size_t i = 0; i < sizeof(closing_chars); i++) {
+        if (run_stays_in_state(dfa, state, CHAR_RUN_LITERAL_BODY, closing_chars[i])) {
+            info->run = CHAR_RUN_LITERAL_BODY;
+            info->run_stop = closing_chars[i];
+            return;
+        }
+    }
+    if (run_stays_in_state(dfa, state, CHAR_RUN_IDENTIFIER, 0)) {
+        info->run = CHAR_RUN_IDENTIFIER;
+    } else if (run_stays_in_state(dfa, state, CHAR_RUN_HORIZONTAL_SPACE, 0)) {
+        info->run = CHAR_RUN_HORIZONTAL_SPACE;
+    }
+}
+
+static struct lexer_dfa lexer_dfa;
+static pthread_once_t lexer_dfa_once = PTHREAD_ONCE_INIT;
+
+static void build_lexer_dfa(void) {
+    contextual_detector_vec detectors = contextual_detector_vec_new(0);
+    dfa_state_vec states = dfa_state_vec_new(0);
+    sstr_dfa_state_index_map indices = sstr_dfa_state_index_map_new(1024);
+    struct preprocessing_token_detector dead = get_initial_detector();
+    dead.status = IMPOSSIBLE;
+    intern_dfa_state((contextual_detector) { .detector = dead, .exclude = EXCLUDE_HEADER_NAME }, &detectors, &states, &indices);
+    lexer_dfa.start_states[EXCLUDE_STRING_LITERAL] = intern_dfa_state((contextual_detector) {
+        .detector = get_initial_detector(), .exclude = EXCLUDE_STRING_LITERAL
+    }, &detectors, &states, &indices);
+    lexer_dfa.start_states[EXCLUDE_HEADER_NAME] = intern_dfa_state((contextual_detector) {
+        .detector = get_initial_detector(), .exclude = EXCLUDE_HEADER_NAME
+    }, &detectors, &states, &indices);
+
+    // Breadth-first: detectors grows as new states are found, and each one is explored in turn
+    dfa_state_index_vec transitions = dfa_state_index_vec_new(0);
+    for (size_t i = 0; i < detectors.arr.len; i++) {
+        for (unsigned c = 0; c < 256; c++) {
+            const contextual_detector state = detectors.arr.data[i];
+            const contextual_detector next = {
+                .detector = detect_preprocessing_token(state.detector, (unsigned char)c, state.exclude),
+                .exclude = state.exclude
+            };
+            dfa_state_index_vec_append(&transitions, i == DEAD_STATE ? DEAD_STATE : intern_dfa_state(next, &detectors, &states, &indices));
+        }
+    }
+    lexer_dfa.transitions = (const dfa_state_index (*)[256])transitions.arr.data;
+    lexer_dfa.states = states.arr;
+    for (dfa_state_index i = DEAD_STATE + 1; i < states.arr.len; i++) {
+        find_char_run(&lexer_dfa, i, &states.arr.data[i]);
+    }
+    lexer_dfa.skips_horizontal_space = true;
+    for (unsigned c = 0; c < 256; c++) {
+        if (char_in_run(CHAR_RUN_HORIZONTAL_SPACE, 0, (unsigned char)c)
+            && (lexer_dfa.transitions[lexer_dfa.start_states[EXCLUDE_HEADER_NAME]][c] != DEAD_STATE
+                || lexer_dfa.transitions[lexer_dfa.start_states[EXCLUDE_STRING_LITERAL]][c] != DEAD_STATE)) {
+            lexer_dfa.skips_horizontal_space = false;
+        }
+    }
+
+    contextual_detector_vec_free_internals(&detectors);
+    for (size_t i = 0; i < indices.n_buckets; i++) {
+        for (const struct sstr_dfa_state_index_node *node = indices.buckets[i]; node != NULL; node = node->next) {
+            FREE(node->key.data);
+        }
+    }
+    sstr_dfa_state_index_map_free_internals(&indices);
+    FREE(indices.buckets);
+}
+
+static const struct lexer_dfa *get_lexer_dfa(void) {
+    pthread_once(&lexer_dfa_once, build_lexer_dfa);
+    return &lexer_dfa;
+}
+
+static dfa_state_index run_lexer_dfa(const sstr token, const enum exclude_from_detection exclude) {
+    const struct lexer_dfa *const dfa = get_lexer_dfa();
+    dfa_state_index state = dfa->start_states[exclude];
     for (size_t i = 0; i < token.len; i++) {
-        detector = detect_preprocessing_token(detector, token.data[i], exclude);
+        state = dfa->transitions[state][token.data[i]];
     }
-    return detector.status == MATCH;
+    return state;
+}
+
+bool is_valid_token(const sstr token, const enum exclude_from_detection exclude) {
+    return get_lexer_dfa()->states.data[run_lexer_dfa(token, exclude)].status == MATCH;
 }
 
 enum pp_token_type get_token_type_from_str(const sstr token, const enum exclude_from_detection exclude) {
-    struct preprocessing_token_detector detector = get_initial_detector();
-    for (size_t i = 0; i < token.len; i++) {
-        detector = detect_preprocessing_token(detector, token.data[i], exclude);
+    const dfa_state state = get_lexer_dfa()->states.data[run_lexer_dfa(token, exclude)];
+    if (state.status != MATCH) preprocessor_fatal_error(NO_SOURCE_LOCATION, "token doesn't seem to have a type");
+    return state.type;
+}
+
+
+/*
+ * The (state, position) pairs from which the DFA is known not to reach another accepting state before it dies.
+ * Maximal munch has to look past the end of a token to know it's the longest, and when there's no longer token, the
+ * next one starts earlier than where the lookahead stopped. Without this, the same bytes would be read again, from
+ * the same states, by every token that starts inside the lookahead (e.g. after every \" in an unterminated string).
+ * Most positions only ever fail in one state, so that one is kept in an array, and any others in a map.
+ * Only the positions in [base, base + n_positions) are remembered; outside of them, nothing is known to fail.
+ */
+struct lexer_failures {
+    dfa_state_index *first; // for each position; DEAD_STATE if there are none
+    size_t_boolean_map others; // keyed by position * number of states + state
+    size_t n_states;
+    size_t base;
+    size_t n_positions;
+};
+
+static struct lexer_failures lexer_failures_new(const size_t n_states, const size_t base, const size_t n_positions) {
+    const struct lexer_failures failures = {
+        .first = MALLOC(n_positions * sizeof(dfa_state_index)),
+        .others = size_t_boolean_map_new(16),
+        .n_states = n_states,
+        .base = base,
+        .n_positions = n_positions
+    };
+    memset(failures.first, 0, n_positions * sizeof(dfa_state_index)); // DEAD_STATE
+    return failures;
+}
+
+static bool lexer_failed_at(const struct lexer_failures *const failures, const dfa_state_index state, const size_t position) {
+    if (position < failures->base || position - failures->base >= failures->n_positions) return false;
+    const dfa_state_index first = failures->first[position - failures->base];
+    if (first == state) return true;
+    return first != DEAD_STATE && size_t_boolean_map_contains(&failures->others, position * failures->n_states + state);
+}
+
+static void add_lexer_failure(struct lexer_failures *const failures, const dfa_state_index state, const size_t position) {
+    if (position < failures->base || position - failures->base >= failures->n_positions) return;
+    if (failures->first[position - failures->base] == DEAD_STATE) {
+        failures->first[position - failures->base] = state;
+    } else if (!lexer_failed_at(failures, state, position)) {
+        size_t_boolean_map_add(&failures->others, position * failures->n_states + state, true);
     }
-    return get_token_type(detector);
 }
 
+static void lexer_failures_free_internals(struct lexer_failures *const failures) {
+    FREE(failures->first);
+    size_t_boolean_map_free_internals(&failures->others);
+    FREE(failures->others.buckets);
+}
+
+// Lexing one input, or one part of it
+struct lexer_run {
+    const struct lexer_dfa *dfa;
+    sstr input;
+    bool input_is_complete; // false if more of the input can come after the end of what's there
+    enum comment_handling comments;
+    struct lexer_failures failures;
+    enum include_context context;
+    bool after_comment; // whether the last token read was a comment
+};
+
+static struct lexer_run lexer_run_new(const sstr input, const bool starts_in_include, const enum comment_handling comments,
+                                      const size_t start, const size_t end) {
+    const struct lexer_dfa *const dfa = get_lexer_dfa();
+    return (struct lexer_run) {
+        .dfa = dfa,
+        .input = input,
+        .input_is_complete = true,
+        .comments = comments,
+        .failures = lexer_failures_new(dfa->states.len, start, end - start + 1),
+        .context = starts_in_include ? INCLUDE_CONTEXT_START_IN_INCLUDE : INCLUDE_CONTEXT_LINE_START,
+        .after_comment = false
+    };
+}
+
+enum lex_result {
+    LEX_TOKEN,
+    LEX_END, // the input is used up
+    LEX_NEED_INPUT // the input isn't complete, and the next token could go on past the end of what's there
+};
 
-pp_token_harr get_pp_tokens(const sstr input, bool starts_in_include) {
+/*
+ * Reads the first token at or after *position that isn't a discarded comment, and moves *position to where the token
+ * after it starts. If the next token could go on past the end of an incomplete input, nothing is read, and *position
+ * is where that token starts, so it can be read again once there's more input.
+ */
+static enum lex_result lex_token(struct lexer_run *const run, size_t *const position, struct preprocessing_token *const token) {
     // TODO:
     // Error on invalid tokens.
     // Currently, it skips over invalid tokens instead of erroring.
     // This is fine in C because it only ends up skipping over whitespace (since any single character is a valid token).
     // But if C was different, then it would skip over invalid tokens, when it should error.
 
-    pp_token_vec tokens = pp_token_vec_new(input.len / 3);  // guess 3 chars per token
-    bool match_exists = false;
-    struct preprocessing_token_detector token_detector = get_initial_detector();
-
-    size_t token_start = 0;
-    struct preprocessing_token token_at_most_recent_match;
-    for (size_t i = 0; i < input.len; i++) {
+    const struct lexer_dfa *const dfa = run->dfa;
+    const sstr input = run->input;
+    size_t token_start = *position;
+    while (true) {
+        if (dfa->skips_horizontal_space) {
+            token_start = skip_char_run(CHAR_RUN_HORIZONTAL_SPACE, 0, input.data, token_start, input.len);
+        }
+        if (token_start == input.len) {
+            *position = token_start;
+            return run->input_is_complete ? LEX_END : LEX_NEED_INPUT;
+        }
         // The token can't be a string literal if it's after #include, and it can't be a header name if it's not
-        token_detector = detect_preprocessing_token(token_detector, input.data[i],
-                                                    in_include_directive(tokens, starts_in_include) ? EXCLUDE_STRING_LITERAL : EXCLUDE_HEADER_NAME);
-        // If the token is valid, then indicate that and set token_at_most_recent_match to the token
-        if (token_detector.status == MATCH) {
-            match_exists = true;
-            const bool after_actual_whitespace = token_start != 0 && isspace(input.data[token_start-1]);
-            const bool after_comment = tokens.arr.len > 0 && tokens.arr.data[tokens.arr.len - 1].type == COMMENT;
-            token_at_most_recent_match = (struct preprocessing_token) {
-                .after_whitespace = after_actual_whitespace || after_comment,
-                .name = { .data = &input.data[token_start], .len = i-token_start + 1 },
-                .type = get_token_type(token_detector)
-            };
-        } else if (token_detector.status == IMPOSSIBLE) {
-            if (match_exists) {
-                // If the token was valid before, then add that valid token
-                pp_token_vec_append(&tokens, token_at_most_recent_match);
-                match_exists = false;
-                // Set the iterator to right after that token (-1 because char_p gets incremented at the end of the loop)
-                i = token_start + token_at_most_recent_match.name.len - 1;
-                // Start a new token at the iterator
-                token_start = i+1;
-            } else {
-                // Try starting from the next character
-                token_start++;
+        dfa_state_index state = dfa->start_states[in_include_directive(run->context) ? EXCLUDE_STRING_LITERAL : EXCLUDE_HEADER_NAME];
+        size_t token_end = token_start; // the end of the longest match so far, if there is one
+        dfa_state_index state_at_token_end = state;
+        size_t i;
+        for (i = token_start; i < input.len && !lexer_failed_at(&run->failures, state, i); i++) {
+            state = dfa->transitions[state][input.data[i]];
+            if (state == DEAD_STATE) break;
+            const dfa_state current = dfa->states.data[state];
+            if (current.run != CHAR_RUN_NONE) {
+                // The bytes after this one can't change the state until the run ends
+                i = skip_char_run(current.run, current.run_stop, input.data, i + 1, input.len) - 1;
             }
-            token_detector = get_initial_detector();
+            if (current.status == MATCH) {
+                token_end = i + 1;
+                state_at_token_end = state;
+            }
+        }
+        const bool reached_end = i == input.len && state != DEAD_STATE;
+        if (reached_end && !run->input_is_complete) {
+            *position = token_start;
+            return LEX_NEED_INPUT;
+        }
+        // Nothing that was read after the match led anywhere, so it won't from those states next time either. (The byte
+        // that killed the DFA isn't recorded: starting from just before it again only takes one step.) That holds when
+        // the DFA ran into the end of the input too (e.g. in an unterminated comment), so lexing goes on right after the
+        // longest match either way, and doesn't read the rest of the input again from each token.
+        state = state_at_token_end;
+        for (size_t j = token_end; j < i; j++) {
+            add_lexer_failure(&run->failures, state, j);
+            state = dfa->transitions[state][input.data[j]];
+        }
+
+        if (token_end == token_start) {
+            // Try starting from the next character
+            token_start++;
+            continue;
+        }
+        const dfa_state token_state = dfa->states.data[state_at_token_end];
+        const enum pp_token_type type = token_state.type;
+        if (type == COMMENT && run->comments == DISCARD_COMMENTS) {
+            run->after_comment = true;
+            token_start = token_end;
+            continue;
         }
+        const bool after_actual_whitespace = token_start != 0 && char_has_class(input.data[token_start-1], CHAR_CLASS_SPACE);
+        const sstr name = { .data = &input.data[token_start], .len = token_end - token_start };
+        *token = (struct preprocessing_token) {
+            .after_whitespace = after_actual_whitespace || run->after_comment,
+            .name = name,
+            .type = type,
+            .kind = type == SINGLE_CHAR && name.data[0] == '\n' ? TOKEN_NEWLINE : token_state.kind,
+            .ident = type == IDENTIFIER ? intern(name) : NO_IDENT
+        };
+        if (type != COMMENT) run->context = next_include_context(run->context, token->kind, token->ident);
+        run->after_comment = type == COMMENT;
+        *position = token_end;
+        return LEX_TOKEN;
+    }
+}
+
+// Lexes input from position on, until a token starts at or after end, and returns where that token starts
+static size_t lex_into_stream(struct lexer_run *const run, struct token_stream *const tokens, size_t position, const size_t end) {
+    struct preprocessing_token token;
+    while (position < end && lex_token(run, &position, &token) == LEX_TOKEN) {
+        token_stream_append(tokens, token);
+    }
+    return position;
+}
+
+/*
+ * Large inputs are split into chunks at line boundaries, which are lexed at the same time, each as if it started the
+ * input. That's right unless the line boundary is inside a token (only a comment can span lines), so the chunks are
+ * then checked in order: if the tokens so far end with the newline at the chunk's start, the chunk is used as is.
+ * Otherwise, lexing resumes where the tokens so far end, until it reaches a newline that the chunk also has a token
+ * for, and the chunk is used from there on. Whether a token is a header name only depends on the tokens since the last
+ * newline, so the results agree from there.
+ */
+static size_t lexer_threads = 1;
+#define MIN_PARALLEL_LEX_CHUNK ((size_t)1 << 20)
+
+void set_lexer_threads(const size_t n_threads) {
+    if (n_threads > 0) {
+        lexer_threads = n_threads;
+    } else {
+        const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        lexer_threads = n_cpus > 0 ? (size_t)n_cpus : 1;
+    }
+}
+
+struct lexer_chunk {
+    struct lexer_run run;
+    struct token_stream tokens;
+    size_t start, end; // the chunk's tokens are the ones that start in [start, end)
+    size_t next_start; // where the token after the chunk's last one starts
+    pthread_t thread;
+    bool has_thread;
+};
+
+static void *lex_chunk(void *const arg) {
+    struct lexer_chunk *const chunk = arg;
+    chunk->next_start = lex_into_stream(&chunk->run, &chunk->tokens, chunk->start, chunk->end);
+    return NULL;
+}
+
+// Whether the last token in tokens is a newline that ends at position
+static bool ends_with_newline_at(const struct token_stream *const tokens, const size_t position) {
+    if (tokens->len == 0) return false;
+    const token_handle last = (token_handle)(tokens->len - 1);
+    return token_stream_kind(tokens, last) == TOKEN_NEWLINE && token_stream_offset(tokens, last) + 1 == position;
+}
+
+/*
+ * Where the chunk's tokens can be used from, if the tokens before it end at position with a newline: its first token
+ * if position is its start, or the one after its newline that ends at position. Returns false if it has no such newline.
+ */
+static bool find_resync_point(const struct lexer_chunk *const chunk, const size_t position, token_handle *const first) {
+    if (position == chunk->start) {
+        *first = 0;
+        return true;
+    }
+    const struct token_stream *const tokens = &chunk->tokens;
+    // Tokens are in order of offset
+    size_t low = 0, high = tokens->len;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (token_stream_offset(tokens, (token_handle)mid) < position - 1) low = mid + 1;
+        else high = mid;
     }
-    if (match_exists) {
-        // If there's a lingering valid token (happens when the last character is part of a valid token), add it
-        pp_token_vec_append(&tokens, token_at_most_recent_match);
+    if (low == tokens->len || token_stream_offset(tokens, (token_handle)low) != position - 1
+        || token_stream_kind(tokens, (token_handle)low) != TOKEN_NEWLINE) {
+        return false;
     }
+    *first = (token_handle)(low + 1);
+    return true;
+}
+
+static struct token_stream lex_in_parallel(const sstr input, const bool starts_in_include, const enum comment_handling comments, size_t n_chunks) {
+    size_t_vec starts = size_t_vec_new(n_chunks + 1);
+    size_t_vec_append(&starts, 0);
+    for (size_t i = 1; i < n_chunks; i++) {
+        const size_t previous = starts.arr.data[starts.arr.len - 1];
+        size_t start = input.len / n_chunks * i;
+        if (start <= previous) continue;
+        const unsigned char *const newline = memchr(&input.data[start], '\n', input.len - start);
+        if (newline == NULL) break;
+        start = (size_t)(newline - input.data) + 1;
+        if (start < input.len) size_t_vec_append(&starts, start);
+    }
+    n_chunks = starts.arr.len;
+    size_t_vec_append(&starts, input.len);
 
-    // Remove the comments
-    pp_token_vec tokens_without_comments = pp_token_vec_new(tokens.arr.len);
-    for (size_t i = 0; i < tokens.arr.len; i++) {
-        if (tokens.arr.data[i].type != COMMENT) {
-            pp_token_vec_append(&tokens_without_comments, tokens.arr.data[i]);
+    struct lexer_chunk *const chunks = MALLOC(n_chunks * sizeof(struct lexer_chunk));
+    for (size_t i = 0; i < n_chunks; i++) {
+        const size_t start = starts.arr.data[i], end = starts.arr.data[i + 1];
+        chunks[i] = (struct lexer_chunk) {
+            .run = lexer_run_new(input, i == 0 && starts_in_include, comments, start, end),
+            .tokens = token_stream_new(input, (end - start) / 3), // guess 3 chars per token
+            .start = start,
+            .end = end,
+            .has_thread = false
+        };
+    }
+    // The first chunk is lexed on this thread. If a thread can't be started, its chunk is too.
+    for (size_t i = 1; i < n_chunks; i++) {
+        chunks[i].has_thread = pthread_create(&chunks[i].thread, NULL, lex_chunk, &chunks[i]) == 0;
+    }
+    lex_chunk(&chunks[0]);
+    for (size_t i = 1; i < n_chunks; i++) {
+        if (chunks[i].has_thread) pthread_join(chunks[i].thread, NULL);
+        else lex_chunk(&chunks[i]);
+    }
+
+    // The first chunk is always right, and the rest are checked against it, and appended to it
+    struct lexer_run *const out = &chunks[0].run;
+    struct token_stream *const tokens = &chunks[0].tokens;
+    size_t position = chunks[0].next_start;
+    for (size_t i = 1; i < n_chunks && position < input.len; i++) {
+        struct lexer_chunk *const chunk = &chunks[i];
+        token_handle first;
+        bool resynced = false;
+        while (position < input.len && position < chunk->end) {
+            if (position >= chunk->start && ends_with_newline_at(tokens, position) && find_resync_point(chunk, position, &first)) {
+                resynced = true;
+                break;
+            }
+            position = lex_into_stream(out, tokens, position, position + 1);
+        }
+        if (resynced) {
+            token_stream_append_all(tokens, &chunk->tokens, first);
+            out->context = chunk->run.context;
+            out->after_comment = chunk->run.after_comment;
+            position = chunk->next_start;
         }
     }
-    pp_token_vec_free_internals(&tokens);
+    // The last chunk's tokens might not have been usable at all
+    lex_into_stream(out, tokens, position, input.len);
 
-    print_tokens(stdout, tokens_without_comments.arr, false, true);
+    const struct token_stream result = *tokens;
+    lexer_failures_free_internals(&out->failures);
+    for (size_t i = 1; i < n_chunks; i++) {
+        lexer_failures_free_internals(&chunks[i].run.failures);
+        token_stream_free_internals(&chunks[i].tokens);
+    }
+    FREE(chunks);
+    size_t_vec_free_internals(&starts);
+    return result;
+}
 
-    return tokens_without_comments.arr;
+struct token_stream get_pp_tokens(const sstr input, const bool starts_in_include, const enum comment_handling comments) {
+    struct token_stream tokens;
+    const size_t n_chunks = input.len / MIN_PARALLEL_LEX_CHUNK < lexer_threads ? input.len / MIN_PARALLEL_LEX_CHUNK : lexer_threads;
+    if (n_chunks > 1) {
+        tokens = lex_in_parallel(input, starts_in_include, comments, n_chunks);
+    } else {
+        struct lexer_run run = lexer_run_new(input, starts_in_include, comments, 0, input.len);
+        tokens = token_stream_new(input, input.len / 3); // guess 3 chars per token
+        lex_into_stream(&run, &tokens, 0, input.len);
+        lexer_failures_free_internals(&run.failures);
+    }
+
+    if (TRACING(LEXER, TRACE_BASIC)) print_tokens(trace_file(), &tokens, false, true);
+
+    return tokens;
 }
 
-void print_tokens(FILE *file, const pp_token_harr tokens, const bool ignore_whitespace, const bool verbose) {
-    if (verbose) {
-        for (size_t i = 0; i < tokens.len; i++) {
-            const struct preprocessing_token token = tokens.data[i];
-            for (size_t j = 0; j < token.name.len; j++) {
-                if (token.name.data[j] == '\n') {
-                    fprintf(file, "[newline]");
-                } else {
-                    fprintf(file, "%c", token.name.data[j]);
-                }
+/*
+ * The input is read LEXER_READ_SIZE bytes at a time, and only whole lines go through phases 1 and 2 (no trigraph or line
+ * splice spans a line break), into the window. Each refill first drops everything before the next token, except for the
+ * character just before it, which says whether the token is after whitespace. A token that could go on past the end of
+ * the window is lexed again after the refill, so a refill at least doubles what's left to lex: then a long token is
+ * only read a few times over.
+ */
+#define LEXER_READ_SIZE ((size_t)1 << 16)
+
+struct lexer {
+    struct lexer_run run; // run.input is the window
+    int fd;
+    unsigned char *window; // logical characters
+    size_t window_len, window_capacity;
+    size_t position; // where the next token starts in the window
+    unsigned char *raw; // what's been read of the line after the last one in the window
+    size_t raw_len, raw_capacity;
+};
+
+struct lexer *lexer_new(const int fd, const enum comment_handling comments) {
+    struct lexer *const lexer = MALLOC(sizeof(struct lexer));
+    unsigned char *const window = MALLOC(LEXER_READ_SIZE);
+    *lexer = (struct lexer) {
+        .run = lexer_run_new((sstr) { .data = window, .len = 0 }, false, comments, 0, 0),
+        .fd = fd,
+        .window = window, .window_len = 0, .window_capacity = LEXER_READ_SIZE,
+        .position = 0,
+        .raw = MALLOC(LEXER_READ_SIZE), .raw_len = 0, .raw_capacity = LEXER_READ_SIZE
+    };
+    lexer->run.input_is_complete = false;
+    return lexer;
+}
+
+// Puts the first n_raw bytes of the raw input through phases 1 and 2, onto the end of the window
+static void append_logical_lines(struct lexer *const lexer, const size_t n_raw) {
+    const struct phases_1_2_info lines = apply_phases_1_2((sstr) { .data = lexer->raw, .len = n_raw });
+    if (lexer->window_capacity - lexer->window_len < lines.result.len) {
+        while (lexer->window_capacity - lexer->window_len < lines.result.len) {
+            lexer->window_capacity *= 2;
+        }
+        lexer->window = REALLOC(lexer->window, lexer->window_capacity);
+    }
+    memcpy(&lexer->window[lexer->window_len], lines.result.data, lines.result.len);
+    lexer->window_len += lines.result.len;
+    if (lines.result.data != lexer->raw) FREE(lines.result.data);
+    FREE(lines.map.breakpoints.data);
+    memmove(lexer->raw, &lexer->raw[n_raw], lexer->raw_len - n_raw);
+    lexer->raw_len -= n_raw;
+}
+
+static void refill_window(struct lexer *const lexer) {
+    const size_t keep_from = lexer->position > 0 ? lexer->position - 1 : 0;
+    memmove(lexer->window, &lexer->window[keep_from], lexer->window_len - keep_from);
+    lexer->window_len -= keep_from;
+    lexer->position -= keep_from;
+
+    const size_t wanted = lexer->window_len + (lexer->window_len > LEXER_READ_SIZE ? lexer->window_len : LEXER_READ_SIZE);
+    while (lexer->window_len < wanted) {
+        if (lexer->raw_capacity - lexer->raw_len < LEXER_READ_SIZE + 1) {
+            lexer->raw_capacity *= 2;
+            lexer->raw = REALLOC(lexer->raw, lexer->raw_capacity);
+        }
+        const ssize_t n_read = read(lexer->fd, &lexer->raw[lexer->raw_len], LEXER_READ_SIZE);
+        if (n_read < 0) {
+            if (errno == EINTR) continue;
+            preprocessor_fatal_error(NO_SOURCE_LOCATION, "Error reading input. Errno: %d (%s).", errno, strerror(errno));
+        }
+        if (n_read == 0) {
+            // Like a source buffer, the input always ends in an extra newline
+            lexer->raw[lexer->raw_len++] = '\n';
+            append_logical_lines(lexer, lexer->raw_len);
+            lexer->run.input_is_complete = true;
+            break;
+        }
+        const size_t old_len = lexer->raw_len;
+        lexer->raw_len += (size_t)n_read;
+        for (size_t i = lexer->raw_len; i > old_len; i--) {
+            if (lexer->raw[i - 1] == '\n') {
+                append_logical_lines(lexer, i);
+                break;
             }
-            fprintf(file, " (");
-            if (token.type == HEADER_NAME) fprintf(file, "header name");
-            else if (token.type == IDENTIFIER) fprintf(file, "identifier");
-            else if (token.type == PP_NUMBER) fprintf(file, "preprocessing number");
-            else if (token.type == CHARACTER_CONSTANT) fprintf(file, "character constant");
-            else if (token.type == STRING_LITERAL) fprintf(file, "string literal");
-            else if (token.type == PUNCTUATOR) fprintf(file, "punctuator");
-            else if (token.type == SINGLE_CHAR) fprintf(file, "single character");
-            fprintf(file, ")");
-            if (token.after_whitespace && !ignore_whitespace) fprintf(file, " (after whitespace)");
-            fprintf(file, "\n");
+        }
+    }
+
+    lexer->run.input = (sstr) { .data = lexer->window, .len = lexer->window_len };
+    // The positions have moved
+    lexer_failures_free_internals(&lexer->run.failures);
+    lexer->run.failures = lexer_failures_new(lexer->run.dfa->states.len, 0, lexer->window_len + 1);
+}
+
+bool next_token(struct lexer *const lexer, struct preprocessing_token *const token) {
+    while (true) {
+        const enum lex_result result = lex_token(&lexer->run, &lexer->position, token);
+        if (result == LEX_TOKEN) return true;
+        if (result == LEX_END) return false;
+        refill_window(lexer);
+    }
+}
+
+void lexer_free(struct lexer *const lexer) {
+    lexer_failures_free_internals(&lexer->run.failures);
+    FREE(lexer->window);
+    FREE(lexer->raw);
+    FREE(lexer);
+}
+
+void print_token_info(FILE *file, const struct preprocessing_token token, const bool ignore_whitespace) {
+    for (size_t j = 0; j < token.name.len; j++) {
+        if (token.name.data[j] == '\n') {
+            fprintf(file, "[newline]");
+        } else {
+            fprintf(file, "%c", token.name.data[j]);
+        }
+    }
+    fprintf(file, " (");
+    if (token.type == HEADER_NAME) fprintf(file, "header name");
+    else if (token.type == IDENTIFIER) fprintf(file, "identifier");
+    else if (token.type == PP_NUMBER) fprintf(file, "preprocessing number");
+    else if (token.type == CHARACTER_CONSTANT) fprintf(file, "character constant");
+    else if (token.type == STRING_LITERAL) fprintf(file, "string literal");
+    else if (token.type == PUNCTUATOR) fprintf(file, "punctuator");
+    else if (token.type == SINGLE_CHAR) fprintf(file, "single character");
+    fprintf(file, ")");
+    if (token.after_whitespace && !ignore_whitespace) fprintf(file, " (after whitespace)");
+    fprintf(file, "\n");
+}
+
+void print_tokens(FILE *file, const struct token_stream *const tokens, const bool ignore_whitespace, const bool verbose) {
+    if (verbose) {
+        for (token_handle i = 0; i < tokens->len; i++) {
+            print_token_info(file, token_stream_get(tokens, i), ignore_whitespace);
         }
     }
 
     // print normally
     ssize_t indent = 0;
-    for (size_t i = 0; i < tokens.len; i++) {
-        const struct preprocessing_token token = tokens.data[i];
+    for (token_handle i = 0; i < tokens->len; i++) {
+        const struct preprocessing_token token = token_stream_get(tokens, i);
         if (!ignore_whitespace && token.after_whitespace) fprintf(file, " ");
         fprintf(file, "%.*s", (int)token.name.len, (char*)token.name.data);
         if (ignore_whitespace) fprintf(file, " ");
-        if (token_is_str(token, "{")) indent++;
-        if (token_is_str(token, "}") && indent > 0) indent--;
-        if (token_is_str(token, ";") || token_is_str(token, "{") || token_is_str(token, "}")) {
+        if (token.kind == TOKEN_LEFT_BRACE) indent++;
+        if (token.kind == TOKEN_RIGHT_BRACE && indent > 0) indent--;
+        if (token.kind == TOKEN_SEMICOLON || token.kind == TOKEN_LEFT_BRACE || token.kind == TOKEN_RIGHT_BRACE) {
             fprintf(file, "\n");
-            bool next_token_is_closing_brace = i != tokens.len - 1 && token_is_str(tokens.data[i+1], "}");
+            bool next_token_is_closing_brace = i != tokens->len - 1 && token_stream_kind(tokens, i + 1) == TOKEN_RIGHT_BRACE;
             for (ssize_t j = 0; j < (next_token_is_closing_brace ? indent - 1 : indent); j++) {
                 fprintf(file, "\t");
             }
@@ -537,3 +1233,37 @@ void print_tokens(FILE *file, const pp_token_harr tokens, const bool ignore_whit
     }
     fprintf(file, "\n");
 }
+
+struct token_printer token_printer_new(struct output_sink *const sink, const enum token_print_mode mode) {
+    return (struct token_printer) { .sink = sink, .mode = mode, .indent = 0, .line_break_pending = false };
+}
+
+static void print_line_break(struct token_printer *const printer, const bool next_token_is_closing_brace) {
+    output_sink_put_char(printer->sink, '\n');
+    for (ssize_t j = 0; j < (next_token_is_closing_brace ? printer->indent - 1 : printer->indent); j++) {
+        output_sink_put_char(printer->sink, '\t');
+    }
+    printer->line_break_pending = false;
+}
+
+void token_printer_print(struct token_printer *const printer, const struct preprocessing_token token) {
+    if (printer->line_break_pending) print_line_break(printer, token.kind == TOKEN_RIGHT_BRACE);
+    if (token.after_whitespace) output_sink_put_char(printer->sink, ' ');
+    output_sink_write(printer->sink, token.name.data, token.name.len);
+    if (printer->mode == TOKEN_PRINT_RAW) return;
+    if (token.kind == TOKEN_LEFT_BRACE) {
+        printer->indent++;
+        printer->line_break_pending = true;
+    } else if (token.kind == TOKEN_RIGHT_BRACE) {
+        if (printer->indent > 0) printer->indent--;
+        printer->line_break_pending = true;
+    } else if (token.kind == TOKEN_SEMICOLON) {
+        printer->line_break_pending = true;
+    }
+}
+
+void token_printer_finish(struct token_printer *const printer) {
+    if (printer->line_break_pending) print_line_break(printer, false);
+    output_sink_put_char(printer->sink, '\n');
+    output_sink_flush(printer->sink);
+}
@@ -3,10 +3,13 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include "data_structures/vector.h"
 #include "data_structures/trie.h"
+#include "data_structures/intern.h"
 #include "detector.h"
 #include "data_structures/sstr.h"
+#include "driver/output_sink.h"
 
 struct header_name_detector {
     enum detection_status status;
@@ -72,7 +75,7 @@ struct char_const_str_literal_detector {
 
 
 struct punctuator_detector {
-    const struct trie *place_in_trie;
+    dense_trie_node node; // in the punctuator trie
     enum detection_status status;
 };
 
@@ -90,6 +93,31 @@ struct single_char_detector {
     enum detection_status status;
 };
 
+// Every punctuator: the name of its kind, and how it's spelled
+#define PUNCTUATORS(X) \
+    X(LEFT_BRACKET, "[") X(RIGHT_BRACKET, "]") X(LEFT_PAREN, "(") X(RIGHT_PAREN, ")") X(LEFT_BRACE, "{") X(RIGHT_BRACE, "}") \
+    X(DOT, ".") X(ARROW, "->") \
+    X(INCREMENT, "++") X(DECREMENT, "--") X(AMPERSAND, "&") X(STAR, "*") X(PLUS, "+") X(MINUS, "-") X(TILDE, "~") \
+    X(EXCLAMATION, "!") \
+    X(SLASH, "/") X(PERCENT, "%") X(LEFT_SHIFT, "<<") X(RIGHT_SHIFT, ">>") X(LESS, "<") X(GREATER, ">") X(LESS_EQUAL, "<=") \
+    X(GREATER_EQUAL, ">=") X(EQUAL_EQUAL, "==") X(NOT_EQUAL, "!=") X(CARET, "^") X(PIPE, "|") X(AND_AND, "&&") X(OR_OR, "||") \
+    X(QUESTION, "?") X(COLON, ":") X(SEMICOLON, ";") X(ELLIPSIS, "...") \
+    X(ASSIGN, "=") X(STAR_ASSIGN, "*=") X(SLASH_ASSIGN, "/=") X(PERCENT_ASSIGN, "%=") X(PLUS_ASSIGN, "+=") \
+    X(MINUS_ASSIGN, "-=") X(LEFT_SHIFT_ASSIGN, "<<=") X(RIGHT_SHIFT_ASSIGN, ">>=") X(AND_ASSIGN, "&=") X(XOR_ASSIGN, "^=") \
+    X(OR_ASSIGN, "|=") \
+    X(COMMA, ",") X(HASH, "#") X(HASH_HASH, "##") \
+    X(DIGRAPH_LEFT_BRACKET, "<:") X(DIGRAPH_RIGHT_BRACKET, ":>") X(DIGRAPH_LEFT_BRACE, "<%") X(DIGRAPH_RIGHT_BRACE, "%>") \
+    X(DIGRAPH_HASH, "%:") X(DIGRAPH_HASH_HASH, "%:%:")
+
+// The tokens that are looked for by spelling: every punctuator, and newlines
+enum token_kind {
+    TOKEN_OTHER,
+#define X(kind, spelling) TOKEN_##kind,
+    PUNCTUATORS(X)
+#undef X
+    TOKEN_NEWLINE
+};
+
 enum pp_token_type {
     HEADER_NAME, IDENTIFIER, PP_NUMBER, CHARACTER_CONSTANT, STRING_LITERAL, PUNCTUATOR, SINGLE_CHAR, COMMENT
 };
@@ -97,6 +125,8 @@ enum pp_token_type {
 struct preprocessing_token {
     sstr name;
     enum pp_token_type type;
+    enum token_kind kind;
+    ident_id ident; // the interned name of an IDENTIFIER; NO_IDENT for every other type
     bool after_whitespace;
 };
 typedef struct preprocessing_token pp_token;
@@ -104,7 +134,17 @@ DEFINE_VEC_TYPE_AND_FUNCTIONS(pp_token)
 
 bool in_src_char_set(unsigned char c);
 
-bool token_is_str(struct preprocessing_token token, const char *str);
+/*
+ * Returns the length of the longest punctuator that text starts with, or 0 if it doesn't start with one, and sets
+ * *kind to its kind.
+ */
+size_t match_punctuator(sstr text, enum token_kind *kind);
+
+// The kind of a token with this name and type, for tokens that don't come straight from the lexer
+enum token_kind get_token_kind(sstr name, enum pp_token_type type);
+
+// How a token of this kind is spelled; the empty string for TOKEN_OTHER
+const char *token_kind_spelling(enum token_kind kind);
 
 struct preprocessing_token_detector {
     struct header_name_detector header_name_detector;
@@ -120,232 +160,66 @@ struct preprocessing_token_detector {
 };
 enum exclude_from_detection {EXCLUDE_STRING_LITERAL, EXCLUDE_HEADER_NAME};
 
-pp_token_harr get_pp_tokens(sstr input, bool starts_in_include);
+struct token_stream; // see token_stream.h
+
+enum comment_handling {DISCARD_COMMENTS, KEEP_COMMENTS};
+
+/*
+ * Splits input into preprocessing tokens. A discarded comment counts as whitespace before the token after it; a kept
+ * one becomes a COMMENT token (for a -C style mode, since nothing after the lexer accepts them yet).
+ */
+struct token_stream get_pp_tokens(sstr input, bool starts_in_include, enum comment_handling comments);
+
+/*
+ * Sets how many threads get_pp_tokens may use for one large input (1 by default); 0 means one per online CPU.
+ * Must be called before any other thread starts preprocessing.
+ */
+void set_lexer_threads(size_t n_threads);
+
+/*
+ * Lexes input as it's read from a file descriptor (which can be a pipe), a window at a time, so the memory it takes
+ * doesn't grow with the length of the input, only with the longest line. Trigraphs and line splices are handled as the
+ * input is read, the same way as for a source buffer.
+ */
+struct lexer;
+
+// The descriptor isn't closed by the lexer
+struct lexer *lexer_new(int fd, enum comment_handling comments);
+
+/*
+ * Reads the next token into *token, or returns false at the end of the input. The token's name points into the
+ * lexer's window, so it's only valid until the next call; its ident stays valid.
+ */
+bool next_token(struct lexer *lexer, struct preprocessing_token *token);
+
+void lexer_free(struct lexer *lexer);
 
 bool is_valid_token(sstr token, enum exclude_from_detection exclude);
 enum pp_token_type get_token_type_from_str(sstr token, enum exclude_from_detection exclude);
 
-void print_tokens(FILE *file, pp_token_harr tokens, bool ignore_whitespace, bool verbose);
-
-static const struct trie punctuators_trie = {
-    /*
-    punctuators:
-    [ ] ( ) { } . ->
-    ++ -- & * + - ~ !
-    / % << >> < > <= >= == != ^ | && ||
-    ? : ; ...
-    = *= /= %= += -= <<= >>= &= ^= |=
-    , # ##
-    <: :> <% %> %: %:%:
-    */
-    .n_children = 24, .children = (struct trie[]) {
-        // (
-        (struct trie) {
-            .val = '(', .match = true, .n_children = 0
-        },
-        // )
-        (struct trie) {
-            .val = ')', .match = true, .n_children = 0
-        },
-        // [
-        (struct trie) {
-            .val = '[', .match = true, .n_children = 0
-        },
-        // ]
-        (struct trie) {
-            .val = ']', .match = true, .n_children = 0
-        },
-        // {
-        (struct trie) {
-            .val = '{', .match = true, .n_children = 0
-        },
-        // }
-        (struct trie) {
-            .val = '}', .match = true, .n_children = 0
-        },
-        // . ...
-        (struct trie) {
-            .val = '.', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '.', .match = false, .n_children = 1, .children =(struct trie[]) {
-                        (struct trie) {
-                            .val = '.', .match = true, .n_children = 0
-                        }
-                    }
-                }
-            }
-        },
-        // - -> -= --
-        (struct trie) {
-            .val = '-', .match = true, .n_children = 3, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '>', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '-', .match = true, .n_children = 0
-                }
-            }
-        },
-        // + += ++
-        (struct trie) {
-            .val = '+', .match = true, .n_children = 2, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '+', .match = true, .n_children = 0
-                }
-            }
-        },
-        // & && &=
-        (struct trie) {
-            .val = '&', .match = true, .n_children = 2, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '&', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // * *=
-        (struct trie) {
-            .val = '*', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // ~
-        (struct trie) {
-            .val = '~', .match = true, .n_children = 0
-        },
-        // ! !=
-        (struct trie) {
-            .val = '!', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // / /=
-        (struct trie) {
-                .val = '/', .match = true, .n_children = 1, .children = (struct trie[]) {
-                        (struct trie) {
-                                .val = '=', .match = true, .n_children = 0
-                        }
-                }
-        },
-        // % %> %: %:%:
-        (struct trie) {
-            .val = '%', .match = true, .n_children = 3, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '>', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = ':', .match = true, .n_children = 1, .children = (struct trie[]) {
-                        (struct trie) {
-                            .val = '%', .match = false, .n_children = 1, .children = (struct trie[]) {
-                                (struct trie) {
-                                    .val = ':', .match = true, .n_children = 0
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        },
-        // < << <<= <= <: <%
-        (struct trie) {
-            .val = '<', .match = true, .n_children = 4, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '<', .match = true, .n_children = 1, .children = (struct trie[]) {
-                        (struct trie) {
-                            .val = '=', .match = true, .n_children = 0
-                        }
-                    }
-                },
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = ':', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '%', .match = true, .n_children = 0
-                }
-            }
-        },
-        // > >> >>= >=
-        (struct trie) {
-            .val = '>', .match = true, .n_children = 2, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '>', .match = true, .n_children = 1, .children = (struct trie[]) {
-                        (struct trie) {
-                            .val = '=', .match = true, .n_children = 0
-                        }
-                    }
-                },
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                },
-            }
-        },
-        // = ==
-        (struct trie) {
-            .val = '=', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // ^ ^=
-        (struct trie) {
-            .val = '^', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // | || |=
-        (struct trie) {
-            .val = '|', .match = true, .n_children = 2, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '|', .match = true, .n_children = 0
-                },
-                (struct trie) {
-                    .val = '=', .match = true, .n_children = 0
-                }
-            }
-        },
-        // ?
-        (struct trie) {
-            .val = '?', .match = true, .n_children = 0
-        },
-        // : :>
-        (struct trie) {
-            .val = ':', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '>', .match = true, .n_children = 0
-                }
-            }
-        },
-        // ,
-        (struct trie) {
-            .val = ',', .match = true, .n_children = 0
-        },
-        // # ##
-        (struct trie) {
-            .val = '#', .match = true, .n_children = 1, .children = (struct trie[]) {
-                (struct trie) {
-                    .val = '#', .match = true, .n_children = 0
-                }
-            }
-        }
-    }
+void print_tokens(FILE *file, const struct token_stream *tokens, bool ignore_whitespace, bool verbose);
+
+// Prints the token on a line of its own, with its type, the way print_tokens does when it's verbose
+void print_token_info(FILE *file, struct preprocessing_token token, bool ignore_whitespace);
+
+enum token_print_mode {
+    TOKEN_PRINT_PRETTY, // a line break after every ; { and }, and statements indented by brace depth
+    TOKEN_PRINT_RAW // tokens exactly as they come, separated by whitespace where the source had it
+};
+
+/*
+ * Writes tokens to an output sink as they're produced.
+ */
+struct token_printer {
+    struct output_sink *sink;
+    enum token_print_mode mode;
+    ssize_t indent;
+    bool line_break_pending; // the indentation of the next line depends on whether the next token is a }
 };
 
+struct token_printer token_printer_new(struct output_sink *sink, enum token_print_mode mode);
+void token_printer_print(struct token_printer *printer, struct preprocessing_token token);
+// Ends the output with a newline and flushes the sink
+void token_printer_finish(struct token_printer *printer);
+
 #endif //ICK_PP_TOKEN_H
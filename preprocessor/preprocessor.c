@@ -2,27 +2,160 @@
 
 #include "conditional_inclusion.h"
 #include "diagnostics.h"
-#include "escaped_newlines.h"
+#include "file_cache.h"
 #include "macro_expansion.h"
-#include "trigraphs.h"
 #include "debug/color_print.h"
+#include "debug/trace.h"
 #include "driver/file_utils.h"
+#include "driver/source_buffer.h"
 
-static pp_token_harr preprocess_included_file(FILE *input_file, sstr_macro_args_and_body_map *macro_map);
+// Takes ownership of found.path. The result's file is NULL if there's no file at found.path.
+static resolved_include resolve_include_path(struct preprocessor_context *const ctx, const struct header_search_result found) {
+    char *const path = normalize_path(found.path);
+    FREE(found.path);
+    if (char_p_resolved_include_map_contains(&ctx->resolved_includes, path)) {
+        const resolved_include resolved = char_p_resolved_include_map_get(&ctx->resolved_includes, path);
+        FREE(path);
+        return resolved;
+    }
+    const cached_file_p file = file_cache_get(path);
+    if (file == NULL) {
+        FREE(path);
+        return (resolved_include) { .path = NULL, .file = NULL };
+    }
+    const resolved_include resolved = { .path = path, .file = file };
+    char_p_resolved_include_map_add(&ctx->resolved_includes, path, resolved);
+    // This is the first time the path has been seen, so it's only recorded once
+    if (ctx->options.dependencies != NULL && !(found.is_system_header && ctx->options.skip_system_dependencies)) {
+        char_p_vec_append(ctx->options.dependencies, path);
+    }
+    return resolved;
+}
 
-static pp_token_harr preprocess_tree(const struct earley_rule group_opt_rule, sstr_macro_args_and_body_map *macro_map) {
-    pp_token_vec out = pp_token_vec_new(0);
-    if (group_opt_rule.rhs.tag == OPT_NONE) {
-        return out.arr;
+// Finds the file named by an #include directive, and gets its parse from the file cache. The result's file is NULL if it wasn't found.
+static resolved_include find_included_file(struct preprocessor_context *const ctx, const char *const fname, const bool quoted) {
+    const struct header_search_result found = find_header(&ctx->options.search_path, ctx->current_source.fname, fname, quoted);
+    if (found.path == NULL) return (resolved_include) { .path = NULL, .file = NULL };
+    return resolve_include_path(ctx, found);
+}
+
+// Whether including the file again would be a no-op, because of its include guard or #pragma once
+static bool include_is_redundant(const struct preprocessor_context *const ctx, const cached_file_p file) {
+    const ident_id guard = file->parsed.include_guard;
+    if (guard != NO_IDENT && ident_id_macro_args_and_body_map_contains(&ctx->macro_map, guard)) return true;
+    return file_id_cached_file_p_map_contains(&ctx->pragma_once_files, file->id);
+}
+
+static struct diagnostic_file diagnostic_file_of(const char *const fname, const sstr raw, const struct parsed_file *const parsed) {
+    return (struct diagnostic_file) {
+        .fname = fname, .raw = raw, .logical_lines = parsed->logical_lines, .source_map = parsed->source_map
+    };
+}
+
+// A file whose text isn't known (yet), so diagnostics can only name it
+static struct diagnostic_file unread_file(const char *const fname) {
+    return (struct diagnostic_file) {
+        .fname = fname, .raw = { .data = NULL, .len = 0 }, .logical_lines = { .data = NULL, .len = 0 },
+        .source_map = { .breakpoints = { .data = NULL, .len = 0 } }
+    };
+}
+
+// The text from the start of the first token to the end of the last, which all have to be from the same line
+static sstr tokens_span(const pp_token_harr tokens) {
+    const sstr first = tokens.data[0].name, last = tokens.data[tokens.len - 1].name;
+    return (sstr) { .data = first.data, .len = (size_t)(last.data - first.data) + last.len };
+}
+
+static void emit_tokens(struct preprocessor_context *const ctx, const pp_token_harr tokens) {
+    for (size_t i = 0; i < tokens.len; i++) {
+        struct preprocessing_token token = tokens.data[i];
+        if (ctx->at_start_of_included_file) {
+            // To make sure it doesn't get smushed with what came before it
+            token.after_whitespace = true;
+            ctx->at_start_of_included_file = false;
+        }
+        if (ctx->token_collector != NULL) pp_token_vec_append(ctx->token_collector, token);
+        else token_printer_print(ctx->printer, token);
     }
+}
 
-    const struct earley_rule group_rule = *group_opt_rule.completed_from.data[0];
+static uint64_t hash_bytes(uint64_t hash, const void *const data, const size_t len) {
+    // FNV-1a
+    const unsigned char *const bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+static uint64_t hash_sstr(const uint64_t hash, const sstr str) {
+    return hash_bytes(hash_bytes(hash, &str.len, sizeof(str.len)), str.data, str.len);
+}
+
+uint64_t state_change_hash(const state_change change) {
+    uint64_t hash = 14695981039346656037u;
+    if (change.kind == STATE_CHANGE_PRAGMA_ONCE) {
+        return hash_bytes(hash_bytes(hash, &change.file->id.dev, sizeof(dev_t)), &change.file->id.ino, sizeof(ino_t));
+    }
+    // A define and the undef that removes it contribute the same hash, so they cancel out
+    const macro_args_and_body macro = change.macro;
+    const unsigned char flags[2] = { macro.is_function_like, macro.accepts_varargs };
+    hash = hash_bytes(hash_bytes(hash, &change.macro_name, sizeof(ident_id)), flags, sizeof(flags));
+    hash = hash_bytes(hash, macro.args.data, macro.args.len * sizeof(ident_id));
+    for (size_t i = 0; i < macro.replacements.len; i++) {
+        const unsigned char whitespace = i != 0 && macro.replacements.data[i].after_whitespace;
+        hash = hash_bytes(hash_sstr(hash, macro.replacements.data[i].name), &whitespace, 1);
+    }
+    return hash;
+}
 
+static void record_change(struct preprocessor_context *const ctx, const state_change change) {
+    if (ctx->changes == NULL) return;
+    state_change_vec_append(ctx->changes, change);
+    ctx->state_fingerprint ^= state_change_hash(change);
+}
+
+static ident_id directive_macro_name(const struct earley_rule control_line_rule) {
+    return control_line_rule.completed_from.data[0]->rhs.symbols.data[0].val.terminal.token.ident;
+}
+
+// Records the macro defined by a #define, unless it was already defined (in which case the #define changed nothing)
+static void record_define(struct preprocessor_context *const ctx, const ident_id name, const bool was_defined) {
+    if (ctx->changes == NULL || was_defined) return;
+    record_change(ctx, (state_change) {
+        .kind = STATE_CHANGE_DEFINE,
+        .macro_name = name,
+        .macro = ident_id_macro_args_and_body_map_get(&ctx->macro_map, name),
+        .file = NULL
+    });
+}
+
+static void undefine_macro(struct preprocessor_context *const ctx, const ident_id name) {
+    macro_args_and_body *const macro = ident_id_macro_args_and_body_map_get_ptr(&ctx->macro_map, name);
+    if (macro == NULL) return;
+    if (ctx->changes != NULL) {
+        // The definition is needed to redefine the macro if the #undef is undone
+        if (macro->pch != NULL) pch_read_macro(macro);
+        record_change(ctx, (state_change) { .kind = STATE_CHANGE_UNDEF, .macro_name = name, .macro = *macro, .file = NULL });
+    }
+    ident_id_macro_args_and_body_map_remove(&ctx->macro_map, name);
+}
+
+static void preprocess_tree(const struct earley_rule group_opt_rule, struct preprocessor_context *const ctx) {
+    if (group_opt_rule.rhs.tag == OPT_NONE) {
+        return;
+    }
+    preprocess_group_parts(group_opt_rule.completed_from.data[0]->completed_from, ctx);
+}
+
+void preprocess_group_parts(const erule_p_harr group_parts, struct preprocessor_context *const ctx) {
+    ident_id_macro_args_and_body_map *const macro_map = &ctx->macro_map;
+    const struct diagnostic_file *const file = &ctx->current_source;
     pp_token_vec text_section = pp_token_vec_new(0);
-    for (size_t i = 0; i < group_rule.completed_from.len; i++) {
-        const struct earley_rule group_part_rule = *group_rule.completed_from.data[i];
+    for (size_t i = 0; i < group_parts.len; i++) {
+        const struct earley_rule group_part_rule = *group_parts.data[i];
         if (group_part_rule.rhs.tag != GROUP_PART_TEXT) {
-            pp_token_vec_append_all_harr(&out, replace_macros(text_section.arr, *macro_map, EXCLUDE_HEADER_NAME));
+            emit_tokens(ctx, replace_macros(text_section.arr, *macro_map, EXCLUDE_HEADER_NAME, file));
             text_section.arr.len = 0;  // TODO replace with call to shrink_retaining_capacity
         }
         switch ((enum group_part_tag)group_part_rule.rhs.tag) {
@@ -30,29 +163,41 @@ static pp_token_harr preprocess_tree(const struct earley_rule group_opt_rule, ss
                 const struct earley_rule control_line_rule = *group_part_rule.completed_from.data[0];
                 switch ((enum control_line_tag)control_line_rule.rhs.tag) {
                     case CONTROL_LINE_DEFINE_OBJECT_LIKE: {
-                        define_object_like_macro(control_line_rule, macro_map);
-                        print_with_color(TEXT_COLOR_LIGHT_RED, "Defined macro, all macros:\n");
-                        print_macros(macro_map);
-                        printf("\n");
+                        const ident_id name = directive_macro_name(control_line_rule);
+                        const bool was_defined = ident_id_macro_args_and_body_map_contains(macro_map, name);
+                        define_object_like_macro(control_line_rule, macro_map, file);
+                        record_define(ctx, name, was_defined);
+                        if (TRACING(MACRO, TRACE_DETAILED)) {
+                            print_with_color(TEXT_COLOR_LIGHT_RED, "Defined macro, all macros:\n");
+                            print_macros(macro_map);
+                            fprintf(trace_file(), "\n");
+                        }
                         break;
                     }
                     case CONTROL_LINE_DEFINE_FUNCTION_LIKE_MIXED_ARGS:
                     case CONTROL_LINE_DEFINE_FUNCTION_LIKE_ONLY_VARARGS:
                     case CONTROL_LINE_DEFINE_FUNCTION_LIKE_NO_VARARGS: {
-                        define_function_like_macro(control_line_rule, macro_map);
-                        print_with_color(TEXT_COLOR_LIGHT_RED, "Defined macro, all macros:\n");
-                        print_macros(macro_map);
-                        printf("\n");
+                        const ident_id name = directive_macro_name(control_line_rule);
+                        const bool was_defined = ident_id_macro_args_and_body_map_contains(macro_map, name);
+                        define_function_like_macro(control_line_rule, macro_map, file);
+                        record_define(ctx, name, was_defined);
+                        if (TRACING(MACRO, TRACE_DETAILED)) {
+                            print_with_color(TEXT_COLOR_LIGHT_RED, "Defined macro, all macros:\n");
+                            print_macros(macro_map);
+                            fprintf(trace_file(), "\n");
+                        }
                         break;
                     }
                     case CONTROL_LINE_UNDEF: {
                         // Removes the macro if it exists; does nothing if it doesn't
-                        sstr_macro_args_and_body_map_remove(macro_map, control_line_rule.completed_from.data[0]->rhs.symbols.data[0].val.terminal.token.name);
+                        undefine_macro(ctx, directive_macro_name(control_line_rule));
                         break;
                     }
                     case CONTROL_LINE_INCLUDE: {
                         const struct earley_rule pp_tokens_rule = *control_line_rule.completed_from.data[0];
-                        const pp_token_harr initial_arg_tokens = replace_macros(pp_tokens_rule_as_harr(pp_tokens_rule), *macro_map, EXCLUDE_STRING_LITERAL);
+                        const pp_token_harr arg_tokens = pp_tokens_rule_as_harr(pp_tokens_rule);
+                        const struct source_location arg_location = location_in(file, tokens_span(arg_tokens));
+                        const pp_token_harr initial_arg_tokens = replace_macros(arg_tokens, *macro_map, EXCLUDE_STRING_LITERAL, file);
                         uchar_vec chars_to_retokenize = uchar_vec_new(0);
                         for (size_t j = 0; j < initial_arg_tokens.len; j++) {
                             if (initial_arg_tokens.data[j].after_whitespace) {
@@ -60,29 +205,61 @@ static pp_token_harr preprocess_tree(const struct earley_rule group_opt_rule, ss
                             }
                             uchar_vec_append_all_harr(&chars_to_retokenize, initial_arg_tokens.data[j].name);
                         }
-                        const pp_token_harr retokenized_arg = get_pp_tokens(chars_to_retokenize.arr, true);
+                        struct token_stream retokenized_arg = get_pp_tokens(chars_to_retokenize.arr, true, DISCARD_COMMENTS);
 
                         if (retokenized_arg.len != 1) {
-                            preprocessor_fatal_error(0, 0, 0, "#include directive expects one argument");
+                            preprocessor_fatal_error(arg_location, "#include directive expects one argument");
                         }
-                        const struct preprocessing_token arg_token = retokenized_arg.data[0];
+                        const struct preprocessing_token arg_token = token_stream_get(&retokenized_arg, 0);
+                        token_stream_free_internals(&retokenized_arg);
                         if (arg_token.type != HEADER_NAME && arg_token.type != STRING_LITERAL) {
-                            preprocessor_fatal_error(0, 0, 0, "Invalid argument to #include directive");
+                            preprocessor_fatal_error(arg_location, "Invalid argument to #include directive");
                         }
                         const sstr filename_sstr = slice(arg_token.name, 1, arg_token.name.len - 1); // remove single quotes or angle brackets
                         char *include_filename = MALLOC(filename_sstr.len + 1);
                         memcpy(include_filename, filename_sstr.data, filename_sstr.len);
                         include_filename[filename_sstr.len] = '\0';
-                        FILE *include_file = fopen(include_filename, "r");
-                        if (include_file == NULL) {
-                            preprocessor_fatal_error(0, 0, 0, "Included file \"%s\" does not exist.", include_filename);
+                        const resolved_include included = find_included_file(ctx, include_filename, arg_token.name.data[0] == '"');
+                        if (included.file == NULL) {
+                            preprocessor_fatal_error(arg_location, "Included file \"%s\" does not exist.", include_filename);
+                        }
+                        FREE(include_filename);
+                        if (include_is_redundant(ctx, included.file)) {
+                            if (TRACING(INCLUDE, TRACE_DETAILED)) fprintf(trace_file(), "#include %.*s: skipped %s\n", (int)arg_token.name.len, (const char*)arg_token.name.data, included.path);
+                            break;
                         }
-                        pp_token_harr tokens_from_file = preprocess_included_file(include_file, macro_map);
-                        if (tokens_from_file.len > 0) {
-                            // To make sure it doesn't get smushed with what came before it
-                            tokens_from_file.data[0].after_whitespace = true;
+                        if (TRACING(INCLUDE, TRACE_BASIC)) fprintf(trace_file(), "#include %.*s: %s\n", (int)arg_token.name.len, (const char*)arg_token.name.data, included.path);
+                        const bool was_at_start_of_included_file = ctx->at_start_of_included_file;
+                        const struct diagnostic_file includer_source = ctx->current_source;
+                        const cached_file_p includer_file = ctx->current_file;
+                        ctx->at_start_of_included_file = true;
+                        ctx->current_source = diagnostic_file_of(included.path, included.file->buffer.contents, &included.file->parsed);
+                        ctx->current_file = included.file;
+                        preprocess_tree(*included.file->parsed.group_opt_rule, ctx);
+                        ctx->current_source = includer_source;
+                        ctx->current_file = includer_file;
+                        if (ctx->at_start_of_included_file) {
+                            // Nothing came out of the file, so whatever comes next is still where it was before
+                            ctx->at_start_of_included_file = was_at_start_of_included_file;
+                        }
+                        break;
+                    }
+                    case CONTROL_LINE_PRAGMA: {
+                        // #pragma once is the only pragma so far; the rest are ignored
+                        const struct earley_rule pp_tokens_opt_rule = *control_line_rule.completed_from.data[0];
+                        // Files that aren't regular files have no identity to remember them by
+                        if (pp_tokens_opt_rule.rhs.tag == OPT_NONE || ctx->current_file == NULL || ctx->current_file->id.ino == 0) break;
+                        const pp_token_harr pragma_tokens = pp_tokens_rule_as_harr(*pp_tokens_opt_rule.completed_from.data[0]);
+                        if (pragma_tokens.data[0].ident == IDENT_ONCE
+                            && !file_id_cached_file_p_map_contains(&ctx->pragma_once_files, ctx->current_file->id)) {
+                            file_id_cached_file_p_map_add(&ctx->pragma_once_files, ctx->current_file->id, ctx->current_file);
+                            record_change(ctx, (state_change) {
+                                .kind = STATE_CHANGE_PRAGMA_ONCE,
+                                .macro_name = NO_IDENT,
+                                .macro = { .args = { .data = NULL, .len = 0 }, .replacements = { .data = NULL, .len = 0 }, .pch = NULL },
+                                .file = ctx->current_file
+                            });
                         }
-                        pp_token_vec_append_all_harr(&out, tokens_from_file);
                         break;
                     }
                 }
@@ -107,41 +284,118 @@ static pp_token_harr preprocess_tree(const struct earley_rule group_opt_rule, ss
             }
             case GROUP_PART_IF: {
                 const struct earley_rule if_section_rule = *group_part_rule.completed_from.data[0];
-                struct earley_rule *const included_group_opt = eval_if_section(if_section_rule, *macro_map);
+                struct earley_rule *const included_group_opt = eval_if_section(if_section_rule, *macro_map, file);
                 if (included_group_opt) {
-                    pp_token_vec_append_all_harr(&out, preprocess_tree(*included_group_opt, macro_map));
+                    preprocess_tree(*included_group_opt, ctx);
                 }
                 break;
             }
-            case GROUP_PART_NON_DIRECTIVE:
-                preprocessor_fatal_error(0, 0, 0, "invalid directive");
+            case GROUP_PART_NON_DIRECTIVE: {
+                struct preprocessing_token hash;
+                const bool has_tokens = rule_first_token(&group_part_rule, &hash);
+                preprocessor_fatal_error(has_tokens ? location_in(file, hash.name) : file_location(file), "invalid directive");
+            }
+        }
+    }
+    emit_tokens(ctx, replace_macros(text_section.arr, *macro_map, EXCLUDE_HEADER_NAME, file));
+}
+
+// Turns the -D options into a source file full of #defines, so they can be defined like any other macro
+static sstr command_line_definitions(const char_p_harr defines) {
+    uchar_vec text = uchar_vec_new(0);
+    for (size_t i = 0; i < defines.len; i++) {
+        const char *const define = defines.data[i];
+        const char *const equals = strchr(define, '=');
+        const size_t name_len = equals == NULL ? strlen(define) : (size_t)(equals - define);
+        uchar_vec_append_all_arr(&text, (const unsigned char *)"#define ", strlen("#define "));
+        uchar_vec_append_all_arr(&text, (const unsigned char *)define, name_len);
+        uchar_vec_append(&text, ' ');
+        if (equals == NULL) {
+            // -DNAME defines NAME as 1
+            uchar_vec_append(&text, '1');
+        } else {
+            uchar_vec_append_all_arr(&text, (const unsigned char *)equals + 1, strlen(equals + 1));
         }
+        uchar_vec_append(&text, '\n');
     }
-    pp_token_vec_append_all_harr(&out, replace_macros(text_section.arr, *macro_map, EXCLUDE_HEADER_NAME));
-    return out.arr;
-}
-
-static pp_token_harr preprocess_included_file(FILE *input_file, sstr_macro_args_and_body_map *macro_map) {
-    const size_t input_len = get_filesize(input_file);
-    unsigned char *input_chars = MALLOC(input_len+1);
-    fread(input_chars, sizeof(unsigned char), input_len, input_file);
-    fclose(input_file);
-    input_chars[input_len] = '\n'; // too much of a pain without this
-
-    const struct trigraph_replacement_info trigraph_replacement = replace_trigraphs(
-            (sstr){ .data = input_chars, .len = input_len + 1 }
-    );
-    const struct escaped_newlines_replacement_info logical_lines = rm_escaped_newlines(trigraph_replacement.result);
-    const pp_token_harr tokens = get_pp_tokens(logical_lines.result, false);
-    const struct earley_rule *const parse_root = parse_full_file(tokens);
-    if (parse_root == NULL) {
-        preprocessor_fatal_error(0, 0, 0, "Parsing failed");
+    return text.arr;
+}
+
+static struct preprocessor_context new_context(const struct preprocessor_options options) {
+    return (struct preprocessor_context) {
+        .macro_map = ident_id_macro_args_and_body_map_new(0),
+        .options = options,
+        .current_source = unread_file(NULL),
+        .current_file = NULL,
+        .resolved_includes = char_p_resolved_include_map_new(16),
+        .pragma_once_files = file_id_cached_file_p_map_new(16),
+        .printer = NULL,
+        .token_collector = NULL,
+        .at_start_of_included_file = false,
+        .changes = NULL,
+        .state_fingerprint = 0
+    };
+}
+
+// Everything that comes before the main file: the PCH and the -D options
+static void preprocess_prelude(struct preprocessor_context *const ctx, const char *const fname) {
+    const struct pch *const pch = ctx->options.pch;
+    if (pch != NULL) {
+        // The prefix comes before everything else, so the -D options can see (and complain about redefining) its macros
+        pch_seed_macros(pch, &ctx->macro_map);
+    }
+    if (ctx->options.defines.len > 0) {
+        // The text is never freed, since the macro bodies point into it
+        const char *const defines_fname = "<command line>";
+        const sstr defines = command_line_definitions(ctx->options.defines);
+        const struct parsed_file parsed = parse_source(defines_fname, defines, false);
+        ctx->current_source = diagnostic_file_of(defines_fname, defines, &parsed);
+        preprocess_tree(*parsed.group_opt_rule, ctx);
+    }
+    if (pch != NULL && pch->tokens.len > 0) {
+        emit_tokens(ctx, pch->tokens);
+        ctx->at_start_of_included_file = true;
+    }
+    ctx->current_source = unread_file(fname);
+}
+
+static void preprocess_main_file(struct preprocessor_context *const ctx, const struct source_buffer input, const char *const fname) {
+    preprocess_prelude(ctx, fname);
+    const struct parsed_file parsed = parse_source(fname, input.contents, true);
+    ctx->current_source = diagnostic_file_of(fname, input.contents, &parsed);
+    preprocess_tree(*parsed.group_opt_rule, ctx);
+}
+
+// Releases every included file, once nothing points into them anymore. The paths are kept, for the dependencies.
+static void release_included_files(const struct preprocessor_context *const ctx) {
+    for (size_t i = 0; i < ctx->resolved_includes.n_buckets; i++) {
+        for (const NODE_T(char_p, resolved_include) *node = ctx->resolved_includes.buckets[i]; node != NULL; node = node->next) {
+            file_cache_release(node->value.file);
+        }
     }
-    const struct earley_rule group_opt_rule = *parse_root->completed_from.data[0];
-    return preprocess_tree(group_opt_rule, macro_map);
 }
 
-pp_token_harr preprocess_file(FILE *input_file) {
-    sstr_macro_args_and_body_map macro_map = sstr_macro_args_and_body_map_new(0);
-    return preprocess_included_file(input_file, &macro_map);
+struct preprocessor_context start_main_file(const struct preprocessor_options options, const char *const fname, pp_token_vec *const token_collector) {
+    struct preprocessor_context ctx = new_context(options);
+    ctx.token_collector = token_collector;
+    preprocess_prelude(&ctx, fname);
+    return ctx;
+}
+
+void preprocess_file(const struct source_buffer input, const char *const fname, const struct preprocessor_options options, struct token_printer *const printer) {
+    struct preprocessor_context ctx = new_context(options);
+    ctx.printer = printer;
+    preprocess_main_file(&ctx, input, fname);
+    token_printer_finish(printer);
+    release_included_files(&ctx);
+}
+
+void emit_pch(const struct source_buffer input, const char *const fname, const struct preprocessor_options options, const char *const pch_fname) {
+    struct preprocessor_context ctx = new_context(options);
+    pp_token_vec tokens = pp_token_vec_new(0);
+    ctx.token_collector = &tokens;
+    preprocess_main_file(&ctx, input, fname);
+    write_pch(pch_fname, &ctx.macro_map, tokens.arr);
+    FREE(tokens.arr.data);
+    release_included_files(&ctx);
 }
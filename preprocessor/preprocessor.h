@@ -1,8 +1,91 @@
 #ifndef PREPROCESSOR_H
 #define PREPROCESSOR_H
 
+#include <stdint.h>
+#include "diagnostics.h"
+#include "file_cache.h"
+#include "header_search.h"
 #include "macro_expansion.h"
+#include "pch.h"
+#include "data_structures/map.h"
+#include "driver/source_buffer.h"
 
-pp_token_harr preprocess_file(FILE *input_file);
+struct preprocessor_options {
+    char_p_harr defines; // NAME or NAME=VALUE, as given to -D
+    struct include_search_path search_path;
+    const struct pch *pch; // the prefix from --include-pch, or NULL
+    // If not NULL, the normalized path of every file the translation unit includes is added here, once each
+    char_p_vec *dependencies;
+    bool skip_system_dependencies; // if true, files found in -isystem directories aren't added to dependencies
+};
+
+// An include path that's already been resolved in this translation unit. path is the same string as the map key,
+// and has been normalized.
+typedef struct resolved_include {
+    const char *path;
+    cached_file_p file;
+} resolved_include;
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(char_p, resolved_include, hash_cstr, cstrs_eq)
+DEFINE_MAP_TYPE_AND_FUNCTIONS(file_id, cached_file_p, hash_file_id, file_ids_eq)
+
+enum state_change_kind {
+    STATE_CHANGE_DEFINE, STATE_CHANGE_UNDEF, STATE_CHANGE_PRAGMA_ONCE
+};
+
+// One change to the macros or to the set of #pragma once files, recorded so it can be undone and redone
+typedef struct state_change {
+    enum state_change_kind kind;
+    ident_id macro_name; // for defines and undefs
+    macro_args_and_body macro; // the macro that was defined, or that was there before being undefined
+    cached_file_p file; // for #pragma once
+} state_change;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(state_change)
+
+struct preprocessor_context {
+    ident_id_macro_args_and_body_map macro_map;
+    struct preprocessor_options options;
+    // The file being preprocessed right now, which diagnostics point into ("<command line>" for the -D options)
+    struct diagnostic_file current_source;
+    cached_file_p current_file; // NULL for the main file and the command line definitions
+    // Paths that have been included before, so that a guarded file can be skipped without even being opened
+    char_p_resolved_include_map resolved_includes;
+    file_id_cached_file_p_map pragma_once_files;
+    struct token_printer *printer; // where the output goes as soon as each text section is expanded
+    pp_token_vec *token_collector; // if not NULL, output tokens are collected here instead of printed
+    bool at_start_of_included_file; // if true, the next token printed gets whitespace before it
+    // If not NULL, every change to the macros and the #pragma once files is appended here, and state_fingerprint is kept
+    // up to date: it's the XOR of a hash of every defined macro and #pragma once file that wasn't there when tracking
+    // started (or that was, and isn't anymore). Equal fingerprints mean equal states, unless there's a collision.
+    state_change_vec *changes;
+    uint64_t state_fingerprint;
+};
+
+/*
+ * Starts preprocessing the main file fname: defines the PCH's macros and the -D macros, and emits the PCH's tokens.
+ * The output goes to token_collector. The files it includes are never released from the file cache.
+ */
+struct preprocessor_context start_main_file(struct preprocessor_options options, const char *fname, pp_token_vec *token_collector);
+
+/*
+ * Executes a sequence of group parts, as found in a group.
+ */
+void preprocess_group_parts(erule_p_harr group_parts, struct preprocessor_context *ctx);
+
+/*
+ * The hash that a change contributes to preprocessor_context.state_fingerprint.
+ */
+uint64_t state_change_hash(state_change change);
+
+/*
+ * Preprocesses input, which was read from fname, printing the output tokens as they're produced, then finishes the output.
+ */
+void preprocess_file(struct source_buffer input, const char *fname, struct preprocessor_options options, struct token_printer *printer);
+
+/*
+ * Preprocesses a prefix header, which was read from fname, and writes the macros it leaves defined and the tokens
+ * it expands to to the PCH file pch_fname.
+ */
+void emit_pch(struct source_buffer input, const char *fname, struct preprocessor_options options, const char *pch_fname);
 
 #endif //PREPROCESSOR_H
@@ -0,0 +1,32 @@
+#include "source_map.h"
+
+void source_map_add_breakpoint(source_map_breakpoint_vec *const breakpoints, const size_t logical_index, const size_t raw_delta) {
+    if (breakpoints->arr.len > 0) {
+        source_map_breakpoint *const last = &breakpoints->arr.data[breakpoints->arr.len - 1];
+        if (last->logical_start == logical_index) {
+            // Adjacent rewrites (e.g. two escaped newlines in a row) collapse into a single breakpoint
+            last->raw_delta = raw_delta;
+            return;
+        }
+    }
+    source_map_breakpoint_vec_append(breakpoints, (source_map_breakpoint) {
+        .logical_start = logical_index,
+        .raw_delta = raw_delta
+    });
+}
+
+size_t source_map_raw_index(const struct source_map map, const size_t logical_index) {
+    // Find the number of breakpoints that start at or before logical_index
+    size_t lo = 0;
+    size_t hi = map.breakpoints.len;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (map.breakpoints.data[mid].logical_start <= logical_index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return logical_index;
+    return logical_index + map.breakpoints.data[lo - 1].raw_delta;
+}
@@ -0,0 +1,38 @@
+#ifndef ICK_SOURCE_MAP_H
+#define ICK_SOURCE_MAP_H
+
+#include <stddef.h>
+#include "data_structures/vector.h"
+
+/*
+ * Every logical index at or after logical_start (up to the next breakpoint) is raw_delta characters
+ * before the corresponding index in the raw file.
+ */
+typedef struct source_map_breakpoint {
+    size_t logical_start;
+    size_t raw_delta;
+} source_map_breakpoint;
+DEFINE_VEC_TYPE_AND_FUNCTIONS(source_map_breakpoint)
+
+/*
+ * Maps indices in the output of translation phase 2 back to indices in the raw file.
+ * The map is piecewise constant: there's one breakpoint per run of trigraphs/escaped newlines, sorted by logical_start,
+ * and indices before the first breakpoint are unchanged.
+ */
+struct source_map {
+    source_map_breakpoint_harr breakpoints;
+};
+
+/*
+ * Records that logical_index and everything after it are raw_delta characters behind the raw file.
+ * Breakpoints must be added in increasing order of logical_index.
+ */
+void source_map_add_breakpoint(source_map_breakpoint_vec *breakpoints, size_t logical_index, size_t raw_delta);
+
+/*
+ * Returns the index into the raw file for an index into the output of phase 2. O(log n) in the number of breakpoints.
+ * A replaced trigraph maps to the first character of the trigraph.
+ */
+size_t source_map_raw_index(struct source_map map, size_t logical_index);
+
+#endif //ICK_SOURCE_MAP_H
@@ -0,0 +1,269 @@
+#include "token_cache.h"
+#include "data_structures/map.h"
+#include "debug/malloc.h"
+#include "driver/diagnostics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *cache_dir = NULL;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct token_cache_stats stats = { .hits = 0, .misses = 0, .bytes_mapped = 0 };
+
+void token_cache_set_dir(const char *const dir) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        driver_error("Couldn't create token cache directory \"%s\". Errno: %d (%s).", dir, errno, strerror(errno));
+    }
+    cache_dir = dir;
+}
+
+bool token_cache_enabled(void) {
+    return cache_dir != NULL;
+}
+
+struct token_cache_key token_cache_key(const sstr raw_contents) {
+    const uint32_t version = LEXER_VERSION;
+    struct sha256 hash = sha256_new();
+    sha256_update(&hash, &version, sizeof(version));
+    sha256_update(&hash, raw_contents.data, raw_contents.len);
+    struct token_cache_key key;
+    sha256_finish(&hash, key.hash);
+    return key;
+}
+
+// Returns a malloc'd path: the key in hex, followed by suffix
+static char *entry_path(const struct token_cache_key key, const char *const suffix) {
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(&hex[2*i], 3, "%02x", key.hash[i]);
+    }
+    const size_t len = strlen(cache_dir) + 1 + sizeof(hex) + strlen(suffix);
+    char *const path = MALLOC(len);
+    snprintf(path, len, "%s/%s%s", cache_dir, hex, suffix);
+    return path;
+}
+
+static void count_lookup(const bool hit, const size_t bytes_mapped) {
+    pthread_mutex_lock(&stats_lock);
+    if (hit) stats.hits++;
+    else stats.misses++;
+    stats.bytes_mapped += bytes_mapped;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Whether n_items items of item_size bytes starting at offset fit in len bytes, aligned to alignment
+static bool in_bounds(const size_t len, const size_t offset, const size_t n_items, const size_t item_size, const size_t alignment) {
+    return offset % alignment == 0 && offset <= len && n_items <= (len - offset) / item_size;
+}
+
+#define ARRAY_IN_BOUNDS(len, offset, n_items, type) in_bounds((len), (offset), (n_items), sizeof(type), _Alignof(type))
+
+// The array of type at offset in the entry
+#define ENTRY_ARRAY(base, offset, type) ((type *)(void *)((base) + (offset)))
+
+// Checks everything a corrupt entry could make the preprocessor read out of bounds
+static bool entry_is_valid(unsigned char *const base, const size_t len, const struct token_cache_key key) {
+    if (len < sizeof(struct token_cache_header)) return false;
+    const struct token_cache_header *const header = ENTRY_ARRAY(base, 0, const struct token_cache_header);
+    const size_t n_tokens = header->n_tokens;
+    if (memcmp(header->magic, TOKEN_CACHE_MAGIC, sizeof(header->magic)) != 0
+    || memcmp(header->key, key.hash, SHA256_DIGEST_SIZE) != 0
+    || !ARRAY_IN_BOUNDS(len, header->breakpoints_offset, header->n_breakpoints, source_map_breakpoint)
+    || !ARRAY_IN_BOUNDS(len, header->offsets_offset, n_tokens, uint32_t)
+    || !ARRAY_IN_BOUNDS(len, header->lengths_or_idents_offset, n_tokens, uint32_t)
+    || !ARRAY_IN_BOUNDS(len, header->kinds_offset, n_tokens, uint8_t)
+    || !ARRAY_IN_BOUNDS(len, header->flags_offset, n_tokens, uint8_t)
+    || !ARRAY_IN_BOUNDS(len, header->idents_offset, header->n_idents, struct token_cache_ident)
+    || !ARRAY_IN_BOUNDS(len, header->logical_lines_offset, header->logical_lines_len, unsigned char)) {
+        return false;
+    }
+    const size_t logical_lines_len = header->logical_lines_len;
+    const struct token_cache_ident *const idents = ENTRY_ARRAY(base, header->idents_offset, const struct token_cache_ident);
+    for (size_t i = 0; i < header->n_idents; i++) {
+        if (idents[i].offset > logical_lines_len || idents[i].len > logical_lines_len - idents[i].offset) return false;
+    }
+    const uint32_t *const offsets = ENTRY_ARRAY(base, header->offsets_offset, const uint32_t);
+    const uint32_t *const lengths_or_idents = ENTRY_ARRAY(base, header->lengths_or_idents_offset, const uint32_t);
+    const uint8_t *const kinds = ENTRY_ARRAY(base, header->kinds_offset, const uint8_t);
+    const uint8_t *const flags = ENTRY_ARRAY(base, header->flags_offset, const uint8_t);
+    for (size_t i = 0; i < n_tokens; i++) {
+        const enum pp_token_type type = (enum pp_token_type)(flags[i] & TOKEN_STREAM_TYPE_MASK);
+        size_t name_len = lengths_or_idents[i];
+        if (type == IDENTIFIER) {
+            if (lengths_or_idents[i] >= header->n_idents) return false;
+            name_len = idents[lengths_or_idents[i]].len;
+        }
+        if (type > COMMENT || kinds[i] > TOKEN_NEWLINE || offsets[i] > logical_lines_len || name_len > logical_lines_len - offsets[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool token_cache_lookup(const struct token_cache_key key, struct lexed_source *const out) {
+    char *const path = entry_path(key, ".tok");
+    const int fd = open(path, O_RDONLY);
+    FREE(path);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        if (fd != -1) close(fd);
+        count_lookup(false, 0);
+        return false;
+    }
+    const size_t len = (size_t)st.st_size;
+    unsigned char *const base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || !entry_is_valid(base, len, key)) {
+        // A corrupt or colliding entry is treated as missing, and gets overwritten once the file is lexed
+        if (base != MAP_FAILED) munmap(base, len);
+        count_lookup(false, 0);
+        return false;
+    }
+
+    const struct token_cache_header *const header = ENTRY_ARRAY(base, 0, const struct token_cache_header);
+    const sstr logical_lines = { .data = base + header->logical_lines_offset, .len = header->logical_lines_len };
+    const struct token_cache_ident *const idents = ENTRY_ARRAY(base, header->idents_offset, const struct token_cache_ident);
+    ident_id *const local_idents = MALLOC((header->n_idents > 0 ? header->n_idents : 1) * sizeof(ident_id));
+    for (size_t i = 0; i < header->n_idents; i++) {
+        local_idents[i] = intern(slice(logical_lines, idents[i].offset, idents[i].offset + idents[i].len));
+    }
+    *out = (struct lexed_source) {
+        .logical_lines = logical_lines,
+        .source_map = {
+            .breakpoints = { .data = ENTRY_ARRAY(base, header->breakpoints_offset, source_map_breakpoint), .len = header->n_breakpoints }
+        },
+        .tokens = {
+            .source = logical_lines,
+            .offsets = ENTRY_ARRAY(base, header->offsets_offset, uint32_t),
+            .lengths_or_idents = ENTRY_ARRAY(base, header->lengths_or_idents_offset, uint32_t),
+            .kinds = ENTRY_ARRAY(base, header->kinds_offset, uint8_t),
+            .flags = ENTRY_ARRAY(base, header->flags_offset, uint8_t),
+            .len = header->n_tokens,
+            .capacity = header->n_tokens,
+            .local_idents = local_idents
+        },
+        .cache_entry = { .data = base, .len = len }
+    };
+    count_lookup(true, len);
+    return true;
+}
+
+void lexed_source_free_internals(const struct lexed_source *const lexed, const sstr contents) {
+    if (lexed->cache_entry.data != NULL) {
+        FREE(lexed->tokens.local_idents);
+        munmap(lexed->cache_entry.data, lexed->cache_entry.len);
+        return;
+    }
+    // Phase 2 only makes a copy if it changes something
+    if (lexed->logical_lines.data != contents.data) FREE(lexed->logical_lines.data);
+    FREE(lexed->source_map.breakpoints.data);
+    struct token_stream tokens = lexed->tokens;
+    token_stream_free_internals(&tokens);
+}
+
+static bool write_fully(const int fd, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t n_written = write(fd, data, len);
+        if (n_written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n_written;
+        len -= (size_t)n_written;
+    }
+    return true;
+}
+
+// Pads the entry to alignment, then appends n_bytes from data, and returns the offset they start at
+static uint32_t append_section(uchar_vec *const entry, const void *const data, const size_t n_bytes, const size_t alignment) {
+    while (entry->arr.len % alignment != 0) uchar_vec_append(entry, 0);
+    const size_t offset = entry->arr.len;
+    uchar_vec_append_all_arr(entry, data, n_bytes);
+    return (uint32_t)offset;
+}
+
+DEFINE_MAP_TYPE_AND_FUNCTIONS(ident_id, uint32_t, hash_ident_id, ident_ids_eq)
+
+void token_cache_store(const struct token_cache_key key, const struct lexed_source lexed) {
+    const struct token_stream *const tokens = &lexed.tokens;
+    // Each distinct identifier gets an index into the entry's table, in order of first use
+    ident_id_uint32_t_map ident_indexes = ident_id_uint32_t_map_new(256);
+    uchar_vec idents = uchar_vec_new(0);
+    uint32_t *const lengths_or_idents = MALLOC((tokens->len > 0 ? tokens->len : 1) * sizeof(uint32_t));
+    for (token_handle i = 0; i < tokens->len; i++) {
+        if (token_stream_type(tokens, i) != IDENTIFIER) {
+            lengths_or_idents[i] = tokens->lengths_or_idents[i];
+            continue;
+        }
+        const ident_id ident = token_stream_ident(tokens, i);
+        const uint32_t *const index = ident_id_uint32_t_map_get_ptr(&ident_indexes, ident);
+        if (index != NULL) {
+            lengths_or_idents[i] = *index;
+            continue;
+        }
+        const uint32_t new_index = (uint32_t)ident_indexes.n_elements;
+        ident_id_uint32_t_map_add(&ident_indexes, ident, new_index);
+        const struct token_cache_ident record = { .offset = tokens->offsets[i], .len = (uint32_t)ident_spelling(ident).len };
+        uchar_vec_append_all_arr(&idents, (const unsigned char *)&record, sizeof(record));
+        lengths_or_idents[i] = new_index;
+    }
+
+    // The header goes in last, once the offsets are known
+    uchar_vec entry = uchar_vec_new(sizeof(struct token_cache_header) + 10 * tokens->len + lexed.logical_lines.len);
+    struct token_cache_header header;
+    memset(&header, 0, sizeof(header));
+    uchar_vec_append_all_arr(&entry, (const unsigned char *)&header, sizeof(header));
+    header.n_breakpoints = (uint32_t)lexed.source_map.breakpoints.len;
+    header.breakpoints_offset = append_section(&entry, lexed.source_map.breakpoints.data,
+                                               lexed.source_map.breakpoints.len * sizeof(source_map_breakpoint), _Alignof(source_map_breakpoint));
+    header.n_tokens = (uint32_t)tokens->len;
+    header.offsets_offset = append_section(&entry, tokens->offsets, tokens->len * sizeof(uint32_t), _Alignof(uint32_t));
+    header.lengths_or_idents_offset = append_section(&entry, lengths_or_idents, tokens->len * sizeof(uint32_t), _Alignof(uint32_t));
+    header.kinds_offset = append_section(&entry, tokens->kinds, tokens->len, 1);
+    header.flags_offset = append_section(&entry, tokens->flags, tokens->len, 1);
+    header.n_idents = (uint32_t)ident_indexes.n_elements;
+    header.idents_offset = append_section(&entry, idents.arr.data, idents.arr.len, _Alignof(struct token_cache_ident));
+    header.logical_lines_len = (uint32_t)lexed.logical_lines.len;
+    header.logical_lines_offset = append_section(&entry, lexed.logical_lines.data, lexed.logical_lines.len, 1);
+    memcpy(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.key, key.hash, SHA256_DIGEST_SIZE);
+    memcpy(entry.arr.data, &header, sizeof(header));
+
+    char *const path = entry_path(key, ".tok");
+    char *const temp_path = entry_path(key, ".tok.tmp.XXXXXX");
+    // Offsets are 32 bits, so the entry has to be less than 4 GiB
+    if (entry.arr.len <= UINT32_MAX) {
+        const int fd = mkstemp(temp_path);
+        if (fd != -1) {
+            // mkstemp makes the file private, but other users' builds may share the directory
+            fchmod(fd, 0644);
+            // Unlike the output sink, a failed write here just means the entry isn't published.
+            // Whoever renames last wins, which is fine, since every writer writes the same bytes.
+            const bool written = write_fully(fd, entry.arr.data, entry.arr.len);
+            if (close(fd) != 0 || !written || rename(temp_path, path) != 0) {
+                unlink(temp_path);
+            }
+        }
+    }
+    FREE(temp_path);
+    FREE(path);
+    FREE(lengths_or_idents);
+    ident_id_uint32_t_map_free_internals(&ident_indexes);
+    FREE(ident_indexes.buckets);
+    uchar_vec_free_internals(&entry);
+    uchar_vec_free_internals(&idents);
+}
+
+struct token_cache_stats token_cache_get_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    const struct token_cache_stats result = stats;
+    pthread_mutex_unlock(&stats_lock);
+    return result;
+}
@@ -0,0 +1,107 @@
+#ifndef ICK_TOKEN_CACHE_H
+#define ICK_TOKEN_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pp_token.h"
+#include "source_map.h"
+#include "token_stream.h"
+#include "driver/sha256.h"
+
+/*
+ * An on-disk cache of lexed files, shared by every ick process that uses the same directory.
+ *
+ * Entries are named after the SHA-256 of LEXER_VERSION and the file's raw bytes, so a file is never lexed twice no
+ * matter where it lives, and changing the lexer never picks up stale entries. Each entry is one read-only file,
+ * mmap'd and used in place: the source map and the token stream's arrays point straight into it, so a hit costs a
+ * bounds check of each token and one intern() per distinct identifier. It's laid out as:
+ *     struct token_cache_header
+ *     source_map_breakpoint[n_breakpoints] (the source map)
+ *     the token stream's arrays, each n_tokens long: offsets, lengths_or_idents, kinds, flags
+ *     struct token_cache_ident[n_idents]
+ *     the output of phase 2, which every token name is a slice of
+ * Identifier IDs belong to a process, so an identifier's lengths_or_idents is an index into the entry's identifier
+ * table, which is interned when the entry is mapped.
+ * Integers are in the byte order and size of the machine that wrote the file, offsets are from the start of the file,
+ * and every array is aligned for its type.
+ * Entries are written to a temporary file and renamed into place, so readers never need a lock and never see part of one.
+ */
+
+// Bump whenever phases 1-3 change what they produce for the same input, or the entries change what they store.
+// 2: ";" is a punctuator, "%=" is one token
+// 3: entries hold the token stream's arrays, including each token's enum token_kind
+// 4: the input after a token that's still incomplete at the end of the file (e.g. an unterminated comment) is lexed
+#define LEXER_VERSION 4
+
+#define TOKEN_CACHE_MAGIC "ICKTOK2"
+
+struct token_cache_header {
+    char magic[8]; // TOKEN_CACHE_MAGIC, including its terminating null
+    unsigned char key[SHA256_DIGEST_SIZE];
+    uint32_t n_breakpoints;
+    uint32_t breakpoints_offset;
+    uint32_t n_tokens;
+    uint32_t offsets_offset;
+    uint32_t lengths_or_idents_offset;
+    uint32_t kinds_offset;
+    uint32_t flags_offset;
+    uint32_t n_idents;
+    uint32_t idents_offset;
+    uint32_t logical_lines_len;
+    uint32_t logical_lines_offset;
+};
+
+// One distinct identifier, as a slice of the logical lines
+struct token_cache_ident {
+    uint32_t offset;
+    uint32_t len;
+};
+
+// A file after translation phases 1-3
+struct lexed_source {
+    sstr logical_lines;
+    struct source_map source_map;
+    struct token_stream tokens; // of logical_lines
+    sstr cache_entry; // the mapped token cache entry that all of the above point into; NULL if they're on the heap
+};
+
+/*
+ * Frees lexed, which was lexed from contents (or found in the token cache for them). contents isn't freed.
+ */
+void lexed_source_free_internals(const struct lexed_source *lexed, sstr contents);
+
+struct token_cache_key {
+    unsigned char hash[SHA256_DIGEST_SIZE];
+};
+
+/*
+ * Turns on the cache, creating dir if it doesn't exist. Must be called before any other thread starts preprocessing.
+ */
+void token_cache_set_dir(const char *dir);
+
+bool token_cache_enabled(void);
+
+struct token_cache_key token_cache_key(sstr raw_contents);
+
+/*
+ * Maps the entry for key. Returns false, leaving *out untouched, if there's no valid entry.
+ * The result points into the mapping, so its token stream can't be changed, and it's only unmapped by
+ * lexed_source_free_internals.
+ */
+bool token_cache_lookup(struct token_cache_key key, struct lexed_source *out);
+
+/*
+ * Publishes an entry for key. Failing to write it isn't an error; the file just gets lexed again next time.
+ */
+void token_cache_store(struct token_cache_key key, struct lexed_source lexed);
+
+struct token_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t bytes_mapped;
+};
+
+struct token_cache_stats token_cache_get_stats(void);
+
+#endif //ICK_TOKEN_CACHE_H
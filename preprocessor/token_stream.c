@@ -0,0 +1,84 @@
+#include "token_stream.h"
+#include <string.h>
+#include "debug/malloc.h"
+#include "preprocessor/diagnostics.h"
+
+static void allocate(struct token_stream *const stream, const size_t capacity) {
+    stream->offsets = REALLOC(stream->offsets, capacity * sizeof(uint32_t));
+    stream->lengths_or_idents = REALLOC(stream->lengths_or_idents, capacity * sizeof(uint32_t));
+    stream->kinds = REALLOC(stream->kinds, capacity * sizeof(uint8_t));
+    stream->flags = REALLOC(stream->flags, capacity * sizeof(uint8_t));
+    stream->capacity = capacity;
+}
+
+struct token_stream token_stream_new(const sstr source, const size_t capacity) {
+    if (source.len > UINT32_MAX) preprocessor_fatal_error(NO_SOURCE_LOCATION, "Source is too large to tokenize (%zu bytes)", source.len);
+    struct token_stream stream = {
+        .source = source,
+        .offsets = NULL, .lengths_or_idents = NULL, .kinds = NULL, .flags = NULL,
+        .len = 0, .capacity = 0, .local_idents = NULL
+    };
+    allocate(&stream, capacity > 0 ? capacity : 1);
+    return stream;
+}
+
+void token_stream_append(struct token_stream *const stream, const struct preprocessing_token token) {
+    if (token.name.data < stream->source.data || token.name.data + token.name.len > stream->source.data + stream->source.len) {
+        preprocessor_fatal_error(NO_SOURCE_LOCATION, "Token %.*s isn't part of its stream's source", (int)token.name.len, (const char*)token.name.data);
+    }
+    if (stream->len == stream->capacity) allocate(stream, stream->capacity * 2);
+    const size_t i = stream->len++;
+    stream->offsets[i] = (uint32_t)(token.name.data - stream->source.data);
+    stream->lengths_or_idents[i] = token.type == IDENTIFIER ? token.ident : (uint32_t)token.name.len;
+    stream->kinds[i] = (uint8_t)token.kind;
+    stream->flags[i] = (uint8_t)((unsigned)token.type | (token.after_whitespace ? TOKEN_STREAM_AFTER_WHITESPACE : 0));
+}
+
+struct preprocessing_token token_stream_get(const struct token_stream *const stream, const token_handle handle) {
+    const enum pp_token_type type = token_stream_type(stream, handle);
+    const ident_id ident = token_stream_ident(stream, handle);
+    return (struct preprocessing_token) {
+        .name = {
+            .data = stream->source.data + stream->offsets[handle],
+            .len = type == IDENTIFIER ? ident_spelling(ident).len : stream->lengths_or_idents[handle]
+        },
+        .type = type,
+        .kind = token_stream_kind(stream, handle),
+        .ident = ident,
+        .after_whitespace = (stream->flags[handle] & TOKEN_STREAM_AFTER_WHITESPACE) != 0
+    };
+}
+
+void token_stream_append_all(struct token_stream *const stream, const struct token_stream *const other, const token_handle first) {
+    if (other->source.data != stream->source.data) preprocessor_fatal_error(NO_SOURCE_LOCATION, "Appending tokens from a different source");
+    if (other->local_idents != NULL) preprocessor_fatal_error(NO_SOURCE_LOCATION, "Appending tokens with local identifier indexes");
+    const size_t n_tokens = other->len - first;
+    if (stream->capacity - stream->len < n_tokens) allocate(stream, stream->len + n_tokens);
+    memcpy(&stream->offsets[stream->len], &other->offsets[first], n_tokens * sizeof(uint32_t));
+    memcpy(&stream->lengths_or_idents[stream->len], &other->lengths_or_idents[first], n_tokens * sizeof(uint32_t));
+    memcpy(&stream->kinds[stream->len], &other->kinds[first], n_tokens * sizeof(uint8_t));
+    memcpy(&stream->flags[stream->len], &other->flags[first], n_tokens * sizeof(uint8_t));
+    stream->len += n_tokens;
+}
+
+pp_token_harr token_stream_to_harr(const struct token_stream *const stream) {
+    pp_token_vec out = pp_token_vec_new(stream->len);
+    for (token_handle i = 0; i < stream->len; i++) {
+        pp_token_vec_append(&out, token_stream_get(stream, i));
+    }
+    return out.arr;
+}
+
+void token_stream_set_after_whitespace(struct token_stream *const stream, const token_handle handle, const bool after_whitespace) {
+    if (after_whitespace) stream->flags[handle] |= TOKEN_STREAM_AFTER_WHITESPACE;
+    else stream->flags[handle] &= (uint8_t)~TOKEN_STREAM_AFTER_WHITESPACE;
+}
+
+void token_stream_free_internals(struct token_stream *const stream) {
+    FREE(stream->offsets);
+    FREE(stream->lengths_or_idents);
+    FREE(stream->kinds);
+    FREE(stream->flags);
+    stream->len = 0;
+    stream->capacity = 0;
+}
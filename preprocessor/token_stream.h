@@ -0,0 +1,75 @@
+#ifndef ICK_TOKEN_STREAM_H
+#define ICK_TOKEN_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pp_token.h"
+#include "data_structures/intern.h"
+#include "data_structures/sstr.h"
+
+/*
+ * The tokens of one source buffer, stored as parallel arrays instead of an array of struct preprocessing_token:
+ * 10 bytes a token instead of 32, and a scan over one field only touches that field.
+ * Every token's name is a slice of the source, so only its offset is kept. Identifiers keep their ID instead of their
+ * length, since the ID gives the spelling anyway; the other tokens keep their length.
+ * A token is referred to by a token_handle, its index in the stream.
+ */
+typedef uint32_t token_handle;
+
+enum token_stream_flag {
+    TOKEN_STREAM_TYPE_MASK = 0x0f, // the low bits are the enum pp_token_type
+    TOKEN_STREAM_AFTER_WHITESPACE = 0x80
+};
+
+struct token_stream {
+    sstr source;
+    uint32_t *offsets;
+    uint32_t *lengths_or_idents;
+    uint8_t *kinds; // enum token_kind
+    uint8_t *flags; // enum token_stream_flag
+    size_t len;
+    size_t capacity;
+    // If not NULL, an identifier's lengths_or_idents is an index into this table rather than its ID. Set for streams
+    // that are used in place from a token cache entry, whose arrays are read-only and aren't freed.
+    const ident_id *local_idents;
+};
+
+// The source has to be less than 4 GiB, and has to outlive the stream
+struct token_stream token_stream_new(sstr source, size_t capacity);
+
+// The token's name has to be a slice of the stream's source
+void token_stream_append(struct token_stream *stream, struct preprocessing_token token);
+
+// Appends other's tokens from first on, which have to be from the same source
+void token_stream_append_all(struct token_stream *stream, const struct token_stream *other, token_handle first);
+
+struct preprocessing_token token_stream_get(const struct token_stream *stream, token_handle handle);
+
+// Every token in the stream, as structs
+pp_token_harr token_stream_to_harr(const struct token_stream *stream);
+
+void token_stream_set_after_whitespace(struct token_stream *stream, token_handle handle, bool after_whitespace);
+
+void token_stream_free_internals(struct token_stream *stream);
+
+static inline enum token_kind token_stream_kind(const struct token_stream *const stream, const token_handle handle) {
+    return (enum token_kind)stream->kinds[handle];
+}
+
+static inline enum pp_token_type token_stream_type(const struct token_stream *const stream, const token_handle handle) {
+    return (enum pp_token_type)(stream->flags[handle] & TOKEN_STREAM_TYPE_MASK);
+}
+
+static inline ident_id token_stream_ident(const struct token_stream *const stream, const token_handle handle) {
+    if (token_stream_type(stream, handle) != IDENTIFIER) return NO_IDENT;
+    const uint32_t value = stream->lengths_or_idents[handle];
+    return stream->local_idents == NULL ? value : stream->local_idents[value];
+}
+
+// Where the token starts in the source
+static inline size_t token_stream_offset(const struct token_stream *const stream, const token_handle handle) {
+    return stream->offsets[handle];
+}
+
+#endif //ICK_TOKEN_STREAM_H
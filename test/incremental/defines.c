@@ -0,0 +1,5 @@
+#define A 1
+int a = A;
+int b;
+#define B 2
+int c = B;
@@ -0,0 +1,103 @@
+/*
+ * Lexes inputs that make a maximal munch lexer backtrack: runs of near-miss punctuators, and literals and header names
+ * that are never closed, so a token could start at every other byte and run on to the end of the input. Checks that
+ * every byte ends up in a token, and that lexing 8 times as much input takes about 8 times as long, not 64.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "data_structures/vector.h"
+#include "debug/malloc.h"
+#include "preprocessor/pp_token.h"
+#include "preprocessor/token_stream.h"
+
+char *ick_progname = "lexer_linear_time";
+
+#define SMALL_REPEATS ((size_t)1 << 14)
+#define MAX_GROWTH 24.0 // how much longer 8 times the input may take
+#define MIN_SECONDS 1e-3 // shorter times are mostly noise
+
+struct pathological_input {
+    const char *description;
+    const char *start; // once, at the start
+    const char *unit; // repeated after it
+    bool starts_in_include;
+};
+
+static const struct pathological_input inputs[] = {
+    { "near-miss %:%: punctuators", "", "%:%", false },
+    { "near-miss ... punctuators", "", "..+", false },
+    { "an unterminated string literal full of escaped quotes", "\"", "\\\"", false },
+    { "an unterminated character constant full of escaped quotes", "'", "\\'", false },
+    { "unterminated string literals", "", "\"a", false },
+    { "unterminated header names", "", "<a", true },
+    { "an unterminated comment", "/", "*", false }
+};
+
+static sstr make_input(const struct pathological_input *const input, const size_t repeats, const bool ends_in_newline) {
+    uchar_vec text = uchar_vec_new(0);
+    uchar_vec_append_all_arr(&text, (const unsigned char *)input->start, strlen(input->start));
+    for (size_t i = 0; i < repeats; i++) {
+        uchar_vec_append_all_arr(&text, (const unsigned char *)input->unit, strlen(input->unit));
+    }
+    if (ends_in_newline) uchar_vec_append(&text, '\n');
+    return text.arr;
+}
+
+static double seconds_since(const struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Lexes the input a few times, and returns the fastest time, or a negative number if some of the input was dropped
+static double time_lexing(const sstr text, const bool starts_in_include) {
+    double best = -1;
+    for (int run = 0; run < 3; run++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        struct token_stream tokens = get_pp_tokens(text, starts_in_include, KEEP_COMMENTS);
+        const double seconds = seconds_since(start);
+        // None of the inputs have spaces, so the tokens have to cover all of it
+        size_t covered = 0;
+        for (token_handle i = 0; i < tokens.len; i++) {
+            covered += token_stream_get(&tokens, i).name.len;
+        }
+        token_stream_free_internals(&tokens);
+        if (covered != text.len) {
+            fprintf(stderr, "    the tokens cover %zu of %zu bytes\n", covered, text.len);
+            return -1;
+        }
+        if (best < 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main(void) {
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        for (int ends_in_newline = 0; ends_in_newline <= 1; ends_in_newline++) {
+            const struct pathological_input *const input = &inputs[i];
+            const sstr small = make_input(input, SMALL_REPEATS, ends_in_newline);
+            const sstr large = make_input(input, 8 * SMALL_REPEATS, ends_in_newline);
+            const double small_seconds = time_lexing(small, input->starts_in_include);
+            const double large_seconds = small_seconds < 0 ? -1 : time_lexing(large, input->starts_in_include);
+            const char *const ending = ends_in_newline ? "ending in a newline" : "without a newline at the end";
+            if (large_seconds < 0) {
+                printf("FAIL %s, %s: some of the input isn't in any token\n", input->description, ending);
+                passed = false;
+            } else if (large_seconds > MAX_GROWTH * (small_seconds > MIN_SECONDS ? small_seconds : MIN_SECONDS)) {
+                printf("FAIL %s, %s: %.4fs for %zu bytes, but %.4fs for %zu bytes\n", input->description, ending,
+                       small_seconds, small.len, large_seconds, large.len);
+                passed = false;
+            } else {
+                printf("ok   %s, %s: %.4fs for %zu bytes, %.4fs for %zu bytes\n", input->description, ending,
+                       small_seconds, small.len, large_seconds, large.len);
+            }
+            FREE(small.data);
+            FREE(large.data);
+        }
+    }
+    return passed ? 0 : 1;
+}
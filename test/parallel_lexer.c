@@ -0,0 +1,129 @@
+/*
+ * Lexes inputs of several MiB, so that get_pp_tokens splits them between threads, and checks that every thread count
+ * gives the same tokens as lexing on one thread. The inputs are random lines of tricky tokens (comments that span
+ * lines, literals with escaped quotes, header names, pp-numbers with signs), so that chunk boundaries land inside all of
+ * them. Some inputs also have one comment longer than a whole chunk, or end in the middle of a comment or a literal.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "data_structures/vector.h"
+#include "debug/malloc.h"
+#include "preprocessor/pp_token.h"
+#include "preprocessor/token_stream.h"
+
+char *ick_progname = "parallel_lexer";
+
+#define INPUT_SIZE ((size_t)4 << 20) // enough for 4 chunks
+#define LONG_COMMENT_SIZE ((size_t)3 << 19) // a chunk and a half
+#define MAX_THREADS 5 // one more than there are chunks
+
+static const char *const fragments[] = {
+    "int f(int a) { return a->b + c[1]; }\n",
+    "/* a comment\n * that spans * a few / lines\n */\n",
+    "x = 1; // a line comment with /* in it\n",
+    "s = \"a \\\"quoted\\\" string /* not a comment */\";\n",
+    "c = '\\'' + 'a' + L'\\\\';\n",
+    "#include <stdio.h>\n",
+    "  #  include \"local.h\" // and a comment\n",
+    "if (a<b && c>d) e <<= 2;\n",
+    "n = 1.5e+10 + .5 + 0x1p-3 + 1..2 + 08e-1f;\n",
+    "%:%: <: :> <% %> ... -> ## #\n",
+    "t = \"unterminated\n",
+    "u = 'also unterminated\n",
+    "a/**/b/* */c\n",
+    "\n",
+    "\t \v \f  spaces\n"
+};
+
+struct input_shape {
+    const char *description;
+    const char *middle; // once, in the middle
+    const char *end; // at the end, after the random lines
+};
+
+static const struct input_shape shapes[] = {
+    { "random lines", "", "" },
+    { "a comment longer than a chunk in the middle", "/*", "*/\nend\n" },
+    { "an unterminated comment at the end", "", "/* never closed\n" },
+    { "an unterminated string literal at the end, without a newline", "", "\"never closed" }
+};
+
+// A fixed linear congruential generator, so that every run lexes the same inputs
+static uint64_t random_state = 1;
+static size_t next_random(const size_t bound) {
+    random_state = random_state * 6364136223846793005u + 1442695040888963407u;
+    return (size_t)(random_state >> 33) % bound;
+}
+
+static void append_random_lines(uchar_vec *const text, const size_t size) {
+    const size_t end = text->arr.len + size;
+    while (text->arr.len < end) {
+        const char *const fragment = fragments[next_random(sizeof(fragments) / sizeof(fragments[0]))];
+        uchar_vec_append_all_arr(text, (const unsigned char *)fragment, strlen(fragment));
+    }
+}
+
+static sstr make_input(const struct input_shape *const shape) {
+    uchar_vec text = uchar_vec_new(INPUT_SIZE + LONG_COMMENT_SIZE + 256);
+    append_random_lines(&text, INPUT_SIZE / 2);
+    if (shape->middle[0] != '\0') {
+        // The random lines have every other kind of token, so the text that's commented out is just as hard to split
+        uchar_vec_append_all_arr(&text, (const unsigned char *)shape->middle, strlen(shape->middle));
+        const size_t comment_start = text.arr.len;
+        append_random_lines(&text, LONG_COMMENT_SIZE);
+        for (size_t i = comment_start; i + 1 < text.arr.len; i++) {
+            // Nothing in the comment can close it
+            if (text.arr.data[i] == '*' && text.arr.data[i + 1] == '/') text.arr.data[i + 1] = '|';
+        }
+    }
+    append_random_lines(&text, INPUT_SIZE / 2);
+    uchar_vec_append_all_arr(&text, (const unsigned char *)shape->end, strlen(shape->end));
+    return text.arr;
+}
+
+// Returns the index of the first token that differs, or SIZE_MAX if the streams are the same
+static size_t first_difference(const struct token_stream *const expected, const struct token_stream *const actual) {
+    for (token_handle i = 0; i < expected->len && i < actual->len; i++) {
+        const struct preprocessing_token token1 = token_stream_get(expected, i);
+        const struct preprocessing_token token2 = token_stream_get(actual, i);
+        if (token1.name.data != token2.name.data || token1.name.len != token2.name.len || token1.type != token2.type
+            || token1.kind != token2.kind || token1.ident != token2.ident || token1.after_whitespace != token2.after_whitespace) {
+            return i;
+        }
+    }
+    return expected->len == actual->len ? SIZE_MAX : (expected->len < actual->len ? expected->len : actual->len);
+}
+
+int main(void) {
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        const sstr text = make_input(&shapes[i]);
+        for (int keep_comments = 0; keep_comments <= 1; keep_comments++) {
+            const enum comment_handling comments = keep_comments ? KEEP_COMMENTS : DISCARD_COMMENTS;
+            set_lexer_threads(1);
+            struct token_stream expected = get_pp_tokens(text, false, comments);
+            bool all_same = true;
+            for (size_t n_threads = 2; n_threads <= MAX_THREADS; n_threads++) {
+                set_lexer_threads(n_threads);
+                struct token_stream actual = get_pp_tokens(text, false, comments);
+                const size_t difference = first_difference(&expected, &actual);
+                if (difference != SIZE_MAX) {
+                    printf("FAIL %s, %s comments, %zu threads: token %zu of %zu differs\n", shapes[i].description,
+                           keep_comments ? "keeping" : "discarding", n_threads, difference, expected.len);
+                    all_same = false;
+                }
+                token_stream_free_internals(&actual);
+            }
+            if (all_same) {
+                printf("ok   %s, %s comments: %zu tokens in %zu bytes\n", shapes[i].description,
+                       keep_comments ? "keeping" : "discarding", expected.len, text.len);
+            }
+            passed = passed && all_same;
+            token_stream_free_internals(&expected);
+        }
+        FREE(text.data);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+ * Feeds inputs to the streaming lexer through a pipe, a few bytes or a few pages at a time, and checks that it gives the
+ * same tokens as lexing the whole input at once. The inputs have line splices and trigraphs in the middle of tokens,
+ * tokens and lines longer than one read, and endings that are easy to get wrong: no newline, a splice, or an open comment.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "data_structures/vector.h"
+#include "debug/malloc.h"
+#include "preprocessor/phases_1_2.h"
+#include "preprocessor/pp_token.h"
+#include "preprocessor/token_stream.h"
+
+char *ick_progname = "streaming_lexer";
+
+#define RANDOM_INPUT_SIZE ((size_t)1 << 20)
+#define LONG_TOKEN_SIZE ((size_t)200 << 10) // a few reads long
+
+static const char *const fragments[] = {
+    "int f(int a) { return a->b + c[1]; }\n",
+    "/* a comment\n * that spans * a few / lines\n */\n",
+    "x = 1; // a line comment \\\n   spliced onto the next line\n",
+    "s = \"a \\\"quoted\\\" str\\\ning\";\n",
+    "lo\\\nng_ide\\\nntifier ?\?/\n= 1 ?\?= 2;\n",
+    "/\\\n* a comment that starts with a splice *\\\n/ after\n",
+    "#include <stdio.h>\n",
+    "n = 1.5e+10 + 0x1p-3 + 1..2;\n",
+    "%:%: <: :> <% %> ... -> ## #\n",
+    "t = \"unterminated\n",
+    "\n",
+    "\t \v \f  spaces\n"
+};
+
+struct input {
+    const char *description;
+    const char *start; // the input is start, then random lines if any, then end
+    size_t random_size;
+    const char *end;
+    bool long_tokens; // if true, a comment and a literal that are longer than a read come after the random lines
+};
+
+static const struct input inputs[] = {
+    { "random lines", "", RANDOM_INPUT_SIZE, "", false },
+    { "tokens longer than a read", "", RANDOM_INPUT_SIZE / 8, "end\n", true },
+    { "an empty input", "", 0, "", false },
+    { "no newline at the end", "int x", 0, "", false },
+    { "a line splice at the end", "int x\\\n", 0, "", false },
+    { "a trigraph line splice at the end", "int x?\?/\n", 0, "", false },
+    { "an unterminated comment at the end", "", RANDOM_INPUT_SIZE / 8, "/* never closed\n", false }
+};
+
+// A fixed linear congruential generator, so that every run lexes the same inputs
+static size_t next_random(uint64_t *const state, const size_t bound) {
+    *state = *state * 6364136223846793005u + 1442695040888963407u;
+    return (size_t)(*state >> 33) % bound;
+}
+
+static void append_cstr(uchar_vec *const text, const char *const str) {
+    uchar_vec_append_all_arr(text, (const unsigned char *)str, strlen(str));
+}
+
+static sstr make_input(const struct input *const input) {
+    uint64_t state = 1;
+    uchar_vec text = uchar_vec_new(0);
+    append_cstr(&text, input->start);
+    while (text.arr.len < input->random_size) {
+        append_cstr(&text, fragments[next_random(&state, sizeof(fragments) / sizeof(fragments[0]))]);
+    }
+    if (input->long_tokens) {
+        append_cstr(&text, "/*");
+        for (size_t i = 0; i < LONG_TOKEN_SIZE; i++) uchar_vec_append(&text, i % 64 == 63 ? '\n' : '*');
+        append_cstr(&text, "*/\n\"");
+        for (size_t i = 0; i < LONG_TOKEN_SIZE; i++) uchar_vec_append(&text, i % 64 == 62 ? '\\' : i % 64 == 63 ? '\n' : 'a');
+        append_cstr(&text, "\"\n");
+    }
+    append_cstr(&text, input->end);
+    return text.arr;
+}
+
+struct writer {
+    sstr text;
+    int fd;
+};
+
+// Writes the text in pieces of random sizes, mostly small, and closes the pipe
+static void *write_in_pieces(void *const arg) {
+    const struct writer *const writer = arg;
+    uint64_t state = 2;
+    for (size_t written = 0; written < writer->text.len;) {
+        size_t piece = next_random(&state, 4) == 0 ? 1 + next_random(&state, 100000) : 1 + next_random(&state, 50);
+        if (piece > writer->text.len - written) piece = writer->text.len - written;
+        const ssize_t n = write(writer->fd, &writer->text.data[written], piece);
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    close(writer->fd);
+    return NULL;
+}
+
+static bool tokens_eq(const struct preprocessing_token token1, const struct preprocessing_token token2) {
+    return sstrs_eq(token1.name, token2.name) && token1.type == token2.type && token1.kind == token2.kind
+        && token1.ident == token2.ident && token1.after_whitespace == token2.after_whitespace;
+}
+
+// Returns the index of the first token that differs, or SIZE_MAX if there's none
+static size_t first_difference(const sstr text, const enum comment_handling comments) {
+    // A source buffer always ends in an extra newline, and so does the streaming lexer's input
+    uchar_vec buffer = uchar_vec_copy_from_arr(text.data, text.len);
+    uchar_vec_append(&buffer, '\n');
+    const struct phases_1_2_info logical_lines = apply_phases_1_2(buffer.arr);
+    struct token_stream expected = get_pp_tokens(logical_lines.result, false, comments);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return 0;
+    }
+    struct writer writer = { .text = text, .fd = fds[1] };
+    pthread_t writer_thread;
+    pthread_create(&writer_thread, NULL, write_in_pieces, &writer);
+    struct lexer *const lexer = lexer_new(fds[0], comments);
+    size_t difference = SIZE_MAX;
+    size_t n_tokens = 0;
+    struct preprocessing_token token;
+    while (next_token(lexer, &token)) {
+        if (n_tokens == expected.len || !tokens_eq(token, token_stream_get(&expected, (token_handle)n_tokens))) {
+            difference = n_tokens;
+            break;
+        }
+        n_tokens++;
+    }
+    if (difference == SIZE_MAX && n_tokens < expected.len) difference = n_tokens;
+    // The writer might still be waiting for the rest to be read
+    while (difference != SIZE_MAX && next_token(lexer, &token)) {}
+    pthread_join(writer_thread, NULL);
+    lexer_free(lexer);
+    close(fds[0]);
+
+    token_stream_free_internals(&expected);
+    if (logical_lines.result.data != buffer.arr.data) FREE(logical_lines.result.data);
+    FREE(logical_lines.map.breakpoints.data);
+    uchar_vec_free_internals(&buffer);
+    return difference;
+}
+
+int main(void) {
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        const sstr text = make_input(&inputs[i]);
+        for (int keep_comments = 0; keep_comments <= 1; keep_comments++) {
+            const size_t difference = first_difference(text, keep_comments ? KEEP_COMMENTS : DISCARD_COMMENTS);
+            const char *const comments = keep_comments ? "keeping" : "discarding";
+            if (difference != SIZE_MAX) {
+                printf("FAIL %s, %s comments: token %zu differs\n", inputs[i].description, comments, difference);
+                passed = false;
+            } else {
+                printf("ok   %s, %s comments: %zu bytes\n", inputs[i].description, comments, text.len);
+            }
+        }
+        FREE(text.data);
+    }
+    return passed ? 0 : 1;
+}